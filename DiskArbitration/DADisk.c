@@ -28,6 +28,7 @@
 #include "DASession.h"
 
 #include <paths.h>
+#include <pthread.h>
 #include <mach/mach.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreFoundation/CFRuntime.h>
@@ -36,11 +37,17 @@
 
 struct __DADisk
 {
-    CFRuntimeBase   _base;
-    CFDictionaryRef _description;
-    char *          _device;
-    char *          _id;
-    DASessionRef    _session;
+    CFRuntimeBase          _base;
+    CFDictionaryRef        _cache;
+    UInt64                 _cacheGeneration;
+    CFDictionaryRef        _description;
+    char *                 _device;
+    UInt64                 _generation;
+    char *                  _id;
+    _DADiskDescriptionIndex _index;
+    CFDataRef               _serialization;
+    DASessionRef            _session;
+    CFMutableDictionaryRef  _values;
 };
 
 typedef struct __DADisk __DADisk;
@@ -66,11 +73,17 @@ static const CFRuntimeClass __DADiskClass =
 
 static CFTypeID __kDADiskTypeID = _kCFRuntimeNotATypeID;
 
+static pthread_mutex_t __gDADiskCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t __gDADiskListLock  = PTHREAD_MUTEX_INITIALIZER;
+
 __private_extern__ void _DAInitialize( void );
 
-__private_extern__ mach_port_t _DASessionGetID( DASessionRef session );
+__private_extern__ CFMutableDictionaryRef _DASessionGetDiskList( DASessionRef session );
+__private_extern__ mach_port_t            _DASessionGetID( DASessionRef session );
+__private_extern__ const _DASnapshot *    _DASessionGetSnapshot( DASessionRef session );
 
 extern CFHashCode CFHashBytes( UInt8 * bytes, CFIndex length );
+extern CFTypeRef  _CFTryRetain( CFTypeRef object );
 
 static CFStringRef __DADiskCopyDescription( CFTypeRef object )
 {
@@ -96,10 +109,16 @@ static DADiskRef __DADiskCreate( CFAllocatorRef allocator, DASessionRef session,
     {
         CFRetain( session );
 
-        disk->_description   = NULL;
-        disk->_device        = NULL;
-        disk->_id            = strdup( id );
-        disk->_session       = session;
+        disk->_cache           = NULL;
+        disk->_cacheGeneration = 0;
+        disk->_description     = NULL;
+        disk->_device          = NULL;
+        disk->_generation      = 0;
+        disk->_id              = strdup( id );
+        disk->_index.state     = _kDADiskDescriptionIndexUnknown;
+        disk->_serialization   = NULL;
+        disk->_session         = session;
+        disk->_values          = NULL;
     }
 
     return disk;
@@ -109,10 +128,29 @@ static void __DADiskDeallocate( CFTypeRef object )
 {
     DADiskRef disk = ( DADiskRef ) object;
 
+    if ( disk->_id && disk->_session )
+    {
+        CFMutableDictionaryRef disks;
+
+        disks = _DASessionGetDiskList( disk->_session );
+
+        pthread_mutex_lock( &__gDADiskListLock );
+
+        if ( CFDictionaryGetValue( disks, disk->_id ) == disk )
+        {
+            CFDictionaryRemoveValue( disks, disk->_id );
+        }
+
+        pthread_mutex_unlock( &__gDADiskListLock );
+    }
+
+    if ( disk->_cache         )  CFRelease( disk->_cache );
     if ( disk->_description   )  CFRelease( disk->_description );
     if ( disk->_device        )  free( disk->_device );
     if ( disk->_id            )  free( disk->_id );
+    if ( disk->_serialization )  CFRelease( disk->_serialization );
     if ( disk->_session       )  CFRelease( disk->_session );
+    if ( disk->_values        )  CFRelease( disk->_values );
 }
 
 static Boolean __DADiskEqual( CFTypeRef object1, CFTypeRef object2 )
@@ -130,7 +168,7 @@ static CFHashCode __DADiskHash( CFTypeRef object )
     return CFHashBytes( ( void * ) disk->_id, MIN( strlen( disk->_id ), 16 ) );
 }
 
-__private_extern__ DADiskRef _DADiskCreate( CFAllocatorRef allocator, DASessionRef session, const char * id )
+static DADiskRef __DADiskCreateWithID( CFAllocatorRef allocator, DASessionRef session, const char * id )
 {
     DADiskRef disk = NULL;
 
@@ -150,48 +188,137 @@ __private_extern__ DADiskRef _DADiskCreate( CFAllocatorRef allocator, DASessionR
     return disk;
 }
 
-DADiskRef _DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization )
+__private_extern__ DADiskRef _DADiskCreate( CFAllocatorRef allocator, DASessionRef session, const char * id )
 {
     DADiskRef disk = NULL;
 
-    if ( serialization )
+    if ( session )
     {
-        CFMutableDictionaryRef description;
+        CFMutableDictionaryRef disks;
+
+        /*
+         * Disk objects are interned per session, so that a client is handed the same object for a disk
+         * every time.  The list does not retain its disks, which may be deallocating while they are still
+         * listed, hence the try retain.
+         */
+
+        disks = _DASessionGetDiskList( session );
+
+        pthread_mutex_lock( &__gDADiskListLock );
 
-        description = _DAUnserializeDiskDescription( CFGetAllocator( session ), serialization );
+        disk = ( void * ) CFDictionaryGetValue( disks, id );
 
-        if ( description )
+        if ( disk )
         {
-            CFDataRef data;
+            disk = ( void * ) _CFTryRetain( disk );
+        }
 
-            data = CFDictionaryGetValue( description, _kDADiskIDKey );
+        if ( disk == NULL )
+        {
+            disk = __DADiskCreateWithID( allocator, session, id );
 
-            if ( data )
+            if ( disk )
             {
-                const char * id;
+                /*
+                 * A disk that is being deallocated may still be listed.  Its entry is removed first,
+                 * since setting the value alone would keep its key, which it is about to free.
+                 */
 
-                id = ( void * ) CFDataGetBytePtr( data );
+                CFDictionaryRemoveValue( disks, disk->_id );
 
-                if ( id )
+                CFDictionarySetValue( disks, disk->_id, disk );
+            }
+        }
+
+        pthread_mutex_unlock( &__gDADiskListLock );
+    }
+
+    return disk;
+}
+
+DADiskRef _DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization )
+{
+    DADiskRef disk = NULL;
+
+    if ( serialization )
+    {
+        CFDataRef               data;
+        _DADiskDescriptionIndex index;
+
+        /*
+         * Decode no more of the description than it takes to find the disk.  The rest is decoded when
+         * the client first asks for it, which a client that merely filters on events may never do.
+         */
+
+        index.state = _kDADiskDescriptionIndexUnknown;
+
+        data = _DAUnserializeDiskDescriptionValue( CFGetAllocator( session ), serialization, &index, _kDADiskIDKey );
+
+        if ( data )
+        {
+            if ( CFGetTypeID( data ) == CFDataGetTypeID( ) && memchr( CFDataGetBytePtr( data ), 0, CFDataGetLength( data ) ) )
+            {
+                disk = _DADiskCreate( CFGetAllocator( session ), session, ( void * ) CFDataGetBytePtr( data ) );
+
+                if ( disk )
                 {
-                    disk = _DADiskCreate( CFGetAllocator( session ), session, id );
+                    CFNumberRef number;
+                    UInt64      generation = 0;
+
+                    number = _DAUnserializeDiskDescriptionValue( CFGetAllocator( session ), serialization, &index, _kDADiskGenerationKey );
 
-                    if ( disk )
+                    if ( number )
                     {
-                        CFDictionaryRemoveValue( description, _kDADiskIDKey );
+                        CFNumberGetValue( number, kCFNumberSInt64Type, &generation );
+
+                        CFRelease( number );
+                    }
+
+                    /*
+                     * Update the interned disk in place, unless it already holds a description at
+                     * least as recent as this one.
+                     */
 
-                        disk->_description = CFRetain( description );
+                    pthread_mutex_lock( &__gDADiskCacheLock );
+
+                    if ( ( disk->_description == NULL && disk->_serialization == NULL ) || disk->_generation < generation )
+                    {
+                        if ( disk->_description   )  CFRelease( disk->_description );
+                        if ( disk->_serialization )  CFRelease( disk->_serialization );
+                        if ( disk->_values        )  CFRelease( disk->_values );
+
+                        disk->_description   = NULL;
+                        disk->_generation    = generation;
+                        disk->_index         = index;
+                        disk->_serialization = CFRetain( serialization );
+                        disk->_values        = NULL;
                     }
+
+                    pthread_mutex_unlock( &__gDADiskCacheLock );
                 }
             }
 
-            CFRelease( description );
+            CFRelease( data );
         }
     }
 
     return disk;
 }
 
+__private_extern__ Boolean _DADiskCopySnapshotRecord( DADiskRef disk, _DASnapshotRecord * record )
+{
+    const _DASnapshot * snapshot;
+
+    snapshot = _DASessionGetSnapshot( disk->_session );
+
+    if ( snapshot )
+    {
+        return _DASnapshotCopyRecord( snapshot, disk->_id, record );
+    }
+
+    return FALSE;
+}
+
 __private_extern__ char * _DADiskGetID( DADiskRef disk )
 {
     return disk->_id;
@@ -214,6 +341,8 @@ __private_extern__ void _DADiskInitialize( void )
 
 __private_extern__ void _DADiskSetDescription( DADiskRef disk, CFDictionaryRef description )
 {
+    pthread_mutex_lock( &__gDADiskCacheLock );
+
     if ( disk->_description )
     {
         CFRelease( disk->_description );
@@ -221,12 +350,29 @@ __private_extern__ void _DADiskSetDescription( DADiskRef disk, CFDictionaryRef d
         disk->_description = NULL;
     }
 
+    if ( disk->_serialization )
+    {
+        CFRelease( disk->_serialization );
+
+        disk->_index.state   = _kDADiskDescriptionIndexUnknown;
+        disk->_serialization = NULL;
+    }
+
+    if ( disk->_values )
+    {
+        CFRelease( disk->_values );
+
+        disk->_values = NULL;
+    }
+
     if ( description )
     {
         CFRetain( description );
 
         disk->_description = description;
-    }    
+    }
+
+    pthread_mutex_unlock( &__gDADiskCacheLock );
 }
 
 CFDictionaryRef DADiskCopyDescription( DADiskRef disk )
@@ -237,32 +383,270 @@ CFDictionaryRef DADiskCopyDescription( DADiskRef disk )
 
     if ( disk )
     {
+        pthread_mutex_lock( &__gDADiskCacheLock );
+
+        if ( disk->_description == NULL && disk->_serialization )
+        {
+            CFMutableDictionaryRef copy;
+
+            copy = _DAUnserializeDiskDescription( CFGetAllocator( disk ), disk->_serialization );
+
+            if ( copy )
+            {
+                CFDictionaryRemoveValue( copy, _kDADiskGenerationKey );
+                CFDictionaryRemoveValue( copy, _kDADiskIDKey );
+
+                disk->_description = copy;
+
+                CFRelease( disk->_serialization );
+
+                disk->_index.state   = _kDADiskDescriptionIndexUnknown;
+                disk->_serialization = NULL;
+
+                if ( disk->_values )
+                {
+                    CFRelease( disk->_values );
+
+                    disk->_values = NULL;
+                }
+            }
+        }
+
         if ( disk->_description )
         {
-            CFRetain( disk->_description );
+            description = CFRetain( disk->_description );
+        }
+
+        pthread_mutex_unlock( &__gDADiskCacheLock );
+
+        if ( description == NULL )
+        {
+            _DASnapshotRecord record;
+            Boolean           snapshot;
+
+            /*
+             * Answer from the description copied last time if the snapshot table shows that it has
+             * not changed since.
+             */
 
-            description = disk->_description;
+            snapshot = _DADiskCopySnapshotRecord( disk, &record );
+
+            if ( snapshot )
+            {
+                pthread_mutex_lock( &__gDADiskCacheLock );
+
+                if ( disk->_cache && disk->_cacheGeneration == record.generation )
+                {
+                    description = CFRetain( disk->_cache );
+                }
+
+                pthread_mutex_unlock( &__gDADiskCacheLock );
+            }
+
+            if ( description == NULL )
+            {
+                vm_address_t           _description;
+                mach_msg_type_number_t _descriptionSize;
+                kern_return_t          status;
+
+                status = _DAServerDiskCopyDescription( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &_description, &_descriptionSize );
+
+                if ( status == KERN_SUCCESS )
+                {
+                    description = _DAUnserializeDiskDescriptionWithBytes( CFGetAllocator( disk ), _description, _descriptionSize );
+
+                    CFDictionaryRemoveValue( ( void * ) description, _kDADiskGenerationKey );
+                    CFDictionaryRemoveValue( ( void * ) description, _kDADiskIDKey );
+
+                    vm_deallocate( mach_task_self( ), _description, _descriptionSize );
+
+                    /*
+                     * The generation was read before the copy, so a change that races with it
+                     * leaves the cache stale by generation and it is copied again next time.
+                     */
+
+                    if ( description && snapshot )
+                    {
+                        pthread_mutex_lock( &__gDADiskCacheLock );
+
+                        if ( disk->_cache )
+                        {
+                            CFRelease( disk->_cache );
+                        }
+
+                        disk->_cache           = CFRetain( description );
+                        disk->_cacheGeneration = record.generation;
+
+                        pthread_mutex_unlock( &__gDADiskCacheLock );
+                    }
+                }
+            }
+        }
+    }
+
+    return description;
+}
+
+static Boolean __DADiskCopySnapshotValue( DADiskRef disk, CFStringRef key, CFTypeRef * value )
+{
+    /*
+     * Answer the most commonly read keys from the slots of the snapshot table, absent keys included,
+     * such that a disk that has yet to be described costs no round trip to the server for them.
+     */
+
+    _DASnapshotRecord record;
+    UInt32            field;
+
+    if      ( CFEqual( key, kDADiskDescriptionMediaBSDNameKey    ) )  field = _kDASnapshotFieldMediaBSDName;
+    else if ( CFEqual( key, kDADiskDescriptionMediaEjectableKey  ) )  field = _kDASnapshotFieldMediaEjectable;
+    else if ( CFEqual( key, kDADiskDescriptionMediaRemovableKey  ) )  field = _kDASnapshotFieldMediaRemovable;
+    else if ( CFEqual( key, kDADiskDescriptionMediaWholeKey      ) )  field = _kDASnapshotFieldMediaWhole;
+    else if ( CFEqual( key, kDADiskDescriptionMediaWritableKey   ) )  field = _kDASnapshotFieldMediaWritable;
+    else if ( CFEqual( key, kDADiskDescriptionVolumeMountableKey ) )  field = _kDASnapshotFieldVolumeMountable;
+    else if ( CFEqual( key, kDADiskDescriptionVolumePathKey      ) )  field = _kDASnapshotFieldVolumePath;
+    else                                                              return FALSE;
+
+    if ( _DADiskCopySnapshotRecord( disk, &record ) == FALSE )
+    {
+        return FALSE;
+    }
+
+    if ( ( record.fields & field ) == 0 )
+    {
+        return FALSE;
+    }
+
+    *value = NULL;
+
+    if ( record.present & field )
+    {
+        if ( field == _kDASnapshotFieldMediaBSDName )
+        {
+            *value = CFStringCreateWithCString( CFGetAllocator( disk ), record.mediaBSDName, kCFStringEncodingUTF8 );
+        }
+        else if ( field == _kDASnapshotFieldVolumePath )
+        {
+            *value = CFURLCreateFromFileSystemRepresentation( CFGetAllocator( disk ), ( void * ) record.volumePath, strlen( record.volumePath ), TRUE );
         }
         else
         {
-            vm_address_t           _description;
-            mach_msg_type_number_t _descriptionSize;
-            kern_return_t          status;
+            *value = CFRetain( ( record.values & field ) ? kCFBooleanTrue : kCFBooleanFalse );
+        }
+
+        if ( *value == NULL )
+        {
+            return FALSE;
+        }
+    }
 
-            status = _DAServerDiskCopyDescription( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &_description, &_descriptionSize );
+    return TRUE;
+}
+
+CFTypeRef DADiskCopyDescriptionValue( DADiskRef disk, CFStringRef key )
+{
+    CFTypeRef value;
+
+    value = NULL;
+
+    if ( disk && key )
+    {
+        Boolean found = FALSE;
 
-            if ( status == KERN_SUCCESS )
+        pthread_mutex_lock( &__gDADiskCacheLock );
+
+        if ( disk->_description )
+        {
+            value = CFDictionaryGetValue( disk->_description, key );
+
+            if ( value )
+            {
+                CFRetain( value );
+            }
+
+            found = TRUE;
+        }
+        else if ( disk->_serialization )
+        {
+            /*
+             * Decode the one key from the serialized description, and remember the outcome for the next
+             * time, absent keys included.  The trailer of the serialization is parsed on the first miss
+             * and kept alongside it, so that later misses go straight to the key.
+             */
+
+            if ( disk->_values == NULL )
+            {
+                disk->_values = CFDictionaryCreateMutable( CFGetAllocator( disk ), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+            }
+
+            if ( disk->_values )
+            {
+                value = CFDictionaryGetValue( disk->_values, key );
+
+                if ( value == NULL )
+                {
+                    /*
+                     * The generation and ID ride along in the serialization for the framework alone, and are
+                     * not keys of the description.
+                     */
+
+                    if ( CFEqual( key, _kDADiskGenerationKey ) == FALSE && CFEqual( key, _kDADiskIDKey ) == FALSE )
+                    {
+                        value = _DAUnserializeDiskDescriptionValue( CFGetAllocator( disk ), disk->_serialization, &disk->_index, key );
+                    }
+
+                    CFDictionarySetValue( disk->_values, key, value ? value : kCFNull );
+
+                    if ( value )
+                    {
+                        CFRelease( value );
+                    }
+                    else
+                    {
+                        value = kCFNull;
+                    }
+                }
+
+                if ( value == kCFNull )
+                {
+                    value = NULL;
+                }
+                else
+                {
+                    CFRetain( value );
+                }
+
+                found = TRUE;
+            }
+        }
+
+        pthread_mutex_unlock( &__gDADiskCacheLock );
+
+        if ( found == FALSE )
+        {
+            found = __DADiskCopySnapshotValue( disk, key, &value );
+        }
+
+        if ( found == FALSE )
+        {
+            CFDictionaryRef description;
+
+            description = DADiskCopyDescription( disk );
+
+            if ( description )
             {
-                description = _DAUnserializeDiskDescriptionWithBytes( CFGetAllocator( disk ), _description, _descriptionSize );
+                value = CFDictionaryGetValue( description, key );
 
-                CFDictionaryRemoveValue( ( void * ) description, _kDADiskIDKey );
+                if ( value )
+                {
+                    CFRetain( value );
+                }
 
-                vm_deallocate( mach_task_self( ), _description, _descriptionSize );
+                CFRelease( description );
             }
         }
     }
 
-    return description;
+    return value;
 }
 
 io_service_t DADiskCopyIOMedia( DADiskRef disk )
@@ -348,7 +732,12 @@ DADiskRef DADiskCreateFromBSDName( CFAllocatorRef allocator, DASessionRef sessio
             strlcpy( id, name, sizeof( id ) );
         }
 
-        disk = _DADiskCreate( allocator, session, id );
+        /*
+         * A disk created by the client is not interned, such that it never carries the description of
+         * an earlier callback, and its description is always copied from the server.
+         */
+
+        disk = __DADiskCreateWithID( allocator, session, id );
     }
 
     return disk;
@@ -416,7 +805,7 @@ DADiskRef DADiskCreateFromVolumePath( CFAllocatorRef allocator, DASessionRef ses
 
                 if ( id )
                 {
-                    disk = _DADiskCreate( allocator, session, id );
+                    disk = __DADiskCreateWithID( allocator, session, id );
 
                     free( id );
                 }
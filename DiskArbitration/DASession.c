@@ -26,6 +26,7 @@
 #include "DADisk.h"
 #include "DAInternal.h"
 #include "DAServer.h"
+#include "DiskArbitrationPrivate.h"
 
 #include <bootstrap_priv.h>
 #include <crt_externs.h>
@@ -34,6 +35,7 @@
 #include <unistd.h>
 #include <dispatch/dispatch.h>
 #include <mach/mach.h>
+#include <mach/mach_vm.h>
 #include <mach-o/dyld.h>
 #include <servers/bootstrap.h>
 #include <CoreFoundation/CoreFoundation.h>
@@ -46,7 +48,9 @@ struct __DASession
     CFRuntimeBase           _base;
 
     AuthorizationRef        _authorization;
+    CFMutableArrayRef       _batch;
     CFMachPortRef           _client;
+    CFMutableDictionaryRef  _disks;
     char *                  _name;
     pid_t                    _pid;
     mach_port_t             _server;
@@ -56,6 +60,13 @@ struct __DASession
     CFMutableDictionaryRef  _register;
     SInt32                  _registerIndex;
     pthread_mutex_t         _registerLock;
+    const _DAEventRing *    _ring;
+    DADiskEventCallback     _ringCallback;
+    void *                  _ringContext;
+    pthread_mutex_t         _ringLock;
+    UInt64                  _ringTail;
+    const _DASnapshot *     _snapshot;
+    kern_return_t           _snapshotError;
 };
 
 typedef struct __DASession __DASession;
@@ -82,6 +93,7 @@ static const CFRuntimeClass __DASessionClass =
 static CFTypeID __kDASessionTypeID = _kCFRuntimeNotATypeID;
 
 static pthread_mutex_t __gDASessionSetAuthorizationLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t __gDASessionSnapshotLock         = PTHREAD_MUTEX_INITIALIZER;
 
 const CFStringRef kDAApprovalRunLoopMode = CFSTR( "kDAApprovalRunLoopMode" );
 
@@ -92,8 +104,32 @@ __private_extern__ void _DADispatchCallback( DASessionRef    session,
                                              CFTypeRef       argument0,
                                              CFTypeRef       argument1 );
 
+__private_extern__ DADiskRef _DADiskCreate( CFAllocatorRef allocator, DASessionRef session, const char * id );
+
 __private_extern__ void _DAInitialize( void );
 
+extern CFHashCode CFHashBytes( UInt8 * bytes, CFIndex length );
+
+static Boolean __DASessionDiskListEqual( const void * value1, const void * value2 )
+{
+    return ( strcmp( value1, value2 ) == 0 );
+}
+
+static CFHashCode __DASessionDiskListHash( const void * value )
+{
+    return CFHashBytes( ( void * ) value, MIN( strlen( value ), 16 ) );
+}
+
+static const CFDictionaryKeyCallBacks __kDASessionDiskListKeyCallBacks =
+{
+    0,
+    NULL,
+    NULL,
+    NULL,
+    __DASessionDiskListEqual,
+    __DASessionDiskListHash
+};
+
 static CFStringRef __DASessionCopyDescription( CFTypeRef object )
 {
     DASessionRef session = ( DASessionRef ) object;
@@ -122,14 +158,17 @@ static CFStringRef __DASessionCopyFormattingDescription( CFTypeRef object, CFDic
 
 static DASessionRef __DASessionCreate( CFAllocatorRef allocator )
 {
-    __DASession * session;
+    pthread_mutexattr_t attributes;
+    __DASession *       session;
 
     session = ( void * ) _CFRuntimeCreateInstance( allocator, __kDASessionTypeID, sizeof( __DASession ) - sizeof( CFRuntimeBase ), NULL );
 
     if ( session )
     {
         session->_authorization = NULL;
+        session->_batch         = NULL;
         session->_client        = NULL;
+        session->_disks         = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &__kDASessionDiskListKeyCallBacks, NULL );
         session->_name          = NULL;
         session->_pid           = 0;
         session->_server        = MACH_PORT_NULL;
@@ -138,8 +177,25 @@ static DASessionRef __DASessionCreate( CFAllocatorRef allocator )
         session->_sourceCount   = 0;
         session->_register      = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
         session->_registerIndex = 0;
+        session->_ring          = NULL;
+        session->_ringCallback  = NULL;
+        session->_ringContext   = NULL;
+        session->_ringTail      = 0;
+        session->_snapshot      = NULL;
+        session->_snapshotError = KERN_SUCCESS;
         pthread_mutex_init( &session->_registerLock, NULL );
 
+        /*
+         * The ring lock is recursive, such that the event callback may register another callback,
+         * or none, from within.
+         */
+
+        pthread_mutexattr_init( &attributes );
+        pthread_mutexattr_settype( &attributes, PTHREAD_MUTEX_RECURSIVE );
+        pthread_mutex_init( &session->_ringLock, &attributes );
+        pthread_mutexattr_destroy( &attributes );
+
+        assert( session->_disks );
         assert( session->_register );
     }
 
@@ -155,10 +211,15 @@ static void __DASessionDeallocate( CFTypeRef object )
     assert( session->_source2 == NULL );
 
     if ( session->_authorization )  AuthorizationFree( session->_authorization, kAuthorizationFlagDefaults );
+    if ( session->_batch         )  CFRelease( session->_batch );
+    if ( session->_disks         )  CFRelease( session->_disks );
     if ( session->_name          )  free( session->_name );
     if ( session->_server        )  mach_port_deallocate( mach_task_self( ), session->_server );
     if ( session->_register )       CFRelease( session->_register );
+    if ( session->_ring )           mach_vm_deallocate( mach_task_self( ), ( mach_vm_address_t ) session->_ring, round_page( sizeof( _DAEventRing ) ) );
+    if ( session->_snapshot )       mach_vm_deallocate( mach_task_self( ), ( mach_vm_address_t ) session->_snapshot, round_page( sizeof( _DASnapshot ) ) );
     pthread_mutex_destroy( &session->_registerLock );
+    pthread_mutex_destroy( &session->_ringLock );
 }
 
 static Boolean __DASessionEqual( CFTypeRef object1, CFTypeRef object2 )
@@ -176,6 +237,114 @@ static CFHashCode __DASessionHash( CFTypeRef object )
     return ( CFHashCode ) session->_server;
 }
 
+static void __DASessionDrainEventRing( DASessionRef session )
+{
+    const _DAEventRing * ring;
+    UInt64               head;
+    Boolean              overflow;
+
+    ring = session->_ring;
+
+    head = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+
+    /*
+     * The ring is overwritten in place once it is full.  Having fallen more than a lap behind, or
+     * finding a record overtaken while it is read, the client has lost events and is told so, and
+     * picks up again from the current head.
+     */
+
+    overflow = ( head - session->_ringTail > _kDAEventRingCount ) ? TRUE : FALSE;
+
+    while ( overflow == FALSE && session->_ringTail < head )
+    {
+        const _DAEventRecord * entry;
+        _DAEventRecord         record;
+
+        entry = &ring->records[ session->_ringTail % _kDAEventRingCount ];
+
+        memcpy( &record, entry, sizeof( _DAEventRecord ) );
+
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+        if ( record.index != session->_ringTail + 1 || __atomic_load_n( &entry->index, __ATOMIC_RELAXED ) != record.index || record.id[0] == 0 )
+        {
+            overflow = TRUE;
+
+            break;
+        }
+
+        record.id[ sizeof( record.id ) - 1 ] = 0;
+
+        session->_ringTail++;
+
+        if ( session->_ringCallback )
+        {
+            DADiskEventKind kind;
+
+            switch ( record.kind )
+            {
+                case _kDADiskAppearedCallback:
+                {
+                    kind = kDADiskEventAppeared;
+
+                    break;
+                }
+                case _kDADiskDescriptionChangedCallback:
+                {
+                    kind = kDADiskEventDescriptionChanged;
+
+                    break;
+                }
+                case _kDADiskDisappearedCallback:
+                {
+                    kind = kDADiskEventDisappeared;
+
+                    break;
+                }
+                default:
+                {
+                    kind = 0;
+
+                    break;
+                }
+            }
+
+            if ( kind )
+            {
+                DADiskRef disk;
+
+                disk = _DADiskCreate( CFGetAllocator( session ), session, record.id );
+
+                if ( disk )
+                {
+                    ( session->_ringCallback )( disk, kind, session->_ringContext );
+
+                    CFRelease( disk );
+                }
+
+                /*
+                 * The callback may have released the ring from within.
+                 */
+
+                if ( session->_ring != ring )
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    if ( overflow )
+    {
+        session->_ringTail = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+
+        if ( session->_ringCallback )
+        {
+            ( session->_ringCallback )( NULL, kDADiskEventOverflow, session->_ringContext );
+        }
+    }
+}
+
 __private_extern__ void _DASessionCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info )
 {
     vm_address_t           _queue;
@@ -183,6 +352,30 @@ __private_extern__ void _DASessionCallback( CFMachPortRef port, void * message,
     DASessionRef           session = info;
     kern_return_t          status;
 
+    pthread_mutex_lock( &session->_ringLock );
+
+    if ( session->_ring )
+    {
+        __DASessionDrainEventRing( session );
+
+        /*
+         * The wakeup is shared with the event ring.  Skip the copy when the server has not marked
+         * the callback queue as ready.
+         */
+
+        if ( session->_ring )
+        {
+            if ( __atomic_load_n( &session->_ring->queue, __ATOMIC_ACQUIRE ) == 0 )
+            {
+                pthread_mutex_unlock( &session->_ringLock );
+
+                return;
+            }
+        }
+    }
+
+    pthread_mutex_unlock( &session->_ringLock );
+
     status = _DAServerSessionCopyCallbackQueue( session->_server, &_queue, &_queueSize );
 
     if ( status == KERN_SUCCESS )
@@ -295,11 +488,81 @@ __private_extern__ mach_port_t _DASessionGetClientPort( DASessionRef session )
 
 #endif /* !__LP64__ */
 
+__private_extern__ CFMutableDictionaryRef _DASessionGetDiskList( DASessionRef session )
+{
+    return session->_disks;
+}
+
 __private_extern__ mach_port_t _DASessionGetID( DASessionRef session )
 {
     return session->_server;
 }
 
+__private_extern__ CFMutableArrayRef _DASessionGetRequestBatch( DASessionRef session )
+{
+    return session->_batch;
+}
+
+__private_extern__ const _DASnapshot * _DASessionGetSnapshot( DASessionRef session )
+{
+    const _DASnapshot * snapshot;
+
+    pthread_mutex_lock( &__gDASessionSnapshotLock );
+
+    snapshot = session->_snapshot;
+
+    if ( snapshot == NULL )
+    {
+        if ( session->_server && session->_snapshotError == KERN_SUCCESS )
+        {
+            mach_port_t   port;
+            kern_return_t status;
+
+            /*
+             * Map the server's snapshot table.  A failure is remembered, so that a server without
+             * the table is not asked again for the life of the session.
+             */
+
+            status = _DAServerSessionCopySnapshot( session->_server, &port );
+
+            if ( status == KERN_SUCCESS )
+            {
+                mach_vm_address_t address;
+
+                address = 0;
+
+                status = mach_vm_map( mach_task_self( ), &address, round_page( sizeof( _DASnapshot ) ), 0, VM_FLAGS_ANYWHERE, port, 0, FALSE, VM_PROT_READ, VM_PROT_READ, VM_INHERIT_NONE );
+
+                if ( status == KERN_SUCCESS )
+                {
+                    snapshot = ( void * ) address;
+
+                    if ( snapshot->version == _kDASnapshotVersion && snapshot->count == _kDASnapshotCount )
+                    {
+                        session->_snapshot = snapshot;
+                    }
+                    else
+                    {
+                        mach_vm_deallocate( mach_task_self( ), address, round_page( sizeof( _DASnapshot ) ) );
+
+                        snapshot = NULL;
+
+                        status = KERN_FAILURE;
+                    }
+                }
+
+                mach_port_deallocate( mach_task_self( ), port );
+            }
+
+            session->_snapshotError = status;
+        }
+    }
+
+    pthread_mutex_unlock( &__gDASessionSnapshotLock );
+
+    return snapshot;
+}
+
 __private_extern__ void _DASessionInitialize( void )
 {
     __kDASessionTypeID = _CFRuntimeRegisterClass( &__DASessionClass );
@@ -380,6 +643,94 @@ __private_extern__ void _DASessionScheduleWithRunLoop( DASessionRef session )
     }
 }
 
+__private_extern__ DAReturn _DASessionSetEventCallback( DASessionRef session, DADiskEventCallback callback, void * context )
+{
+    DAReturn status;
+
+    status = kDAReturnSuccess;
+
+    pthread_mutex_lock( &session->_ringLock );
+
+    if ( callback == NULL )
+    {
+        /*
+         * Stop the server from writing events and from marking the shared wakeup, then let go of
+         * the ring.
+         */
+
+        if ( session->_ring )
+        {
+            _DAServerSessionReleaseEventRing( session->_server );
+
+            mach_vm_deallocate( mach_task_self( ), ( mach_vm_address_t ) session->_ring, round_page( sizeof( _DAEventRing ) ) );
+
+            session->_ring = NULL;
+        }
+    }
+    else if ( session->_ring == NULL )
+    {
+        mach_port_t port;
+
+        status = _DAServerSessionCopyEventRing( session->_server, &port );
+
+        if ( status == KERN_SUCCESS )
+        {
+            mach_vm_address_t address;
+
+            address = 0;
+
+            status = mach_vm_map( mach_task_self( ), &address, round_page( sizeof( _DAEventRing ) ), 0, VM_FLAGS_ANYWHERE, port, 0, FALSE, VM_PROT_READ, VM_PROT_READ, VM_INHERIT_NONE );
+
+            if ( status == KERN_SUCCESS )
+            {
+                const _DAEventRing * ring;
+
+                ring = ( void * ) address;
+
+                if ( ring->version == _kDAEventRingVersion && ring->count == _kDAEventRingCount )
+                {
+                    session->_ringTail = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+
+                    session->_ring = ring;
+                }
+                else
+                {
+                    mach_vm_deallocate( mach_task_self( ), address, round_page( sizeof( _DAEventRing ) ) );
+
+                    status = kDAReturnUnsupported;
+                }
+            }
+
+            mach_port_deallocate( mach_task_self( ), port );
+        }
+    }
+
+    if ( status == kDAReturnSuccess )
+    {
+        session->_ringCallback = callback;
+        session->_ringContext  = context;
+    }
+
+    pthread_mutex_unlock( &session->_ringLock );
+
+    return status;
+}
+
+__private_extern__ void _DASessionSetRequestBatch( DASessionRef session, CFMutableArrayRef batch )
+{
+    if ( batch )
+    {
+        CFRetain( batch );
+    }
+
+    if ( session->_batch )
+    {
+        CFRelease( session->_batch );
+    }
+
+    session->_batch = batch;
+}
+
 __private_extern__ void _DASessionUnscheduleFromRunLoop( DASessionRef session )
 {
     if ( session->_sourceCount == 1 )
@@ -40,14 +40,16 @@ CFDictionaryRef kDADiskDescriptionMatchVolumeUnrecognized = NULL;
 CFArrayRef kDADiskDescriptionWatchVolumeName = NULL;
 CFArrayRef kDADiskDescriptionWatchVolumePath = NULL;
 
+__private_extern__ Boolean     _DADiskCopySnapshotRecord( DADiskRef disk, _DASnapshotRecord * record );
 __private_extern__ char *      _DADiskGetID( DADiskRef disk );
 __private_extern__ mach_port_t _DADiskGetSessionID( DADiskRef disk );
 __private_extern__ void        _DADiskInitialize( void );
 __private_extern__ void        _DADiskSetDescription( DADiskRef disk, CFDictionaryRef description );
 
-__private_extern__ AuthorizationRef _DASessionGetAuthorization( DASessionRef session );
-__private_extern__ mach_port_t      _DASessionGetID( DASessionRef session );
-__private_extern__ void             _DASessionInitialize( void );
+__private_extern__ AuthorizationRef  _DASessionGetAuthorization( DASessionRef session );
+__private_extern__ mach_port_t       _DASessionGetID( DASessionRef session );
+__private_extern__ CFMutableArrayRef _DASessionGetRequestBatch( DASessionRef session );
+__private_extern__ void              _DASessionInitialize( void );
 
 /*
  * Helper functions used by framework for storing callback information in the session's register dictionary
@@ -160,32 +162,88 @@ static DAReturn __DAQueueRequest( DASessionRef   session,
 
     if ( session )
     {
-        CFDataRef _argument2 = NULL;
-        CFDataRef _argument3 = NULL;
-
-        if ( argument2 )  _argument2 = _DASerialize( kCFAllocatorDefault, argument2 );
-        if ( argument3 )  _argument3 = _DASerialize( kCFAllocatorDefault, argument3 );
+        CFMutableArrayRef      batch;
+        CFMutableDictionaryRef callback;
+        SInt32                 index;
 
         /*
          * store the callback and context in the session instead of passing it directly over to the server for security reasons.
          * pass the handle to the callback object to the server which will be used to lookup the correct callback
          */
-        CFMutableDictionaryRef   callback =  DACallbackCreate(kCFAllocatorDefault, address, context);
-        SInt32 index = DAAddCallbackToSession(session, callback);
-        CFRelease(callback);
-        status = _DAServerSessionQueueRequest( _DASessionGetID( session ),
-                                               ( uint32_t                ) kind,
-                                               ( caddr_t                ) _DADiskGetID( argument0 ),
-                                               ( int32_t                ) argument1,
-                                               ( vm_address_t           ) ( _argument2 ? CFDataGetBytePtr( _argument2 ) : 0 ),
-                                               ( mach_msg_type_number_t ) ( _argument2 ? CFDataGetLength(  _argument2 ) : 0 ),
-                                               ( vm_address_t           ) ( _argument3 ? CFDataGetBytePtr( _argument3 ) : 0 ),
-                                               ( mach_msg_type_number_t ) ( _argument3 ? CFDataGetLength(  _argument3 ) : 0 ),
-                                               ( uintptr_t              ) index,
-                                               ( uintptr_t              ) index );
-
-        if ( _argument2 )  CFRelease( _argument2 );
-        if ( _argument3 )  CFRelease( _argument3 );
+        callback = DACallbackCreate( kCFAllocatorDefault, address, context );
+        index    = DAAddCallbackToSession( session, callback );
+        CFRelease( callback );
+
+        batch = _DASessionGetRequestBatch( session );
+
+        if ( batch )
+        {
+            CFMutableDictionaryRef request;
+
+            /*
+             * Hold the request in the session's open batch, to be sent along with the rest of it.
+             */
+
+            status = kDAReturnNoResources;
+
+            request = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            if ( request )
+            {
+                CFStringRef id;
+
+                id = CFStringCreateWithCString( kCFAllocatorDefault, _DADiskGetID( argument0 ), kCFStringEncodingUTF8 );
+
+                if ( id )
+                {
+                    ___CFDictionarySetIntegerValue( request, _kDARequestKindKey, kind );
+
+                    CFDictionarySetValue( request, _kDARequestDiskKey, id );
+
+                    ___CFDictionarySetIntegerValue( request, _kDARequestArgument1Key, argument1 );
+
+                    if ( argument2 )  CFDictionarySetValue( request, _kDARequestArgument2Key, argument2 );
+                    if ( argument3 )  CFDictionarySetValue( request, _kDARequestArgument3Key, argument3 );
+
+                    ___CFDictionarySetIntegerValue( request, _kDACallbackAddressKey, index );
+
+                    CFArrayAppendValue( batch, request );
+
+                    status = kDAReturnSuccess;
+
+                    CFRelease( id );
+                }
+
+                CFRelease( request );
+            }
+
+            if ( status )
+            {
+                DARemoveCallbackFromSessionWithKey( session, index );
+            }
+        }
+        else
+        {
+            CFDataRef _argument2 = NULL;
+            CFDataRef _argument3 = NULL;
+
+            if ( argument2 )  _argument2 = _DASerialize( kCFAllocatorDefault, argument2 );
+            if ( argument3 )  _argument3 = _DASerialize( kCFAllocatorDefault, argument3 );
+
+            status = _DAServerSessionQueueRequest( _DASessionGetID( session ),
+                                                   ( uint32_t                ) kind,
+                                                   ( caddr_t                ) _DADiskGetID( argument0 ),
+                                                   ( int32_t                ) argument1,
+                                                   ( vm_address_t           ) ( _argument2 ? CFDataGetBytePtr( _argument2 ) : 0 ),
+                                                   ( mach_msg_type_number_t ) ( _argument2 ? CFDataGetLength(  _argument2 ) : 0 ),
+                                                   ( vm_address_t           ) ( _argument3 ? CFDataGetBytePtr( _argument3 ) : 0 ),
+                                                   ( mach_msg_type_number_t ) ( _argument3 ? CFDataGetLength(  _argument3 ) : 0 ),
+                                                   ( uintptr_t              ) index,
+                                                   ( uintptr_t              ) index );
+
+            if ( _argument2 )  CFRelease( _argument2 );
+            if ( _argument3 )  CFRelease( _argument3 );
+        }
     }
 
     return status;
@@ -225,13 +283,21 @@ __private_extern__ DAReturn _DAAuthorize( DASessionRef session, _DAAuthorizeOpti
     {
         if ( ( options & _kDAAuthorizeOptionIsOwner ) )
         {
-            uid_t diskUID;
-
-            status = _DAServerDiskGetUserUID( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &diskUID );
+            _DASnapshotRecord record;
+            uid_t             diskUID;
 
-            if ( status )
+            if ( _DADiskCopySnapshotRecord( disk, &record ) )
             {
-                return status;
+                diskUID = record.userUID;
+            }
+            else
+            {
+                status = _DAServerDiskGetUserUID( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &diskUID );
+
+                if ( status )
+                {
+                    return status;
+                }
             }
 
             status = kDAReturnNotPrivileged;
@@ -343,6 +409,7 @@ static bool DARequestKindWithResponse(_DARequestKind kind)
         case _kDADiskMountCallback:
         case _kDADiskRenameCallback:
         case _kDADiskUnmountCallback:
+        case _kDADiskDescriptionsCallback:
         {
             daRequest = true;
             break;
@@ -487,6 +554,96 @@ __private_extern__ void _DADispatchCallback( DASessionRef    session,
 
             break;
        }
+        case _kDADiskListSnapshotCallback:
+        {
+            CFMutableArrayRef disks;
+            CFArrayRef        serializations;
+
+            serializations = CFDictionaryGetValue( argument1, _kDADiskListDisksKey );
+
+            disks = CFArrayCreateMutable( CFGetAllocator( session ), 0, &kCFTypeArrayCallBacks );
+
+            if ( disks )
+            {
+                CFIndex count;
+                CFIndex index;
+
+                count = serializations ? CFArrayGetCount( serializations ) : 0;
+
+                for ( index = 0; index < count; index++ )
+                {
+                    DADiskRef item;
+
+                    item = _DADiskCreateFromSerialization( CFGetAllocator( session ), session, CFArrayGetValueAtIndex( serializations, index ) );
+
+                    if ( item )
+                    {
+                        CFArrayAppendValue( disks, item );
+
+                        CFRelease( item );
+                    }
+                }
+
+                ( ( DADiskListSnapshotCallback ) address )( disks, ___CFDictionaryGetIntegerValue( argument1, _kDADiskListGenerationKey ), context );
+
+                CFRelease( disks );
+            }
+
+            break;
+        }
+        case _kDADiskDescriptionsCallback:
+        {
+            CFMutableArrayRef descriptions;
+
+            descriptions = CFArrayCreateMutable( CFGetAllocator( session ), 0, &kCFTypeArrayCallBacks );
+
+            if ( descriptions )
+            {
+                CFIndex count;
+                CFIndex index;
+
+                count = argument1 ? CFArrayGetCount( argument1 ) : 0;
+
+                for ( index = 0; index < count; index++ )
+                {
+                    CFDictionaryRef description = NULL;
+                    CFDataRef       serialization;
+
+                    serialization = CFArrayGetValueAtIndex( argument1, index );
+
+                    if ( CFDataGetLength( serialization ) )
+                    {
+                        DADiskRef item;
+
+                        item = _DADiskCreateFromSerialization( CFGetAllocator( session ), session, serialization );
+
+                        if ( item )
+                        {
+                            description = DADiskCopyDescription( item );
+
+                            CFRelease( item );
+                        }
+                    }
+
+                    if ( description )
+                    {
+                        CFArrayAppendValue( descriptions, description );
+
+                        CFRelease( description );
+                    }
+                    else
+                    {
+                        CFArrayAppendValue( descriptions, kCFNull );
+                    }
+                }
+
+                ( ( DADiskDescriptionsCallback ) address )( descriptions, context );
+
+                CFRelease( descriptions );
+            }
+
+            break;
+        }
 
     }
 
@@ -542,8 +699,9 @@ __private_extern__ void _DARegisterCallback( DASessionRef    session,
 {
     if ( session )
     {
-        CFDataRef _match = NULL;
-        CFDataRef _watch = NULL;
+        CFMutableArrayRef batch;
+        CFDataRef         _match = NULL;
+        CFDataRef         _watch = NULL;
 
         if ( match )  _match = _DASerializeDiskDescription( kCFAllocatorDefault, match );
         if ( watch )  _watch = _DASerialize( kCFAllocatorDefault, watch );
@@ -555,15 +713,46 @@ __private_extern__ void _DARegisterCallback( DASessionRef    session,
         CFMutableDictionaryRef   callback =  DACallbackCreate(kCFAllocatorDefault, address, context);
         SInt32 index = DAAddCallbackToSession(session, callback);
         CFRelease(callback);
-        _DAServerSessionRegisterCallback( _DASessionGetID( session ),
-                                          ( uintptr_t              ) index,
-                                          ( uintptr_t              ) index,
-                                          ( uint32_t                ) kind,
-                                          ( int32_t                ) order,
-                                          ( vm_address_t           ) ( _match ? CFDataGetBytePtr( _match ) : 0 ),
-                                          ( mach_msg_type_number_t ) ( _match ? CFDataGetLength(  _match ) : 0 ),
-                                          ( vm_address_t           ) ( _watch ? CFDataGetBytePtr( _watch ) : 0 ),
-                                          ( mach_msg_type_number_t ) ( _watch ? CFDataGetLength(  _watch ) : 0 ) );
+
+        batch = _DASessionGetRequestBatch( session );
+
+        if ( batch )
+        {
+            CFMutableDictionaryRef registration;
+
+            /*
+             * Hold the registration in the session's open batch, to be installed along with the rest of it.
+             */
+
+            registration = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            if ( registration )
+            {
+                ___CFDictionarySetIntegerValue( registration, _kDACallbackAddressKey, index );
+                ___CFDictionarySetIntegerValue( registration, _kDACallbackContextKey, index );
+                ___CFDictionarySetIntegerValue( registration, _kDACallbackKindKey,    kind  );
+                ___CFDictionarySetIntegerValue( registration, _kDACallbackOrderKey,   order );
+
+                if ( _match )  CFDictionarySetValue( registration, _kDACallbackMatchKey, _match );
+                if ( _watch )  CFDictionarySetValue( registration, _kDACallbackWatchKey, _watch );
+
+                CFArrayAppendValue( batch, registration );
+
+                CFRelease( registration );
+            }
+        }
+        else
+        {
+            _DAServerSessionRegisterCallback( _DASessionGetID( session ),
+                                              ( uintptr_t              ) index,
+                                              ( uintptr_t              ) index,
+                                              ( uint32_t               ) kind,
+                                              ( int32_t                ) order,
+                                              ( vm_address_t           ) ( _match ? CFDataGetBytePtr( _match ) : 0 ),
+                                              ( mach_msg_type_number_t ) ( _match ? CFDataGetLength(  _match ) : 0 ),
+                                              ( vm_address_t           ) ( _watch ? CFDataGetBytePtr( _watch ) : 0 ),
+                                              ( mach_msg_type_number_t ) ( _watch ? CFDataGetLength(  _watch ) : 0 ) );
+        }
 
         if ( _match )  CFRelease( _match );
         if ( _watch )  CFRelease( _watch );
@@ -574,13 +763,41 @@ __private_extern__ void _DAUnregisterCallback( DASessionRef session, void * addr
 {
     if ( session )
     {
+        CFMutableArrayRef batch;
+
         /*
          * Remove the callback address and context from the session's register dict table
          * pass the handle to the callback object to the server to unregister the callback
          * since only the keys are passed to the server to avoid security issues.
          */
         SInt32 matchingIndex = DARemoveCallbackFromSession(session, address, context);
-        _DAServerSessionUnregisterCallback( _DASessionGetID( session ), ( uintptr_t ) matchingIndex, ( uintptr_t ) matchingIndex );
+
+        batch = _DASessionGetRequestBatch( session );
+
+        if ( batch )
+        {
+            CFMutableDictionaryRef unregistration;
+
+            /*
+             * Hold the unregistration in the session's open batch, to be removed along with the rest of it.
+             */
+
+            unregistration = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            if ( unregistration )
+            {
+                ___CFDictionarySetIntegerValue( unregistration, _kDACallbackAddressKey, matchingIndex );
+                ___CFDictionarySetIntegerValue( unregistration, _kDACallbackContextKey, matchingIndex );
+
+                CFArrayAppendValue( batch, unregistration );
+
+                CFRelease( unregistration );
+            }
+        }
+        else
+        {
+            _DAServerSessionUnregisterCallback( _DASessionGetID( session ), ( uintptr_t ) matchingIndex, ( uintptr_t ) matchingIndex );
+        }
     }
 }
 
@@ -669,7 +886,16 @@ DADiskOptions DADiskGetOptions( DADiskRef disk )
 
     if ( disk )
     {
-        _DAServerDiskGetOptions( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &options );
+        _DASnapshotRecord record;
+
+        if ( _DADiskCopySnapshotRecord( disk, &record ) )
+        {
+            options = record.options;
+        }
+        else
+        {
+            _DAServerDiskGetOptions( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &options );
+        }
     }
 
     return options;
@@ -683,7 +909,16 @@ Boolean DADiskIsClaimed( DADiskRef disk )
 
     if ( disk )
     {
-        _DAServerDiskIsClaimed( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &claimed );
+        _DASnapshotRecord record;
+
+        if ( _DADiskCopySnapshotRecord( disk, &record ) )
+        {
+            claimed = record.claimed;
+        }
+        else
+        {
+            _DAServerDiskIsClaimed( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &claimed );
+        }
     }
 
     return claimed;
@@ -62,10 +62,19 @@ static CFMutableSetRef        __gDiskArbUnmountList                 = NULL;
 
 __private_extern__ DAReturn _DAAuthorize( DASessionRef session, _DAAuthorizeOptions options, DADiskRef disk, const char * right );
 
+__private_extern__ DADiskRef   _DADiskCreate( CFAllocatorRef allocator, DASessionRef session, const char * id );
 __private_extern__ char *      _DADiskGetID( DADiskRef disk );
 __private_extern__ mach_port_t _DADiskGetSessionID( DADiskRef disk );
 
-__private_extern__ mach_port_t _DASessionGetID( DASessionRef session );
+__private_extern__ CFMutableDictionaryRef DACallbackCreate( CFAllocatorRef allocator, mach_vm_offset_t address, mach_vm_offset_t context );
+__private_extern__ SInt32                 DAAddCallbackToSession( DASessionRef session, CFMutableDictionaryRef callback );
+__private_extern__ CFMutableDictionaryRef DAGetCallbackFromSession( DASessionRef session, SInt32 index );
+__private_extern__ void                   DARemoveCallbackFromSessionWithKey( DASessionRef session, SInt32 index );
+
+__private_extern__ mach_port_t       _DASessionGetID( DASessionRef session );
+__private_extern__ CFMutableArrayRef _DASessionGetRequestBatch( DASessionRef session );
+__private_extern__ DAReturn          _DASessionSetEventCallback( DASessionRef session, DADiskEventCallback callback, void * context );
+__private_extern__ void              _DASessionSetRequestBatch( DASessionRef session, CFMutableArrayRef batch );
 
 __private_extern__ void _DARegisterCallback( DASessionRef    session,
                                              void *          callback,
@@ -2493,6 +2502,178 @@ int DiskArbVSDBGetVolumeStatus_auto( char * disk )
 
 #endif /* !__LP64__ */
 
+static DAReturn __DASessionCommitCallbacks( DASessionRef session, CFArrayRef callbacks, Boolean registration )
+{
+    CFDataRef _callbacks;
+    DAReturn  status;
+
+    status = kDAReturnNoResources;
+
+    _callbacks = _DASerialize( kCFAllocatorDefault, callbacks );
+
+    if ( _callbacks )
+    {
+        if ( registration )
+        {
+            status = _DAServerSessionRegisterCallbacks( _DASessionGetID( session ),
+                                                        ( vm_address_t           ) CFDataGetBytePtr( _callbacks ),
+                                                        ( mach_msg_type_number_t ) CFDataGetLength( _callbacks ) );
+        }
+        else
+        {
+            status = _DAServerSessionUnregisterCallbacks( _DASessionGetID( session ),
+                                                          ( vm_address_t           ) CFDataGetBytePtr( _callbacks ),
+                                                          ( mach_msg_type_number_t ) CFDataGetLength( _callbacks ) );
+        }
+
+        CFRelease( _callbacks );
+    }
+
+    return status;
+}
+
+static DAReturn __DASessionCommitRequests( DASessionRef session, CFArrayRef requests )
+{
+    CFArrayRef statuses = NULL;
+    CFIndex    count;
+    CFIndex    index;
+    DAReturn   status;
+
+    count = CFArrayGetCount( requests );
+
+    status = kDAReturnSuccess;
+
+    if ( count )
+    {
+        CFDataRef _requests;
+
+        status = kDAReturnNoResources;
+
+        _requests = _DASerialize( kCFAllocatorDefault, requests );
+
+        if ( _requests )
+        {
+            vm_address_t           _statuses;
+            mach_msg_type_number_t _statusesSize;
+
+            status = _DAServerSessionQueueRequests( _DASessionGetID( session ),
+                                                    ( vm_address_t           ) CFDataGetBytePtr( _requests ),
+                                                    ( mach_msg_type_number_t ) CFDataGetLength( _requests ),
+                                                    &_statuses,
+                                                    &_statusesSize );
+
+            if ( status == KERN_SUCCESS )
+            {
+                statuses = _DAUnserializeWithBytes( kCFAllocatorDefault, _statuses, _statusesSize );
+
+                vm_deallocate( mach_task_self( ), _statuses, _statusesSize );
+            }
+
+            CFRelease( _requests );
+        }
+    }
+
+    /*
+     * Complete each request that the server did not queue, as the equivalent individual call would.
+     */
+
+    for ( index = 0; index < count; index++ )
+    {
+        CFDictionaryRef request;
+        DAReturn        requestStatus;
+
+        request = CFArrayGetValueAtIndex( requests, index );
+
+        requestStatus = status;
+
+        if ( statuses && index < CFArrayGetCount( statuses ) )
+        {
+            requestStatus = ___CFNumberGetIntegerValue( CFArrayGetValueAtIndex( statuses, index ) );
+        }
+        else if ( requestStatus == kDAReturnSuccess )
+        {
+            requestStatus = kDAReturnError;
+        }
+
+        if ( requestStatus )
+        {
+            CFMutableDictionaryRef callback;
+            SInt32                 handle;
+
+            handle = ___CFDictionaryGetIntegerValue( request, _kDACallbackAddressKey );
+
+            callback = DAGetCallbackFromSession( session, handle );
+
+            if ( callback )
+            {
+                DADiskClaimCallback address;
+                void *              context;
+
+                address = ( void * ) ( uintptr_t ) ___CFDictionaryGetIntegerValue( callback, _kDACallbackAddressKey );
+                context = ( void * ) ( uintptr_t ) ___CFDictionaryGetIntegerValue( callback, _kDACallbackContextKey );
+
+                if ( address )
+                {
+                    char * id;
+
+                    id = ___CFStringCopyCString( CFDictionaryGetValue( request, _kDARequestDiskKey ) );
+
+                    if ( id )
+                    {
+                        DADiskRef disk;
+
+                        disk = _DADiskCreate( kCFAllocatorDefault, session, id );
+
+                        if ( disk )
+                        {
+                            DADissenterRef dissenter;
+
+                            dissenter = DADissenterCreate( kCFAllocatorDefault, requestStatus, NULL );
+
+                            ( address )( disk, dissenter, context );
+
+                            CFRelease( dissenter );
+
+                            CFRelease( disk );
+                        }
+
+                        free( id );
+                    }
+                }
+
+                DARemoveCallbackFromSessionWithKey( session, handle );
+            }
+        }
+    }
+
+    if ( statuses )
+    {
+        CFRelease( statuses );
+    }
+
+    return status;
+}
+
+static CFStringRef __DASessionGetRequestBatchEntryType( CFDictionaryRef entry )
+{
+    /*
+     * A request carries a request kind, a registration carries a callback kind and an unregistration
+     * carries neither.
+     */
+
+    if ( CFDictionaryContainsKey( entry, _kDARequestKindKey ) )
+    {
+        return _kDARequestKindKey;
+    }
+
+    if ( CFDictionaryContainsKey( entry, _kDACallbackKindKey ) )
+    {
+        return _kDACallbackKindKey;
+    }
+
+    return NULL;
+}
+
 int _DAmkdir( const char * path, mode_t mode )
 {
     int status;
@@ -2624,3 +2805,373 @@ void DARegisterDiskListCompleteCallback( DASessionRef session, DADiskListComplet
 {
     _DARegisterCallback( session, callback, context, _kDADiskListCompleteCallback, 0, NULL, NULL );
 }
+
+void DARegisterDiskListSnapshotCallback( DASessionRef               session,
+                                         CFDictionaryRef            match,
+                                         DADiskListSnapshotCallback callback,
+                                         void *                     context )
+{
+    _DARegisterCallback( session, callback, context, _kDADiskListSnapshotCallback, 0, match, NULL );
+}
+
+DAReturn DASessionBeginRequestBatch( DASessionRef session )
+{
+    DAReturn status;
+
+    status = kDAReturnBadArgument;
+
+    if ( session )
+    {
+        status = kDAReturnBusy;
+
+        if ( _DASessionGetRequestBatch( session ) == NULL )
+        {
+            CFMutableArrayRef batch;
+
+            status = kDAReturnNoResources;
+
+            batch = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( batch )
+            {
+                _DASessionSetRequestBatch( session, batch );
+
+                status = kDAReturnSuccess;
+
+                CFRelease( batch );
+            }
+        }
+    }
+
+    return status;
+}
+
+DAReturn DASessionCommitRequestBatch( DASessionRef session )
+{
+    DAReturn status;
+
+    status = kDAReturnBadArgument;
+
+    if ( session )
+    {
+        CFMutableArrayRef batch;
+
+        batch = _DASessionGetRequestBatch( session );
+
+        if ( batch )
+        {
+            CFIndex count;
+            CFIndex index;
+
+            CFRetain( batch );
+
+            _DASessionSetRequestBatch( session, NULL );
+
+            count = CFArrayGetCount( batch );
+
+            status = kDAReturnSuccess;
+
+            /*
+             * Send each run of like entries in one message, in the order in which they were made, so that a
+             * registration made ahead of a request within the batch is in place by the time the request is.
+             */
+
+            for ( index = 0; index < count; )
+            {
+                CFMutableArrayRef entries;
+                CFStringRef       type;
+                CFIndex           length;
+
+                type = __DASessionGetRequestBatchEntryType( CFArrayGetValueAtIndex( batch, index ) );
+
+                for ( length = 1; index + length < count; length++ )
+                {
+                    if ( __DASessionGetRequestBatchEntryType( CFArrayGetValueAtIndex( batch, index + length ) ) != type )
+                    {
+                        break;
+                    }
+                }
+
+                entries = CFArrayCreateMutable( kCFAllocatorDefault, length, &kCFTypeArrayCallBacks );
+
+                if ( entries )
+                {
+                    DAReturn entriesStatus;
+
+                    CFArrayAppendArray( entries, batch, CFRangeMake( index, length ) );
+
+                    if ( type == _kDARequestKindKey )
+                    {
+                        entriesStatus = __DASessionCommitRequests( session, entries );
+                    }
+                    else
+                    {
+                        entriesStatus = __DASessionCommitCallbacks( session, entries, type == _kDACallbackKindKey );
+                    }
+
+                    if ( status == kDAReturnSuccess )
+                    {
+                        status = entriesStatus;
+                    }
+
+                    CFRelease( entries );
+                }
+                else if ( status == kDAReturnSuccess )
+                {
+                    status = kDAReturnNoResources;
+                }
+
+                index += length;
+            }
+
+            CFRelease( batch );
+        }
+    }
+
+    return status;
+}
+
+CFArrayRef DASessionCopyDisks( DASessionRef session, CFDictionaryRef match )
+{
+    CFMutableArrayRef disks = NULL;
+
+    if ( session )
+    {
+        CFDataRef _match = NULL;
+
+        if ( match )  _match = _DASerializeDiskDescription( kCFAllocatorDefault, match );
+
+        if ( match == NULL || _match )
+        {
+            vm_address_t           _descriptions;
+            mach_msg_type_number_t _descriptionsSize;
+            kern_return_t          status;
+
+            status = _DAServerSessionCopyDiskDescriptions( _DASessionGetID( session ),
+                                                           ( vm_address_t           ) ( _match ? CFDataGetBytePtr( _match ) : 0 ),
+                                                           ( mach_msg_type_number_t ) ( _match ? CFDataGetLength(  _match ) : 0 ),
+                                                           &_descriptions,
+                                                           &_descriptionsSize );
+
+            if ( status == KERN_SUCCESS )
+            {
+                CFArrayRef descriptions;
+
+                descriptions = _DAUnserializeWithBytes( CFGetAllocator( session ), _descriptions, _descriptionsSize );
+
+                if ( descriptions )
+                {
+                    disks = CFArrayCreateMutable( CFGetAllocator( session ), 0, &kCFTypeArrayCallBacks );
+
+                    if ( disks )
+                    {
+                        CFIndex count;
+                        CFIndex index;
+
+                        count = CFArrayGetCount( descriptions );
+
+                        for ( index = 0; index < count; index++ )
+                        {
+                            DADiskRef disk;
+
+                            disk = _DADiskCreateFromSerialization( CFGetAllocator( session ), session, CFArrayGetValueAtIndex( descriptions, index ) );
+
+                            if ( disk )
+                            {
+                                CFArrayAppendValue( disks, disk );
+
+                                CFRelease( disk );
+                            }
+                        }
+                    }
+
+                    CFRelease( descriptions );
+                }
+
+                vm_deallocate( mach_task_self( ), _descriptions, _descriptionsSize );
+            }
+        }
+
+        if ( _match )  CFRelease( _match );
+    }
+
+    return disks;
+}
+
+DAReturn DASessionQueueDiskDescriptions( DASessionRef               session,
+                                         CFArrayRef                 disks,
+                                         DADiskDescriptionsCallback callback,
+                                         void *                     context )
+{
+    DAReturn status;
+
+    status = kDAReturnBadArgument;
+
+    if ( session && disks && callback )
+    {
+        CFMutableArrayRef ids;
+
+        status = kDAReturnNoResources;
+
+        ids = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        if ( ids )
+        {
+            CFIndex count;
+            CFIndex index;
+
+            count = CFArrayGetCount( disks );
+
+            for ( index = 0; index < count; index++ )
+            {
+                CFStringRef id;
+
+                id = CFStringCreateWithCString( kCFAllocatorDefault, _DADiskGetID( ( void * ) CFArrayGetValueAtIndex( disks, index ) ), kCFStringEncodingUTF8 );
+
+                if ( id == NULL )
+                {
+                    break;
+                }
+
+                CFArrayAppendValue( ids, id );
+
+                CFRelease( id );
+            }
+
+            if ( index == count )
+            {
+                CFDataRef _ids;
+
+                _ids = _DASerialize( kCFAllocatorDefault, ids );
+
+                if ( _ids )
+                {
+                    CFMutableDictionaryRef _callback;
+
+                    /*
+                     * Store the callback in the session and pass the server its handle, as for requests.
+                     */
+
+                    _callback = DACallbackCreate( kCFAllocatorDefault, ( mach_vm_offset_t ) callback, ( mach_vm_offset_t ) context );
+
+                    if ( _callback )
+                    {
+                        SInt32 _index;
+
+                        _index = DAAddCallbackToSession( session, _callback );
+
+                        status = _DAServerSessionQueueDiskDescriptions( _DASessionGetID( session ),
+                                                                        ( vm_address_t           ) CFDataGetBytePtr( _ids ),
+                                                                        ( mach_msg_type_number_t ) CFDataGetLength( _ids ),
+                                                                        ( uintptr_t              ) _index,
+                                                                        ( uintptr_t              ) _index );
+
+                        if ( status )
+                        {
+                            DARemoveCallbackFromSessionWithKey( session, _index );
+                        }
+
+                        CFRelease( _callback );
+                    }
+
+                    CFRelease( _ids );
+                }
+            }
+
+            CFRelease( ids );
+        }
+    }
+
+    return status;
+}
+
+DAReturn DASessionSetCallbackBatching( DASessionRef session, CFTimeInterval latency, CFIndex limit )
+{
+    DAReturn status;
+
+    status = kDAReturnBadArgument;
+
+    if ( session )
+    {
+        if ( latency >= 0 && latency <= 1 && limit >= 0 && limit <= INT32_MAX )
+        {
+            status = _DAServerSessionSetCallbackBatching( _DASessionGetID( session ), latency * 1000000, limit );
+        }
+    }
+
+    return status;
+}
+
+DAReturn DASessionSetDebugLogSubsystems( DASessionRef session, DADebugLogSubsystems subsystems )
+{
+    DAReturn status;
+
+    status = kDAReturnBadArgument;
+
+    if ( session )
+    {
+        status = _DAServerSessionSetDebugLogSubsystems( _DASessionGetID( session ), ( int32_t ) subsystems );
+    }
+
+    return status;
+}
+
+CFDataRef DASessionCopyTrace( DASessionRef session )
+{
+    CFDataRef trace = NULL;
+
+    if ( session )
+    {
+        vm_address_t           _trace;
+        mach_msg_type_number_t _traceSize;
+        kern_return_t          status;
+
+        status = _DAServerSessionCopyTrace( _DASessionGetID( session ), &_trace, &_traceSize );
+
+        if ( status == KERN_SUCCESS )
+        {
+            trace = CFDataCreate( CFGetAllocator( session ), ( void * ) _trace, _traceSize );
+
+            vm_deallocate( mach_task_self( ), _trace, _traceSize );
+        }
+    }
+
+    return trace;
+}
+
+CFDictionaryRef DASessionCopyMetrics( DASessionRef session )
+{
+    CFDictionaryRef metrics = NULL;
+
+    if ( session )
+    {
+        vm_address_t           _metrics;
+        mach_msg_type_number_t _metricsSize;
+        kern_return_t          status;
+
+        status = _DAServerSessionCopyMetrics( _DASessionGetID( session ), &_metrics, &_metricsSize );
+
+        if ( status == KERN_SUCCESS )
+        {
+            metrics = _DAUnserializeWithBytes( CFGetAllocator( session ), _metrics, _metricsSize );
+
+            vm_deallocate( mach_task_self( ), _metrics, _metricsSize );
+        }
+    }
+
+    return metrics;
+}
+
+DAReturn DARegisterDiskEventCallback( DASessionRef session, DADiskEventCallback callback, void * context )
+{
+    DAReturn status;
+
+    status = kDAReturnBadArgument;
+
+    if ( session )
+    {
+        status = _DASessionSetEventCallback( session, callback, context );
+    }
+
+    return status;
+}
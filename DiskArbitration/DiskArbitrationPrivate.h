@@ -292,6 +292,18 @@ extern const CFStringRef kDADiskDescriptionAppearanceTimeKey;
 
 extern const CFStringRef kDADiskDescriptionMediaMatchKey;
 
+enum
+{
+    kDADebugLogSubsystemDefault    = 0x00000001,
+    kDADebugLogSubsystemFileSystem = 0x00000002,
+    kDADebugLogSubsystemQueue      = 0x00000004,
+    kDADebugLogSubsystemRequest    = 0x00000008,
+    kDADebugLogSubsystemServer     = 0x00000010,
+    kDADebugLogSubsystemAll        = 0xFFFFFFFF
+};
+
+typedef UInt32 DADebugLogSubsystems;
+
 #ifndef __DISKARBITRATIOND__
 
 extern int _DAmkdir( const char * path, mode_t mode );
@@ -325,6 +337,202 @@ typedef void ( *DADiskListCompleteCallback )( void * context );
 
 extern void DARegisterDiskListCompleteCallback( DASessionRef session, DADiskListCompleteCallback  callback, void * context );
 
+typedef void ( *DADiskListSnapshotCallback )( CFArrayRef disks, UInt64 generation, void * context );
+
+/*!
+ * @function   DARegisterDiskListSnapshotCallback
+ * @abstract   Registers a callback function to be called with the initial set of disks, in place of the initial
+ * @abstract   stream of disk appeared events.  Needs to be registered before registering DARegisterDiskAppearedCallback.
+ * @param      session  The session object.
+ * @param      match    The disk description keys to match.  Pass NULL for all disk objects.
+ * @param      callback The registered callback function.
+ * @param      context  The user-defined context parameter to pass to the callback function.
+ * @discussion
+ * The callback is called once for each subsequent DARegisterDiskAppearedCallback, with the disks that existed
+ * at that point and the generation of the disk list they were taken from.  A disk is included if it matches both
+ * this match and the match of the disk appeared callback.  Disk appeared and disappeared callbacks that follow
+ * describe changes made after that generation.
+ */
+
+extern void DARegisterDiskListSnapshotCallback( DASessionRef               session,
+                                                CFDictionaryRef            match,
+                                                DADiskListSnapshotCallback callback,
+                                                void *                     context );
+
+/*!
+ * @function   DASessionBeginRequestBatch
+ * @abstract   Opens a batch of requests on the session.
+ * @param      session The session object.
+ * @result     A result code.  kDAReturnBusy is returned if a batch is already open.
+ * @discussion
+ * Until DASessionCommitRequestBatch is called, requests made on the session, such as DADiskMount, DADiskUnmount
+ * and DADiskEject, are held in the batch rather than sent to the server one at a time.  Each request still calls
+ * its own callback.  Callback registrations and unregistrations made with DARegister*Callback and DAUnregister-
+ * Callback are held in the batch as well.  The batch is not thread-safe; open and commit it on the thread that
+ * makes the requests.
+ */
+
+extern DAReturn DASessionBeginRequestBatch( DASessionRef session );
+
+/*!
+ * @function   DASessionCommitRequestBatch
+ * @abstract   Sends the requests held in the session's open batch to the server, and closes it.
+ * @param      session The session object.
+ * @result     A result code.  The first failure among the messages sent is returned.
+ * @discussion
+ * Each run of consecutive requests, registrations or unregistrations in the batch is sent in one message, in the
+ * order in which it was made.  A run of registrations is installed by the server either in whole or not at all.
+ * A request that the server declines to queue has its callback called with a dissenter before this function
+ * returns, just as the individual call would have.
+ */
+
+extern DAReturn DASessionCommitRequestBatch( DASessionRef session );
+
+/*!
+ * @function   DASessionCopyDisks
+ * @abstract   Obtains the disks known to the server, together with their descriptions, in one request.
+ * @param      session The session object.
+ * @param      match   The disk description keys to match.  Pass NULL to obtain every disk.
+ * @result     An array of disk objects, or NULL on failure.
+ * @discussion
+ * The disks returned are those that an appeared callback registered at the same moment would be called with.
+ * Each disk object carries the description it had when it was copied, so DADiskCopyDescription on it needs no
+ * further round-trip to the server.
+ */
+
+extern CFArrayRef DASessionCopyDisks( DASessionRef session, CFDictionaryRef match );
+
+/*!
+ * @function   DADiskCopyDescriptionValue
+ * @abstract   Obtains one value from the Disk Arbitration description of the specified disk.
+ * @param      disk The disk object.
+ * @param      key  The disk description key.
+ * @result     The value, or NULL if the description holds no value for the key.
+ * @discussion
+ * This is equivalent to looking the key up in the result of DADiskCopyDescription, except that a disk object
+ * received through a callback decodes only the requested value rather than its entire description.  For any
+ * other disk object, the BSD name, volume path and the ejectable, removable, whole, writable and mountable keys
+ * are answered from the shared snapshot table without a round trip to the server.
+ */
+
+extern CFTypeRef DADiskCopyDescriptionValue( DADiskRef disk, CFStringRef key );
+
+typedef void ( *DADiskDescriptionsCallback )( CFArrayRef descriptions, void * context );
+
+/*!
+ * @function   DASessionQueueDiskDescriptions
+ * @abstract   Obtains the Disk Arbitration descriptions of several disks, asynchronously, in one request.
+ * @param      session  The session object.
+ * @param      disks    The disk objects.
+ * @param      callback The callback function to call with the descriptions.
+ * @param      context  The user-defined context parameter to pass to the callback function.
+ * @result     kDAReturnSuccess if the request was queued, in which case the callback will be called.
+ * @discussion
+ * The callback is called on the session's run loop or dispatch queue with an array of descriptions, in the order
+ * of the disks given.  A disk that is no longer present is represented by kCFNull.
+ */
+
+extern DAReturn DASessionQueueDiskDescriptions( DASessionRef               session,
+                                                CFArrayRef                 disks,
+                                                DADiskDescriptionsCallback callback,
+                                                void *                     context );
+
+/*!
+ * @function   DASessionSetCallbackBatching
+ * @abstract   Requests that callbacks for a session be delivered in batches.
+ * @param      session The session object.
+ * @param      latency The longest time, in seconds, that a callback may be held back for its batch, no more than
+ *                     one second.  Zero restores immediate delivery.
+ * @param      limit   The number of pending callbacks at which a batch is delivered without waiting out the latency.
+ *                     Zero places no limit on the size of a batch.
+ * @result     A result code.
+ * @discussion
+ * Each delivery to a session costs a round-trip to the server, regardless of how many callbacks are pending.
+ * Clients that monitor disk activity can amortise that cost over storms of events by opting into batched
+ * delivery.  Approval callbacks are held back along with the others, so the latency counts against the time
+ * the client has to respond.
+ */
+
+extern DAReturn DASessionSetCallbackBatching( DASessionRef session, CFTimeInterval latency, CFIndex limit );
+
+enum
+{
+    kDADiskEventAppeared           = 1,
+    kDADiskEventDescriptionChanged = 2,
+    kDADiskEventDisappeared        = 3,
+    kDADiskEventOverflow           = 4
+};
+
+typedef UInt32 DADiskEventKind;
+
+typedef void ( *DADiskEventCallback )( DADiskRef disk, DADiskEventKind kind, void * context );
+
+/*!
+ * @function   DARegisterDiskEventCallback
+ * @abstract   Registers a callback function to be called with a compact record of every disk appeared, disk
+ *             description changed and disk disappeared event.
+ * @param      session  The session object.
+ * @param      callback The callback function.  NULL stops the delivery of events and releases the ring.
+ * @param      context  The user-defined context parameter to pass to the callback function.
+ * @result     A result code.
+ * @discussion
+ * The events are written by the server into a ring shared with the session, and are read without a round-trip
+ * to the server.  The disk object carries no description; its description is copied on demand.  Should the
+ * client fall behind by more than the ring holds, the callback is called with kDADiskEventOverflow and a NULL
+ * disk, and the client should resynchronize its view of the disks.  Events are delivered only while the
+ * session is scheduled.
+ */
+
+extern DAReturn DARegisterDiskEventCallback( DASessionRef session, DADiskEventCallback callback, void * context );
+
+/*!
+ * @function   DASessionSetDebugLogSubsystems
+ * @abstract   Selects the server subsystems whose debug messages are logged.
+ * @param      session    The session object.
+ * @param      subsystems The subsystems to log, or zero to log none.
+ * @result     A result code.  kDAReturnNotPrivileged is returned unless the caller is root.
+ * @discussion
+ * The selection takes effect immediately and lasts until it is changed again or the server exits.  Debug
+ * messages are written to os_log at the info level, and also to the debug log file if the server was started
+ * with -d.  The server starts with every subsystem selected if it was started with -d or if os_log keeps its
+ * info messages, and with none selected otherwise.
+ */
+
+extern DAReturn DASessionSetDebugLogSubsystems( DASessionRef session, DADebugLogSubsystems subsystems );
+
+/*!
+ * @function   DASessionCopyTrace
+ * @abstract   Obtains a timeline of the recent lifecycle events of each disk.
+ * @param      session The session object.
+ * @result     The timeline, in the Chrome trace event format, or NULL on failure.  NULL is also returned unless
+ *             the caller is root.
+ * @discussion
+ * The server keeps the most recent events in memory: media appearance, the peek, probe, repair and mount
+ * stages, and the time each client took to answer its peek and approval callbacks.  Each disk is presented as
+ * a process and each file system or client as a thread, such that the timeline can be loaded as is into a
+ * trace viewer.
+ */
+
+extern CFDataRef DASessionCopyTrace( DASessionRef session );
+
+/*!
+ * @function   DASessionCopyMetrics
+ * @abstract   Obtains the counters and latency histograms kept by the server.
+ * @param      session The session object.
+ * @result     The metrics, or NULL on failure.  NULL is also returned unless the caller is root.
+ * @discussion
+ * The metrics are given as a dictionary of series names, each a dictionary of keys, such as a file system kind,
+ * a client or a routine, to a dictionary of values.  A counter has a "count" value only.  A histogram has the
+ * "count", "sum", "min", "max", "p50", "p90", "p99" and "p999" values, and the occupied "buckets" of the
+ * histogram as alternating upper limits and counts.  Intervals are in microseconds.  The server measures the
+ * time of each stage of a disk, of each file system helper by kind, of each routine, of each client response
+ * and of each request in the queue, as well as the depth of the callback queue of each client.  The processor
+ * time of the server is given in microseconds as the "count" of the "cpu time" counters keyed "user" and
+ * "system".  The same metrics are written to /var/run/diskarbitrationd.metrics when the server receives SIGINFO.
+ */
+
+extern CFDictionaryRef DASessionCopyMetrics( DASessionRef session );
+
 #endif /* !__DISKARBITRATIOND__ */
 
 #ifdef __cplusplus
@@ -0,0 +1,1992 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "../diskarbitrationd/DAInternal.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <DiskArbitration/DiskArbitration.h>
+#include <DiskArbitration/DiskArbitrationPrivate.h>
+
+#include <copyfile.h>
+#include <dispatch/dispatch.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <libproc.h>
+#include <paths.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/wait.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The storm attaches a number of disk images at once, each partitioned into a number of slices,
+ * while a number of client sessions watch for them, and then detaches them all at once.  Each
+ * image is a clone of a template, which is partitioned before the storm starts, such that the
+ * server sees the media appear, probes, repairs and mounts the slices, and notifies the clients
+ * much as it would for a rack of real disks.  The probe, repair and mount helpers are the real
+ * ones, as the server spawns them by their paths on the host.
+ *
+ * The serialization benchmark runs the serialization routines shared by the server and the
+ * framework, which are compiled into the tool, over descriptions like those of the common kinds of
+ * disk, and over callback queues of increasing length.  The allocations are counted through the
+ * allocator handed to the routines.
+ *
+ * The load generator opens a number of client sessions, each with its own mix of callbacks, and
+ * has each of them call the routines of the server at a given rate against one disk, while one of
+ * them cycles that disk through unmount, mount, claim and unclaim at another rate.  The latency of
+ * each routine is measured at the client, from the call until its answer, and the processor time of
+ * the server is read from its metrics.
+ */
+
+#define __kDAStressLoadSampleCountMax     1000000
+#define __kDAStressSerializeQueueCountMax 10000
+
+enum
+{
+    __kDAStressLoadCopyDescription = 0,
+    __kDAStressLoadGetOptions      = 1,
+    __kDAStressLoadSetOptions      = 2,
+    __kDAStressLoadUnmount         = 3,
+    __kDAStressLoadMount           = 4,
+    __kDAStressLoadClaim           = 5,
+    __kDAStressLoadUnclaim         = 6,
+    __kDAStressLoadCount           = 7
+};
+
+static const char * __kDAStressLoadName[] =
+{
+    "DADiskCopyDescription",
+    "DADiskGetOptions",
+    "DADiskSetOptions",
+    "DADiskUnmount",
+    "DADiskMount",
+    "DADiskClaim",
+    "DADiskUnclaim"
+};
+
+enum
+{
+    __kDAStressValueBoolean = 0,
+    __kDAStressValueNumber  = 1,
+    __kDAStressValueString  = 2,
+    __kDAStressValueURL     = 3,
+    __kDAStressValueUUID    = 4
+};
+
+typedef UInt32 __DAStressValueKind;
+
+struct __DAStressValue
+{
+    const CFStringRef * key;
+    __DAStressValueKind kind;
+    const char *        string;
+    SInt64              number;
+};
+
+typedef struct __DAStressValue __DAStressValue;
+
+typedef void ( *__DAStressSerializeFunction )( CFAllocatorRef allocator, CFTypeRef object );
+
+static const __DAStressValue __kDAStressDescriptionWholeDisk[] =
+{
+    { &kDADiskDescriptionBusNameKey,         __kDAStressValueString,  "/",                                                     0            },
+    { &kDADiskDescriptionBusPathKey,         __kDAStressValueString,  "IODeviceTree:/",                                        0            },
+    { &kDADiskDescriptionDeviceInternalKey,  __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionDeviceModelKey,     __kDAStressValueString,  "APPLE SSD AP0512Q",                                     0            },
+    { &kDADiskDescriptionDevicePathKey,      __kDAStressValueString,  "IOService:/AppleARMPE/arm-io@10F00000/AppleT600xIO/ans@8F400000/AppleASCWrapV4/iop-ans-nub/RTBuddy(ANS2)/RTBuddyService/AppleANS3NVMeController/NS_01@1", 0 },
+    { &kDADiskDescriptionDeviceProtocolKey,  __kDAStressValueString,  "Apple Fabric",                                          0            },
+    { &kDADiskDescriptionDeviceRevisionKey,  __kDAStressValueString,  "387.100.",                                              0            },
+    { &kDADiskDescriptionDeviceUnitKey,      __kDAStressValueNumber,  NULL,                                                    0            },
+    { &kDADiskDescriptionMediaBlockSizeKey,  __kDAStressValueNumber,  NULL,                                                    4096         },
+    { &kDADiskDescriptionMediaBSDMajorKey,   __kDAStressValueNumber,  NULL,                                                    1            },
+    { &kDADiskDescriptionMediaBSDMinorKey,   __kDAStressValueNumber,  NULL,                                                    0            },
+    { &kDADiskDescriptionMediaBSDNameKey,    __kDAStressValueString,  "disk0",                                                 0            },
+    { &kDADiskDescriptionMediaBSDUnitKey,    __kDAStressValueNumber,  NULL,                                                    0            },
+    { &kDADiskDescriptionMediaContentKey,    __kDAStressValueString,  "GUID_partition_scheme",                                 0            },
+    { &kDADiskDescriptionMediaEjectableKey,  __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionMediaKindKey,       __kDAStressValueString,  "IOMedia",                                               0            },
+    { &kDADiskDescriptionMediaLeafKey,       __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionMediaNameKey,       __kDAStressValueString,  "APPLE SSD AP0512Q",                                     0            },
+    { &kDADiskDescriptionMediaPathKey,       __kDAStressValueString,  "IODeviceTree:/arm-io@10F00000/ans@8F400000/iop-ans-nub/AppleANS3NVMeController/NS_01@1/IOBlockStorageDriver/APPLE SSD AP0512Q Media", 0 },
+    { &kDADiskDescriptionMediaRemovableKey,  __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionMediaSizeKey,       __kDAStressValueNumber,  NULL,                                                    500277792768 },
+    { &kDADiskDescriptionMediaWholeKey,      __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionMediaWritableKey,   __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { NULL }
+};
+
+static const __DAStressValue __kDAStressDescriptionAPFSVolume[] =
+{
+    { &kDADiskDescriptionBusNameKey,         __kDAStressValueString,  "/",                                                     0            },
+    { &kDADiskDescriptionBusPathKey,         __kDAStressValueString,  "IODeviceTree:/",                                        0            },
+    { &kDADiskDescriptionDeviceInternalKey,  __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionDeviceModelKey,     __kDAStressValueString,  "APPLE SSD AP0512Q",                                     0            },
+    { &kDADiskDescriptionDevicePathKey,      __kDAStressValueString,  "IOService:/AppleARMPE/arm-io@10F00000/AppleT600xIO/ans@8F400000/AppleASCWrapV4/iop-ans-nub/RTBuddy(ANS2)/RTBuddyService/AppleANS3NVMeController/NS_01@1", 0 },
+    { &kDADiskDescriptionDeviceProtocolKey,  __kDAStressValueString,  "Apple Fabric",                                          0            },
+    { &kDADiskDescriptionDeviceRevisionKey,  __kDAStressValueString,  "387.100.",                                              0            },
+    { &kDADiskDescriptionDeviceUnitKey,      __kDAStressValueNumber,  NULL,                                                    0            },
+    { &kDADiskDescriptionMediaBlockSizeKey,  __kDAStressValueNumber,  NULL,                                                    4096         },
+    { &kDADiskDescriptionMediaBSDMajorKey,   __kDAStressValueNumber,  NULL,                                                    1            },
+    { &kDADiskDescriptionMediaBSDMinorKey,   __kDAStressValueNumber,  NULL,                                                    20           },
+    { &kDADiskDescriptionMediaBSDNameKey,    __kDAStressValueString,  "disk3s5",                                               0            },
+    { &kDADiskDescriptionMediaBSDUnitKey,    __kDAStressValueNumber,  NULL,                                                    3            },
+    { &kDADiskDescriptionMediaContentKey,    __kDAStressValueString,  "41504653-0000-11AA-AA11-00306543ECAC",                  0            },
+    { &kDADiskDescriptionMediaEjectableKey,  __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionMediaKindKey,       __kDAStressValueString,  "IOMedia",                                               0            },
+    { &kDADiskDescriptionMediaLeafKey,       __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionMediaNameKey,       __kDAStressValueString,  "Data",                                                  0            },
+    { &kDADiskDescriptionMediaPathKey,       __kDAStressValueString,  "IODeviceTree:/arm-io@10F00000/ans@8F400000/iop-ans-nub/AppleANS3NVMeController/NS_01@1/IOBlockStorageDriver/APPLE SSD AP0512Q Media/IOGUIDPartitionScheme/Container@2/AppleAPFSMedia/AppleAPFSContainer/Data@5", 0 },
+    { &kDADiskDescriptionMediaRemovableKey,  __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionMediaSizeKey,       __kDAStressValueNumber,  NULL,                                                    494384795648 },
+    { &kDADiskDescriptionMediaUUIDKey,       __kDAStressValueUUID,    "5B1E4C36-7D0C-4A4B-9E3F-0A2D6C8F1B27",                  0            },
+    { &kDADiskDescriptionMediaWholeKey,      __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionMediaWritableKey,   __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionVolumeKindKey,      __kDAStressValueString,  "apfs",                                                  0            },
+    { &kDADiskDescriptionVolumeMountableKey, __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionVolumeNameKey,      __kDAStressValueString,  "Data",                                                  0            },
+    { &kDADiskDescriptionVolumeNetworkKey,   __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionVolumePathKey,      __kDAStressValueURL,     "/System/Volumes/Data",                                  0            },
+    { &kDADiskDescriptionVolumeTypeKey,      __kDAStressValueString,  "APFS",                                                  0            },
+    { &kDADiskDescriptionVolumeUUIDKey,      __kDAStressValueUUID,    "9C4F1A2E-3B6D-4E8F-A1C2-7D5E9B0F3A64",                  0            },
+    { NULL }
+};
+
+static const __DAStressValue __kDAStressDescriptionOpticalMedia[] =
+{
+    { &kDADiskDescriptionBusNameKey,         __kDAStressValueString,  "XHC1",                                                  0            },
+    { &kDADiskDescriptionBusPathKey,         __kDAStressValueString,  "IODeviceTree:/PCI0@0/XHC1@14",                          0            },
+    { &kDADiskDescriptionDeviceInternalKey,  __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionDeviceModelKey,     __kDAStressValueString,  "DVD-R   UJ-8A8",                                        0            },
+    { &kDADiskDescriptionDevicePathKey,      __kDAStressValueString,  "IOService:/AppleACPIPlatformExpert/PCI0@0/AppleACPIPCI/XHC1@14/XHC1@14000000/HS01@14100000/SuperDrive@14100000/IOUSBMassStorageDriverNub/IOUSBMassStorageDriver/IOSCSILogicalUnitNub@0/IOSCSIPeripheralDeviceType05", 0 },
+    { &kDADiskDescriptionDeviceProtocolKey,  __kDAStressValueString,  "USB",                                                   0            },
+    { &kDADiskDescriptionDeviceRevisionKey,  __kDAStressValueString,  "HA13",                                                  0            },
+    { &kDADiskDescriptionDeviceVendorKey,    __kDAStressValueString,  "Apple",                                                 0            },
+    { &kDADiskDescriptionMediaBlockSizeKey,  __kDAStressValueNumber,  NULL,                                                    2048         },
+    { &kDADiskDescriptionMediaBSDMajorKey,   __kDAStressValueNumber,  NULL,                                                    1            },
+    { &kDADiskDescriptionMediaBSDMinorKey,   __kDAStressValueNumber,  NULL,                                                    24           },
+    { &kDADiskDescriptionMediaBSDNameKey,    __kDAStressValueString,  "disk4",                                                 0            },
+    { &kDADiskDescriptionMediaBSDUnitKey,    __kDAStressValueNumber,  NULL,                                                    4            },
+    { &kDADiskDescriptionMediaContentKey,    __kDAStressValueString,  "",                                                      0            },
+    { &kDADiskDescriptionMediaEjectableKey,  __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionMediaKindKey,       __kDAStressValueString,  "IODVDMedia",                                            0            },
+    { &kDADiskDescriptionMediaLeafKey,       __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionMediaNameKey,       __kDAStressValueString,  "MATSHITA DVD-R UJ-8A8 Media",                           0            },
+    { &kDADiskDescriptionMediaPathKey,       __kDAStressValueString,  "IODeviceTree:/PCI0@0/XHC1@14/SuperDrive@14100000/IODVDBlockStorageDriver/MATSHITA DVD-R UJ-8A8 Media", 0 },
+    { &kDADiskDescriptionMediaRemovableKey,  __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionMediaSizeKey,       __kDAStressValueNumber,  NULL,                                                    4706074624   },
+    { &kDADiskDescriptionMediaTypeKey,       __kDAStressValueString,  "DVD-ROM",                                               0            },
+    { &kDADiskDescriptionMediaWholeKey,      __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionMediaWritableKey,   __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionVolumeKindKey,      __kDAStressValueString,  "udf",                                                   0            },
+    { &kDADiskDescriptionVolumeMountableKey, __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionVolumeNameKey,      __kDAStressValueString,  "DVD_VIDEO",                                             0            },
+    { &kDADiskDescriptionVolumeNetworkKey,   __kDAStressValueBoolean, NULL,                                                    FALSE        },
+    { &kDADiskDescriptionVolumePathKey,      __kDAStressValueURL,     "/Volumes/DVD_VIDEO",                                    0            },
+    { &kDADiskDescriptionVolumeTypeKey,      __kDAStressValueString,  "UDF",                                                   0            },
+    { NULL }
+};
+
+static const __DAStressValue __kDAStressDescriptionNetworkVolume[] =
+{
+    { &kDADiskDescriptionVolumeKindKey,      __kDAStressValueString,  "smbfs",                                                 0            },
+    { &kDADiskDescriptionVolumeMountableKey, __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionVolumeNameKey,      __kDAStressValueString,  "projects",                                              0            },
+    { &kDADiskDescriptionVolumeNetworkKey,   __kDAStressValueBoolean, NULL,                                                    TRUE         },
+    { &kDADiskDescriptionVolumePathKey,      __kDAStressValueURL,     "/Volumes/projects",                                     0            },
+    { &kDADiskDescriptionVolumeTypeKey,      __kDAStressValueString,  "SMB (Mac OS X)",                                        0            },
+    { NULL }
+};
+
+struct __DAStressSeries
+{
+    UInt64 * list;
+    UInt32   count;
+    UInt32   failed;
+};
+
+typedef struct __DAStressSeries __DAStressSeries;
+
+struct __DAStressClient
+{
+    DASessionRef      session;
+    dispatch_queue_t  queue;
+    UInt32            ready;
+    UInt32            appeared;
+    UInt32            disappeared;
+    UInt32            changed;
+    UInt64            appearedLast;
+    UInt64            disappearedLast;
+    dispatch_source_t timer;
+    UInt32            tick;
+    __DAStressSeries  series[__kDAStressLoadCount];
+};
+
+typedef struct __DAStressClient __DAStressClient;
+
+static CFAllocatorRef     __gDAStressAllocator        = NULL;
+static UInt64             __gDAStressAllocatorSize    = 0;
+static __DAStressClient * __gDAStressClientList       = NULL;
+static UInt32             __gDAStressClientListCount  = 0;
+static const char *       __gDAStressLoadDisk         = NULL;
+static DADiskRef          __gDAStressLoadCycleDisk    = NULL;
+static UInt32             __gDAStressLoadCycleBusy    = FALSE;
+static UInt64             __gDAStressLoadCycleStart   = 0;
+static const char *       __gDAStressName             = NULL;
+static UInt32             __gDAStressStormMounted     = 0;
+static UInt64             __gDAStressStormMountedLast = 0;
+static CFMutableSetRef    __gDAStressStormMountList   = NULL;
+static CFMutableArrayRef  __gDAStressStormWholeList   = NULL;
+
+extern char ** environ;
+
+static void __usage( void )
+{
+    /*
+     * Print usage.
+     */
+
+    fprintf( stderr, "%s load [-c clients] [-d disk] [-r rate] [-t seconds] [-w rate]\n", __gDAStressName );
+    fprintf( stderr, "%s serialize [-n iterations]\n", __gDAStressName );
+    fprintf( stderr, "%s storm [-c clients] [-d disks] [-m megabytes] [-s slices] [-t seconds]\n", __gDAStressName );
+    fprintf( stderr, "load options:\n" );
+    fprintf( stderr, "\t-c\tnumber of client sessions, 16 by default\n" );
+    fprintf( stderr, "\t-d\tdisk to call the routines against, disk0 by default\n" );
+    fprintf( stderr, "\t-r\tcalls per second of each client, 10 by default\n" );
+    fprintf( stderr, "\t-t\tseconds to run for, 10 by default\n" );
+    fprintf( stderr, "\t-w\tunmount, mount, claim and unclaim cycles per second, 0 by default\n" );
+    fprintf( stderr, "serialize options:\n" );
+    fprintf( stderr, "\t-n\tnumber of iterations of each description, 10000 by default\n" );
+    fprintf( stderr, "storm options:\n" );
+    fprintf( stderr, "\t-c\tnumber of client sessions, 8 by default\n" );
+    fprintf( stderr, "\t-d\tnumber of whole disks, 16 by default\n" );
+    fprintf( stderr, "\t-m\tsize of each slice in megabytes, 16 by default\n" );
+    fprintf( stderr, "\t-s\tnumber of slices of each disk, 8 by default\n" );
+    fprintf( stderr, "\t-t\tlongest wait for each phase in seconds, 600 by default\n" );
+
+    exit( EX_USAGE );
+}
+
+static void * __DAStressAllocatorAllocate( CFIndex size, CFOptionFlags hint, void * info )
+{
+    __gDAStressAllocatorSize += size;
+
+    return malloc( size );
+}
+
+static void __DAStressAllocatorDeallocate( void * pointer, void * info )
+{
+    free( pointer );
+}
+
+static void * __DAStressAllocatorReallocate( void * pointer, CFIndex size, CFOptionFlags hint, void * info )
+{
+    __gDAStressAllocatorSize += size;
+
+    return realloc( pointer, size );
+}
+
+static CFDictionaryRef __DAStressCreateDescription( const __DAStressValue * values )
+{
+    CFMutableDictionaryRef description;
+
+    description = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( description )
+    {
+        for ( ; values->key; values++ )
+        {
+            CFTypeRef object = NULL;
+
+            switch ( values->kind )
+            {
+                case __kDAStressValueBoolean:
+                {
+                    object = CFRetain( values->number ? kCFBooleanTrue : kCFBooleanFalse );
+
+                    break;
+                }
+                case __kDAStressValueNumber:
+                {
+                    object = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt64Type, &values->number );
+
+                    break;
+                }
+                case __kDAStressValueString:
+                {
+                    object = CFStringCreateWithCString( kCFAllocatorDefault, values->string, kCFStringEncodingUTF8 );
+
+                    break;
+                }
+                case __kDAStressValueURL:
+                {
+                    object = CFURLCreateFromFileSystemRepresentation( kCFAllocatorDefault, ( const UInt8 * ) values->string, strlen( values->string ), TRUE );
+
+                    break;
+                }
+                case __kDAStressValueUUID:
+                {
+                    CFStringRef string;
+
+                    string = CFStringCreateWithCString( kCFAllocatorDefault, values->string, kCFStringEncodingUTF8 );
+
+                    if ( string )
+                    {
+                        object = CFUUIDCreateFromString( kCFAllocatorDefault, string );
+
+                        CFRelease( string );
+                    }
+
+                    break;
+                }
+            }
+
+            if ( object )
+            {
+                CFDictionarySetValue( description, *values->key, object );
+
+                CFRelease( object );
+            }
+        }
+    }
+
+    return description;
+}
+
+static double __DAStressGetInterval( UInt64 start, UInt64 end )
+{
+    /*
+     * Obtain the interval in milliseconds, or zero for an event that never came.
+     */
+
+    return ( end > start ) ? ( end - start ) / 1e6 : 0;
+}
+
+static UInt64 __DAStressGetTime( void )
+{
+    return clock_gettime_nsec_np( CLOCK_UPTIME_RAW );
+}
+
+static pid_t __DAStressGetServerProcessID( void )
+{
+    pid_t * list;
+    int     count;
+    pid_t   pid = 0;
+
+    count = proc_listallpids( NULL, 0 );
+
+    if ( count > 0 )
+    {
+        count += 32;
+
+        list = calloc( count, sizeof( pid_t ) );
+
+        if ( list )
+        {
+            int index;
+
+            count = proc_listallpids( list, count * sizeof( pid_t ) );
+
+            for ( index = 0; index < count; index++ )
+            {
+                char name[MAXCOMLEN + 1];
+
+                if ( proc_name( list[index], name, sizeof( name ) ) > 0 )
+                {
+                    if ( strcmp( name, "diskarbitrationd" ) == 0 )
+                    {
+                        pid = list[index];
+
+                        break;
+                    }
+                }
+            }
+
+            free( list );
+        }
+    }
+
+    return pid;
+}
+
+static UInt64 __DAStressGetServerFootprint( pid_t pid )
+{
+    struct rusage_info_v4 usage;
+
+    if ( proc_pid_rusage( pid, RUSAGE_INFO_V4, ( rusage_info_t * ) &usage ) == 0 )
+    {
+        return usage.ri_phys_footprint;
+    }
+
+    return 0;
+}
+
+static pid_t __DAStressSpawn( char * const * arguments )
+{
+    posix_spawn_file_actions_t actions;
+    pid_t                      pid;
+
+    /*
+     * Spawn a tool of the host, without waiting on it, and with its output discarded.
+     */
+
+    posix_spawn_file_actions_init( &actions );
+
+    posix_spawn_file_actions_addopen( &actions, STDOUT_FILENO, _PATH_DEVNULL, O_WRONLY, 0 );
+
+    if ( posix_spawnp( &pid, arguments[0], &actions, NULL, arguments, environ ) )
+    {
+        pid = -1;
+    }
+
+    posix_spawn_file_actions_destroy( &actions );
+
+    return pid;
+}
+
+static Boolean __DAStressWait( pid_t pid )
+{
+    int status;
+
+    if ( pid == -1 )
+    {
+        return FALSE;
+    }
+
+    while ( waitpid( pid, &status, 0 ) == -1 )
+    {
+        if ( errno != EINTR )
+        {
+            return FALSE;
+        }
+    }
+
+    return ( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 ) ? TRUE : FALSE;
+}
+
+static void __DAStressClientListCreate( UInt32 count, CFDictionaryRef match, DADiskAppearedCallback appeared, DADiskDisappearedCallback disappeared, DADiskListSnapshotCallback snapshot )
+{
+    UInt32 index;
+
+    __gDAStressClientList      = calloc( count, sizeof( __DAStressClient ) );
+    __gDAStressClientListCount = count;
+
+    if ( __gDAStressClientList == NULL )
+    {
+        fprintf( stderr, "%s: out of memory.\n", __gDAStressName );
+
+        exit( EX_OSERR );
+    }
+
+    for ( index = 0; index < count; index++ )
+    {
+        __DAStressClient * client;
+
+        client = __gDAStressClientList + index;
+
+        client->session = DASessionCreate( kCFAllocatorDefault );
+        client->queue   = dispatch_queue_create( "com.apple.DiskArbitration.dastress", NULL );
+
+        if ( client->session == NULL || client->queue == NULL )
+        {
+            fprintf( stderr, "%s: unable to create session.\n", __gDAStressName );
+
+            exit( EX_UNAVAILABLE );
+        }
+
+        /*
+         * The snapshot stands in for the initial stream of appeared callbacks, such that every disk
+         * appeared callback that follows it is for a disk that is new.
+         */
+
+        if ( snapshot )
+        {
+            DARegisterDiskListSnapshotCallback( client->session, NULL, snapshot, client );
+        }
+
+        if ( appeared )
+        {
+            DARegisterDiskAppearedCallback( client->session, match, appeared, client );
+        }
+
+        if ( disappeared )
+        {
+            DARegisterDiskDisappearedCallback( client->session, match, disappeared, client );
+        }
+
+        DASessionSetDispatchQueue( client->session, client->queue );
+    }
+}
+
+static void __DAStressClientListRelease( void )
+{
+    UInt32 index;
+
+    for ( index = 0; index < __gDAStressClientListCount; index++ )
+    {
+        __DAStressClient * client;
+
+        client = __gDAStressClientList + index;
+
+        DASessionSetDispatchQueue( client->session, NULL );
+
+        CFRelease( client->session );
+
+        dispatch_release( client->queue );
+    }
+
+    free( __gDAStressClientList );
+
+    __gDAStressClientList      = NULL;
+    __gDAStressClientListCount = 0;
+}
+
+static int __DAStressLoadCompare( const void * a, const void * b )
+{
+    UInt64 x = *( const UInt64 * ) a;
+    UInt64 y = *( const UInt64 * ) b;
+
+    return ( x > y ) - ( x < y );
+}
+
+static Boolean __DAStressLoadGetServerTime( DASessionRef session, UInt64 * user, UInt64 * system )
+{
+    CFDictionaryRef metrics;
+    Boolean         status = FALSE;
+
+    /*
+     * Obtain the processor time of the server, in microseconds, from its metrics, which are given
+     * to root only.
+     */
+
+    metrics = DASessionCopyMetrics( session );
+
+    if ( metrics )
+    {
+        CFDictionaryRef keys;
+
+        keys = CFDictionaryGetValue( metrics, CFSTR( "cpu time" ) );
+
+        if ( keys )
+        {
+            CFDictionaryRef value;
+
+            value = CFDictionaryGetValue( keys, CFSTR( "user" ) );
+
+            *user = value ? ___CFDictionaryGetIntegerValue( value, CFSTR( "count" ) ) : 0;
+
+            value = CFDictionaryGetValue( keys, CFSTR( "system" ) );
+
+            *system = value ? ___CFDictionaryGetIntegerValue( value, CFSTR( "count" ) ) : 0;
+
+            status = TRUE;
+        }
+
+        CFRelease( metrics );
+    }
+
+    return status;
+}
+
+static void __DAStressLoadRecord( __DAStressClient * client, UInt32 routine, UInt64 start, Boolean failed )
+{
+    __DAStressSeries * series;
+
+    series = client->series + routine;
+
+    if ( series->count < __kDAStressLoadSampleCountMax )
+    {
+        if ( ( series->count & ( series->count - 1 ) ) == 0 )
+        {
+            series->list = reallocf( series->list, MAX( series->count * 2, 64 ) * sizeof( UInt64 ) );
+
+            if ( series->list == NULL )
+            {
+                fprintf( stderr, "%s: out of memory.\n", __gDAStressName );
+
+                exit( EX_OSERR );
+            }
+        }
+
+        series->list[series->count] = __DAStressGetTime( ) - start;
+
+        series->count++;
+    }
+
+    if ( failed )
+    {
+        series->failed++;
+    }
+}
+
+static void __DAStressLoadAppearedCallback( DADiskRef disk, void * context )
+{
+    __DAStressClient * client = context;
+
+    client->appeared++;
+}
+
+static void __DAStressLoadDescriptionChangedCallback( DADiskRef disk, CFArrayRef keys, void * context )
+{
+    __DAStressClient * client = context;
+
+    client->changed++;
+}
+
+static void __DAStressLoadDisappearedCallback( DADiskRef disk, void * context )
+{
+    __DAStressClient * client = context;
+
+    client->disappeared++;
+}
+
+static void __DAStressLoadClaimCallback( DADiskRef disk, DADissenterRef dissenter, void * context )
+{
+    __DAStressClient * client = context;
+    UInt64             start;
+
+    __DAStressLoadRecord( client, __kDAStressLoadClaim, __gDAStressLoadCycleStart, dissenter ? TRUE : FALSE );
+
+    start = __DAStressGetTime( );
+
+    DADiskUnclaim( disk );
+
+    __DAStressLoadRecord( client, __kDAStressLoadUnclaim, start, FALSE );
+
+    __atomic_store_n( &__gDAStressLoadCycleBusy, FALSE, __ATOMIC_RELEASE );
+}
+
+static void __DAStressLoadMountCallback( DADiskRef disk, DADissenterRef dissenter, void * context )
+{
+    __DAStressClient * client = context;
+
+    __DAStressLoadRecord( client, __kDAStressLoadMount, __gDAStressLoadCycleStart, dissenter ? TRUE : FALSE );
+
+    __gDAStressLoadCycleStart = __DAStressGetTime( );
+
+    DADiskClaim( disk, kDADiskClaimOptionDefault, NULL, NULL, __DAStressLoadClaimCallback, client );
+}
+
+static void __DAStressLoadUnmountCallback( DADiskRef disk, DADissenterRef dissenter, void * context )
+{
+    __DAStressClient * client = context;
+
+    __DAStressLoadRecord( client, __kDAStressLoadUnmount, __gDAStressLoadCycleStart, dissenter ? TRUE : FALSE );
+
+    __gDAStressLoadCycleStart = __DAStressGetTime( );
+
+    DADiskMount( disk, NULL, kDADiskMountOptionDefault, __DAStressLoadMountCallback, client );
+}
+
+static void __DAStressLoadCycle( __DAStressClient * client )
+{
+    /*
+     * Start a cycle of the disk through unmount, mount, claim and unclaim, each step of which is
+     * issued from the answer to the last, unless the last cycle is still under way.
+     */
+
+    if ( __atomic_load_n( &__gDAStressLoadCycleBusy, __ATOMIC_ACQUIRE ) == FALSE )
+    {
+        __atomic_store_n( &__gDAStressLoadCycleBusy, TRUE, __ATOMIC_RELEASE );
+
+        __gDAStressLoadCycleStart = __DAStressGetTime( );
+
+        DADiskUnmount( __gDAStressLoadCycleDisk, kDADiskUnmountOptionDefault, __DAStressLoadUnmountCallback, client );
+    }
+}
+
+static void __DAStressLoadTick( __DAStressClient * client )
+{
+    DADiskRef disk;
+    UInt64    start;
+
+    /*
+     * Call the next of the routines that leave the disk as it is.  The description is copied from a
+     * new disk object each time, as a disk object answers from its own copy once it has one.
+     */
+
+    switch ( client->tick++ % 3 )
+    {
+        case 0:
+        {
+            CFDictionaryRef description;
+
+            start = __DAStressGetTime( );
+
+            description = NULL;
+
+            disk = DADiskCreateFromBSDName( kCFAllocatorDefault, client->session, __gDAStressLoadDisk );
+
+            if ( disk )
+            {
+                description = DADiskCopyDescription( disk );
+
+                CFRelease( disk );
+            }
+
+            __DAStressLoadRecord( client, __kDAStressLoadCopyDescription, start, description ? FALSE : TRUE );
+
+            if ( description )
+            {
+                CFRelease( description );
+            }
+
+            break;
+        }
+        case 1:
+        {
+            disk = DADiskCreateFromBSDName( kCFAllocatorDefault, client->session, __gDAStressLoadDisk );
+
+            if ( disk )
+            {
+                start = __DAStressGetTime( );
+
+                DADiskGetOptions( disk );
+
+                __DAStressLoadRecord( client, __kDAStressLoadGetOptions, start, FALSE );
+
+                CFRelease( disk );
+            }
+
+            break;
+        }
+        case 2:
+        {
+            disk = DADiskCreateFromBSDName( kCFAllocatorDefault, client->session, __gDAStressLoadDisk );
+
+            if ( disk )
+            {
+                DADiskOptions options;
+                DAReturn      status;
+
+                /*
+                 * Set the options that are set already, such that the disk is left as it is.
+                 */
+
+                options = DADiskGetOptions( disk );
+
+                start = __DAStressGetTime( );
+
+                status = DADiskSetOptions( disk, options, TRUE );
+
+                __DAStressLoadRecord( client, __kDAStressLoadSetOptions, start, status ? TRUE : FALSE );
+
+                CFRelease( disk );
+            }
+
+            break;
+        }
+    }
+}
+
+static int __DAStressLoad( int argc, char * argv[] )
+{
+    UInt32            clients  = 16;
+    UInt32            rate     = 10;
+    UInt32            timeout  = 10;
+    UInt32            cycles   = 0;
+    __DAStressSeries  series;
+    dispatch_source_t timer;
+    DADiskRef         disk;
+    UInt64            user;
+    UInt64            userLast;
+    UInt64            system;
+    UInt64            systemLast;
+    UInt64            start;
+    UInt64            stop;
+    Boolean           metrics;
+    UInt32            appeared;
+    UInt32            changed;
+    UInt32            disappeared;
+    UInt32            index;
+    UInt32            routine;
+    int               option;
+
+    __gDAStressLoadDisk = "disk0";
+
+    while ( ( option = getopt( argc, argv, "c:d:r:t:w:" ) ) != -1 )
+    {
+        switch ( option )
+        {
+            case 'c':
+            {
+                clients = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            case 'd':
+            {
+                __gDAStressLoadDisk = optarg;
+
+                if ( strncmp( __gDAStressLoadDisk, _PATH_DEV, strlen( _PATH_DEV ) ) == 0 )
+                {
+                    __gDAStressLoadDisk += strlen( _PATH_DEV );
+                }
+
+                break;
+            }
+            case 'r':
+            {
+                rate = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            case 't':
+            {
+                timeout = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            case 'w':
+            {
+                cycles = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            default:
+            {
+                __usage( );
+
+                break;
+            }
+        }
+    }
+
+    if ( clients == 0 || rate == 0 || timeout == 0 )
+    {
+        __usage( );
+    }
+
+    /*
+     * Create the clients, each with one of four mixes of callbacks, and give the initial stream of
+     * disk appeared callbacks a second to pass.
+     */
+
+    __DAStressClientListCreate( clients, NULL, NULL, NULL, NULL );
+
+    for ( index = 0; index < clients; index++ )
+    {
+        __DAStressClient * client;
+
+        client = __gDAStressClientList + index;
+
+        switch ( index % 4 )
+        {
+            case 0:
+            {
+                DARegisterDiskAppearedCallback( client->session, NULL, __DAStressLoadAppearedCallback, client );
+                DARegisterDiskDisappearedCallback( client->session, NULL, __DAStressLoadDisappearedCallback, client );
+
+                break;
+            }
+            case 1:
+            {
+                DARegisterDiskAppearedCallback( client->session, kDADiskDescriptionMatchVolumeMountable, __DAStressLoadAppearedCallback, client );
+
+                break;
+            }
+            case 2:
+            {
+                DARegisterDiskDescriptionChangedCallback( client->session, NULL, kDADiskDescriptionWatchVolumePath, __DAStressLoadDescriptionChangedCallback, client );
+
+                break;
+            }
+            case 3:
+            {
+                DARegisterDiskAppearedCallback( client->session, kDADiskDescriptionMatchMediaWhole, __DAStressLoadAppearedCallback, client );
+                DARegisterDiskDescriptionChangedCallback( client->session, kDADiskDescriptionMatchVolumeMountable, kDADiskDescriptionWatchVolumeName, __DAStressLoadDescriptionChangedCallback, client );
+                DARegisterDiskDisappearedCallback( client->session, kDADiskDescriptionMatchMediaWhole, __DAStressLoadDisappearedCallback, client );
+
+                break;
+            }
+        }
+    }
+
+    sleep( 1 );
+
+    for ( index = 0; index < clients; index++ )
+    {
+        dispatch_sync( __gDAStressClientList[index].queue, ^{ } );
+    }
+
+    disk = DADiskCreateFromBSDName( kCFAllocatorDefault, __gDAStressClientList[0].session, __gDAStressLoadDisk );
+
+    if ( disk == NULL )
+    {
+        fprintf( stderr, "%s: unable to find %s.\n", __gDAStressName, __gDAStressLoadDisk );
+
+        return EX_NOINPUT;
+    }
+
+    __gDAStressLoadCycleDisk = disk;
+
+    metrics = __DAStressLoadGetServerTime( __gDAStressClientList[0].session, &userLast, &systemLast );
+
+    /*
+     * Run the load.  The calls of each client are spread evenly over each second, and the cycles
+     * of the disk are issued from the queue of the first client.
+     */
+
+    start = __DAStressGetTime( );
+
+    for ( index = 0; index < clients; index++ )
+    {
+        __DAStressClient * client;
+
+        client = __gDAStressClientList + index;
+
+        client->timer = dispatch_source_create( DISPATCH_SOURCE_TYPE_TIMER, 0, 0, client->queue );
+
+        if ( client->timer == NULL )
+        {
+            fprintf( stderr, "%s: unable to create timer.\n", __gDAStressName );
+
+            return EX_OSERR;
+        }
+
+        dispatch_source_set_timer( client->timer, dispatch_time( DISPATCH_TIME_NOW, NSEC_PER_SEC / rate * index / clients ), NSEC_PER_SEC / rate, 0 );
+
+        dispatch_source_set_event_handler( client->timer, ^{ __DAStressLoadTick( client ); } );
+
+        dispatch_resume( client->timer );
+    }
+
+    timer = NULL;
+
+    if ( cycles )
+    {
+        __DAStressClient * client;
+
+        client = __gDAStressClientList;
+
+        timer = dispatch_source_create( DISPATCH_SOURCE_TYPE_TIMER, 0, 0, client->queue );
+
+        if ( timer == NULL )
+        {
+            fprintf( stderr, "%s: unable to create timer.\n", __gDAStressName );
+
+            return EX_OSERR;
+        }
+
+        dispatch_source_set_timer( timer, DISPATCH_TIME_NOW, NSEC_PER_SEC / cycles, 0 );
+
+        dispatch_source_set_event_handler( timer, ^{ __DAStressLoadCycle( client ); } );
+
+        dispatch_resume( timer );
+    }
+
+    sleep( timeout );
+
+    /*
+     * Stop the load, and give the last cycle of the disk the time to complete.
+     */
+
+    if ( timer )
+    {
+        dispatch_source_cancel( timer );
+
+        dispatch_release( timer );
+    }
+
+    for ( index = 0; index < clients; index++ )
+    {
+        dispatch_source_cancel( __gDAStressClientList[index].timer );
+
+        dispatch_sync( __gDAStressClientList[index].queue, ^{ } );
+
+        dispatch_release( __gDAStressClientList[index].timer );
+    }
+
+    stop = __DAStressGetTime( );
+
+    for ( index = 0; index < 60000 && __atomic_load_n( &__gDAStressLoadCycleBusy, __ATOMIC_ACQUIRE ); index++ )
+    {
+        usleep( 1000 );
+    }
+
+    dispatch_sync( __gDAStressClientList[0].queue, ^{ } );
+
+    if ( metrics )
+    {
+        metrics = __DAStressLoadGetServerTime( __gDAStressClientList[0].session, &user, &system );
+    }
+
+    /*
+     * Report the latency of each routine, over all clients, in microseconds.
+     */
+
+    appeared    = 0;
+    changed     = 0;
+    disappeared = 0;
+
+    for ( index = 0; index < clients; index++ )
+    {
+        appeared    += __gDAStressClientList[index].appeared;
+        changed     += __gDAStressClientList[index].changed;
+        disappeared += __gDAStressClientList[index].disappeared;
+    }
+
+    printf( "clients:                      %u, at %u calls per second each\n", clients, rate );
+    printf( "disk:                         %s, at %u cycles per second\n", __gDAStressLoadDisk, cycles );
+    printf( "time:                         %.1f ms\n", __DAStressGetInterval( start, stop ) );
+    printf( "callbacks:                    %u appeared, %u changed, %u disappeared\n", appeared, changed, disappeared );
+
+    if ( metrics )
+    {
+        printf( "server cpu time:              %.1f ms user, %.1f ms system\n", ( user - userLast ) / 1e3, ( system - systemLast ) / 1e3 );
+    }
+    else
+    {
+        printf( "server cpu time:              not available, as the server metrics are given to root only\n" );
+    }
+
+    printf( "\n%-22s %8s %8s %10s %10s %10s %10s %10s\n", "routine", "calls", "failed", "p50 us", "p90 us", "p99 us", "p999 us", "max us" );
+
+    for ( routine = 0; routine < __kDAStressLoadCount; routine++ )
+    {
+        bzero( &series, sizeof( series ) );
+
+        for ( index = 0; index < clients; index++ )
+        {
+            series.count  += __gDAStressClientList[index].series[routine].count;
+            series.failed += __gDAStressClientList[index].series[routine].failed;
+        }
+
+        if ( series.count )
+        {
+            UInt32 count;
+
+            series.list = malloc( series.count * sizeof( UInt64 ) );
+
+            if ( series.list == NULL )
+            {
+                fprintf( stderr, "%s: out of memory.\n", __gDAStressName );
+
+                return EX_OSERR;
+            }
+
+            for ( count = 0, index = 0; index < clients; index++ )
+            {
+                __DAStressSeries * source;
+
+                source = __gDAStressClientList[index].series + routine;
+
+                memcpy( series.list + count, source->list, source->count * sizeof( UInt64 ) );
+
+                count += source->count;
+            }
+
+            qsort( series.list, series.count, sizeof( UInt64 ), __DAStressLoadCompare );
+
+            printf( "%-22s %8u %8u %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                    __kDAStressLoadName[routine],
+                    series.count,
+                    series.failed,
+                    series.list[( UInt32 ) ( ( series.count - 1 ) * 0.50  )] / 1e3,
+                    series.list[( UInt32 ) ( ( series.count - 1 ) * 0.90  )] / 1e3,
+                    series.list[( UInt32 ) ( ( series.count - 1 ) * 0.99  )] / 1e3,
+                    series.list[( UInt32 ) ( ( series.count - 1 ) * 0.999 )] / 1e3,
+                    series.list[series.count - 1] / 1e3 );
+
+            free( series.list );
+        }
+    }
+
+    /*
+     * Clean up.
+     */
+
+    for ( index = 0; index < clients; index++ )
+    {
+        for ( routine = 0; routine < __kDAStressLoadCount; routine++ )
+        {
+            free( __gDAStressClientList[index].series[routine].list );
+        }
+    }
+
+    CFRelease( disk );
+
+    __DAStressClientListRelease( );
+
+    return EX_OK;
+}
+
+static void __DAStressSerializeDescription( CFAllocatorRef allocator, CFTypeRef object )
+{
+    CFDataRef data;
+
+    data = _DASerializeDiskDescription( allocator, object );
+
+    if ( data )
+    {
+        CFRelease( data );
+    }
+}
+
+static void __DAStressSerializeMeasure( const char * name, __DAStressSerializeFunction function, CFTypeRef object, UInt32 count )
+{
+    UInt64 size;
+    UInt64 start;
+    UInt64 stop;
+    UInt32 index;
+
+    /*
+     * Run the function once to warm up, and then the given number of times against the clock and
+     * the allocator.
+     */
+
+    function( __gDAStressAllocator, object );
+
+    size  = __gDAStressAllocatorSize;
+    start = __DAStressGetTime( );
+
+    for ( index = 0; index < count; index++ )
+    {
+        function( __gDAStressAllocator, object );
+    }
+
+    stop = __DAStressGetTime( );
+
+    printf( "%-44s %8u %12.0f %12.0f\n", name, count, ( double ) ( stop - start ) / count, ( double ) ( __gDAStressAllocatorSize - size ) / count );
+}
+
+static void __DAStressSerializeQueue( CFAllocatorRef allocator, CFTypeRef object )
+{
+    CFDataRef data;
+
+    data = _DASerialize( allocator, object );
+
+    if ( data )
+    {
+        CFRelease( data );
+    }
+}
+
+static void __DAStressUnserializeDescription( CFAllocatorRef allocator, CFTypeRef object )
+{
+    CFMutableDictionaryRef description;
+
+    description = _DAUnserializeDiskDescriptionWithBytes( allocator, ( vm_address_t ) CFDataGetBytePtr( object ), CFDataGetLength( object ) );
+
+    if ( description )
+    {
+        CFRelease( description );
+    }
+}
+
+static void __DAStressUnserializeQueue( CFAllocatorRef allocator, CFTypeRef object )
+{
+    CFTypeRef queue;
+
+    queue = _DAUnserialize( allocator, object );
+
+    if ( queue )
+    {
+        CFRelease( queue );
+    }
+}
+
+static int __DAStressSerialize( int argc, char * argv[] )
+{
+    CFAllocatorContext context;
+    CFDictionaryRef    description;
+    CFDataRef          data;
+    UInt32             count = 10000;
+    UInt32             index;
+    int                option;
+
+    static const struct
+    {
+        const char *            name;
+        const __DAStressValue * values;
+    } descriptions[] =
+    {
+        { "whole disk",     __kDAStressDescriptionWholeDisk     },
+        { "apfs volume",    __kDAStressDescriptionAPFSVolume    },
+        { "optical media",  __kDAStressDescriptionOpticalMedia  },
+        { "network volume", __kDAStressDescriptionNetworkVolume }
+    };
+
+    while ( ( option = getopt( argc, argv, "n:" ) ) != -1 )
+    {
+        switch ( option )
+        {
+            case 'n':
+            {
+                count = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            default:
+            {
+                __usage( );
+
+                break;
+            }
+        }
+    }
+
+    if ( count == 0 )
+    {
+        __usage( );
+    }
+
+    bzero( &context, sizeof( context ) );
+
+    context.allocate   = __DAStressAllocatorAllocate;
+    context.deallocate = __DAStressAllocatorDeallocate;
+    context.reallocate = __DAStressAllocatorReallocate;
+
+    __gDAStressAllocator = CFAllocatorCreate( kCFAllocatorDefault, &context );
+
+    if ( __gDAStressAllocator == NULL )
+    {
+        fprintf( stderr, "%s: unable to create allocator.\n", __gDAStressName );
+
+        return EX_OSERR;
+    }
+
+    printf( "%-44s %8s %12s %12s\n", "case", "ops", "ns/op", "bytes/op" );
+
+    /*
+     * Measure the descriptions.
+     */
+
+    for ( index = 0; index < sizeof( descriptions ) / sizeof( descriptions[0] ); index++ )
+    {
+        char name[64];
+
+        description = __DAStressCreateDescription( descriptions[index].values );
+
+        if ( description )
+        {
+            snprintf( name, sizeof( name ), "_DASerializeDiskDescription %s", descriptions[index].name );
+
+            __DAStressSerializeMeasure( name, __DAStressSerializeDescription, description, count );
+
+            data = _DASerializeDiskDescription( kCFAllocatorDefault, description );
+
+            if ( data )
+            {
+                snprintf( name, sizeof( name ), "_DAUnserializeDiskDescription %s", descriptions[index].name );
+
+                __DAStressSerializeMeasure( name, __DAStressUnserializeDescription, data, count );
+
+                CFRelease( data );
+            }
+
+            CFRelease( description );
+        }
+    }
+
+    /*
+     * Measure the callback queues, each entry of which is a disk appeared callback carrying the
+     * serialized description of a whole disk, as the server sends it.
+     */
+
+    description = __DAStressCreateDescription( __kDAStressDescriptionWholeDisk );
+
+    data = description ? _DASerializeDiskDescription( kCFAllocatorDefault, description ) : NULL;
+
+    if ( data )
+    {
+        CFMutableArrayRef queue;
+
+        queue = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        if ( queue )
+        {
+            UInt32 length;
+
+            for ( length = 1; length <= __kDAStressSerializeQueueCountMax; length *= 10 )
+            {
+                CFDataRef serialization;
+                char      name[64];
+
+                while ( CFArrayGetCount( queue ) < length )
+                {
+                    CFMutableDictionaryRef callback;
+
+                    callback = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                    if ( callback == NULL )
+                    {
+                        break;
+                    }
+
+                    ___CFDictionarySetIntegerValue( callback, _kDACallbackAddressKey, 0x100003F20 );
+                    ___CFDictionarySetIntegerValue( callback, _kDACallbackContextKey, CFArrayGetCount( queue ) );
+                    ___CFDictionarySetIntegerValue( callback, _kDACallbackKindKey, _kDADiskAppearedCallback );
+
+                    CFDictionarySetValue( callback, _kDACallbackArgument0Key, data );
+
+                    CFArrayAppendValue( queue, callback );
+
+                    CFRelease( callback );
+                }
+
+                snprintf( name, sizeof( name ), "_DASerialize queue of %u", length );
+
+                __DAStressSerializeMeasure( name, __DAStressSerializeQueue, queue, MAX( count / length, 10 ) );
+
+                serialization = _DASerialize( kCFAllocatorDefault, queue );
+
+                if ( serialization )
+                {
+                    snprintf( name, sizeof( name ), "_DAUnserialize queue of %u", length );
+
+                    __DAStressSerializeMeasure( name, __DAStressUnserializeQueue, serialization, MAX( count / length, 10 ) );
+
+                    CFRelease( serialization );
+                }
+            }
+
+            CFRelease( queue );
+        }
+
+        CFRelease( data );
+    }
+
+    if ( description )
+    {
+        CFRelease( description );
+    }
+
+    CFRelease( __gDAStressAllocator );
+
+    return EX_OK;
+}
+
+static void __DAStressStormAppearedCallback( DADiskRef disk, void * context )
+{
+    __DAStressClient * client = context;
+
+    client->appearedLast = __DAStressGetTime( );
+
+    __atomic_store_n( &client->appeared, client->appeared + 1, __ATOMIC_RELEASE );
+
+    /*
+     * The first client keeps the whole disks, so that they can be detached later.
+     */
+
+    if ( client == __gDAStressClientList )
+    {
+        CFDictionaryRef description;
+
+        description = DADiskCopyDescription( disk );
+
+        if ( description )
+        {
+            if ( CFDictionaryGetValue( description, kDADiskDescriptionMediaWholeKey ) == kCFBooleanTrue )
+            {
+                const char * name;
+
+                name = DADiskGetBSDName( disk );
+
+                if ( name )
+                {
+                    CFStringRef string;
+
+                    string = CFStringCreateWithCString( kCFAllocatorDefault, name, kCFStringEncodingUTF8 );
+
+                    if ( string )
+                    {
+                        CFArrayAppendValue( __gDAStressStormWholeList, string );
+
+                        CFRelease( string );
+                    }
+                }
+            }
+
+            CFRelease( description );
+        }
+    }
+}
+
+static void __DAStressStormDescriptionChangedCallback( DADiskRef disk, CFArrayRef keys, void * context )
+{
+    CFDictionaryRef description;
+
+    description = DADiskCopyDescription( disk );
+
+    if ( description )
+    {
+        if ( CFDictionaryGetValue( description, kDADiskDescriptionVolumePathKey ) )
+        {
+            const char * name;
+
+            name = DADiskGetBSDName( disk );
+
+            if ( name )
+            {
+                CFStringRef string;
+
+                string = CFStringCreateWithCString( kCFAllocatorDefault, name, kCFStringEncodingUTF8 );
+
+                if ( string )
+                {
+                    if ( CFSetContainsValue( __gDAStressStormMountList, string ) == FALSE )
+                    {
+                        CFSetAddValue( __gDAStressStormMountList, string );
+
+                        __gDAStressStormMountedLast = __DAStressGetTime( );
+
+                        __atomic_store_n( &__gDAStressStormMounted, __gDAStressStormMounted + 1, __ATOMIC_RELEASE );
+                    }
+
+                    CFRelease( string );
+                }
+            }
+        }
+
+        CFRelease( description );
+    }
+}
+
+static void __DAStressStormDisappearedCallback( DADiskRef disk, void * context )
+{
+    __DAStressClient * client = context;
+
+    client->disappearedLast = __DAStressGetTime( );
+
+    __atomic_store_n( &client->disappeared, client->disappeared + 1, __ATOMIC_RELEASE );
+}
+
+static void __DAStressStormSnapshotCallback( CFArrayRef disks, UInt64 generation, void * context )
+{
+    __DAStressClient * client = context;
+
+    __atomic_store_n( &client->ready, TRUE, __ATOMIC_RELEASE );
+}
+
+static Boolean __DAStressStormCreateTemplate( const char * path, UInt32 slices, UInt32 size )
+{
+    char *  arguments[5 + 3 * slices + 1];
+    char *  command;
+    char    device[64];
+    FILE *  file;
+    UInt32  index;
+    Boolean status = FALSE;
+
+    /*
+     * Create a blank image, and partition it into the given number of slices of the given size.
+     */
+
+    asprintf( &command, "hdiutil create -quiet -size %um -layout NONE '%s'", slices * size + 8, path );
+
+    if ( command == NULL || system( command ) )
+    {
+        free( command );
+
+        return FALSE;
+    }
+
+    free( command );
+
+    asprintf( &command, "hdiutil attach -nomount -noverify '%s'", path );
+
+    file = command ? popen( command, "r" ) : NULL;
+
+    free( command );
+
+    if ( file == NULL )
+    {
+        return FALSE;
+    }
+
+    device[0] = 0;
+
+    if ( fscanf( file, "%63s", device ) != 1 )
+    {
+        device[0] = 0;
+    }
+
+    pclose( file );
+
+    if ( strncmp( device, "/dev/disk", strlen( "/dev/disk" ) ) )
+    {
+        return FALSE;
+    }
+
+    arguments[0] = "diskutil";
+    arguments[1] = "partitionDisk";
+    arguments[2] = device;
+    arguments[4] = "GPT";
+
+    asprintf( &arguments[3], "%u", slices );
+
+    for ( index = 0; index < slices; index++ )
+    {
+        arguments[5 + 3 * index + 0] = "JHFS+";
+
+        asprintf( &arguments[5 + 3 * index + 1], "DAStress%u", index + 1 );
+
+        if ( index + 1 < slices )
+        {
+            asprintf( &arguments[5 + 3 * index + 2], "%um", size );
+        }
+        else
+        {
+            arguments[5 + 3 * index + 2] = strdup( "R" );
+        }
+    }
+
+    arguments[5 + 3 * slices] = NULL;
+
+    status = __DAStressWait( __DAStressSpawn( arguments ) );
+
+    free( arguments[3] );
+
+    for ( index = 0; index < slices; index++ )
+    {
+        free( arguments[5 + 3 * index + 1] );
+        free( arguments[5 + 3 * index + 2] );
+    }
+
+    {
+        char * detach[] = { "hdiutil", "detach", "-force", device, NULL };
+
+        if ( __DAStressWait( __DAStressSpawn( detach ) ) == FALSE )
+        {
+            status = FALSE;
+        }
+    }
+
+    return status;
+}
+
+static Boolean __DAStressStormIsAppeared( UInt32 count, UInt32 mounted )
+{
+    UInt32 appeared;
+    UInt32 index;
+
+    /*
+     * The storm has settled once every slice is mounted and every client has been told of every
+     * disk that the first client was told of.
+     */
+
+    if ( __atomic_load_n( &__gDAStressStormMounted, __ATOMIC_ACQUIRE ) < mounted )
+    {
+        return FALSE;
+    }
+
+    appeared = __atomic_load_n( &__gDAStressClientList[0].appeared, __ATOMIC_ACQUIRE );
+
+    if ( appeared < count )
+    {
+        return FALSE;
+    }
+
+    for ( index = 1; index < __gDAStressClientListCount; index++ )
+    {
+        if ( __atomic_load_n( &__gDAStressClientList[index].appeared, __ATOMIC_ACQUIRE ) != appeared )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static Boolean __DAStressStormIsDisappeared( void )
+{
+    UInt32 index;
+
+    for ( index = 0; index < __gDAStressClientListCount; index++ )
+    {
+        __DAStressClient * client;
+
+        client = __gDAStressClientList + index;
+
+        if ( __atomic_load_n( &client->disappeared, __ATOMIC_ACQUIRE ) < __atomic_load_n( &client->appeared, __ATOMIC_ACQUIRE ) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static int __DAStressStorm( int argc, char * argv[] )
+{
+    UInt32          clients   = 8;
+    UInt32          disks     = 16;
+    UInt32          size      = 16;
+    UInt32          slices    = 8;
+    UInt32          timeout   = 600;
+    CFStringRef     model;
+    CFDictionaryRef match;
+    CFArrayRef      watch;
+    char            directory[] = "/tmp/dastress.XXXXXX";
+    char *          path;
+    pid_t *         pidList;
+    pid_t           server;
+    UInt64          footprint;
+    UInt64          footprintPeak;
+    UInt64          start;
+    UInt64          deadline;
+    UInt64          notified;
+    CFIndex         count;
+    CFIndex         index;
+    Boolean         settled;
+    int             option;
+    int             status    = EX_OK;
+
+    if ( geteuid( ) )
+    {
+        fprintf( stderr, "%s: permission denied.\n", __gDAStressName );
+
+        return EX_NOPERM;
+    }
+
+    while ( ( option = getopt( argc, argv, "c:d:m:s:t:" ) ) != -1 )
+    {
+        switch ( option )
+        {
+            case 'c':
+            {
+                clients = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            case 'd':
+            {
+                disks = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            case 'm':
+            {
+                size = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            case 's':
+            {
+                slices = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            case 't':
+            {
+                timeout = strtoul( optarg, NULL, 0 );
+
+                break;
+            }
+            default:
+            {
+                __usage( );
+
+                break;
+            }
+        }
+    }
+
+    if ( clients == 0 || disks == 0 || size == 0 || slices == 0 || slices > 128 )
+    {
+        __usage( );
+    }
+
+    server = __DAStressGetServerProcessID( );
+
+    if ( server == 0 )
+    {
+        fprintf( stderr, "%s: diskarbitrationd is not running.\n", __gDAStressName );
+
+        return EX_UNAVAILABLE;
+    }
+
+    if ( mkdtemp( directory ) == NULL )
+    {
+        fprintf( stderr, "%s: unable to create %s.\n", __gDAStressName, directory );
+
+        return EX_CANTCREAT;
+    }
+
+    /*
+     * Prepare the images.
+     */
+
+    asprintf( &path, "%s/template.dmg", directory );
+
+    if ( path == NULL || __DAStressStormCreateTemplate( path, slices, size ) == FALSE )
+    {
+        fprintf( stderr, "%s: unable to create the template image.\n", __gDAStressName );
+
+        return EX_CANTCREAT;
+    }
+
+    for ( index = 0; index < disks; index++ )
+    {
+        char * clone;
+
+        asprintf( &clone, "%s/disk%ld.dmg", directory, index );
+
+        if ( clone == NULL || copyfile( path, clone, NULL, COPYFILE_CLONE ) )
+        {
+            fprintf( stderr, "%s: unable to create %s.\n", __gDAStressName, clone ? clone : "image" );
+
+            return EX_CANTCREAT;
+        }
+
+        free( clone );
+    }
+
+    unlink( path );
+
+    free( path );
+
+    /*
+     * Create the clients.  The first client is also told of the mounts.
+     */
+
+    model = CFSTR( "Disk Image" );
+    match = CFDictionaryCreate( kCFAllocatorDefault, ( const void ** ) &kDADiskDescriptionDeviceModelKey, ( const void ** ) &model, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+    watch = CFArrayCreate( kCFAllocatorDefault, ( const void ** ) &kDADiskDescriptionVolumePathKey, 1, &kCFTypeArrayCallBacks );
+
+    __gDAStressStormMountList = CFSetCreateMutable( kCFAllocatorDefault, 0, &kCFTypeSetCallBacks );
+    __gDAStressStormWholeList = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+    __DAStressClientListCreate( clients, match, __DAStressStormAppearedCallback, __DAStressStormDisappearedCallback, __DAStressStormSnapshotCallback );
+
+    DARegisterDiskDescriptionChangedCallback( __gDAStressClientList[0].session, match, watch, __DAStressStormDescriptionChangedCallback, __gDAStressClientList );
+
+    for ( index = 0; index < clients; index++ )
+    {
+        while ( __atomic_load_n( &__gDAStressClientList[index].ready, __ATOMIC_ACQUIRE ) == FALSE )
+        {
+            usleep( 1000 );
+        }
+    }
+
+    pidList = calloc( disks, sizeof( pid_t ) );
+
+    if ( pidList == NULL )
+    {
+        fprintf( stderr, "%s: out of memory.\n", __gDAStressName );
+
+        return EX_OSERR;
+    }
+
+    footprint     = __DAStressGetServerFootprint( server );
+    footprintPeak = footprint;
+
+    /*
+     * Attach the images all at once, and wait for the storm to settle.
+     */
+
+    start = __DAStressGetTime( );
+
+    for ( index = 0; index < disks; index++ )
+    {
+        char * image;
+
+        asprintf( &image, "%s/disk%ld.dmg", directory, index );
+
+        if ( image )
+        {
+            char * arguments[] = { "hdiutil", "attach", "-nobrowse", "-noverify", "-noautoopen", image, NULL };
+
+            pidList[index] = __DAStressSpawn( arguments );
+
+            free( image );
+        }
+        else
+        {
+            pidList[index] = -1;
+        }
+    }
+
+    deadline = start + timeout * NSEC_PER_SEC;
+
+    for ( settled = FALSE; settled == FALSE && __DAStressGetTime( ) < deadline; )
+    {
+        footprintPeak = MAX( footprintPeak, __DAStressGetServerFootprint( server ) );
+
+        settled = __DAStressStormIsAppeared( disks * ( slices + 1 ), disks * slices );
+
+        usleep( 10000 );
+    }
+
+    for ( index = 0; index < disks; index++ )
+    {
+        if ( __DAStressWait( pidList[index] ) == FALSE )
+        {
+            fprintf( stderr, "%s: unable to attach disk%ld.dmg.\n", __gDAStressName, index );
+        }
+    }
+
+    notified = 0;
+
+    for ( index = 0; index < clients; index++ )
+    {
+        notified = MAX( notified, __gDAStressClientList[index].appearedLast );
+    }
+
+    printf( "disks:                        %u, with %u slices each\n", disks, slices );
+    printf( "clients:                      %u\n", clients );
+    printf( "media appeared:               %u\n", __atomic_load_n( &__gDAStressClientList[0].appeared, __ATOMIC_ACQUIRE ) );
+    printf( "volumes mounted:              %u\n", __atomic_load_n( &__gDAStressStormMounted, __ATOMIC_ACQUIRE ) );
+    printf( "time to all probed:           %.1f ms\n", __DAStressGetInterval( start, __gDAStressClientList[0].appearedLast ) );
+    printf( "time to all mounted:          %.1f ms\n", __DAStressGetInterval( start, __gDAStressStormMountedLast ) );
+    printf( "time to all clients notified: %.1f ms\n", __DAStressGetInterval( start, notified ) );
+
+    if ( settled == FALSE )
+    {
+        printf( "the storm did not settle within %u seconds.\n", timeout );
+
+        status = EX_TEMPFAIL;
+    }
+
+    /*
+     * Detach the images all at once, and wait for every client to be told.
+     */
+
+    dispatch_sync( __gDAStressClientList[0].queue, ^{ } );
+
+    count = CFArrayGetCount( __gDAStressStormWholeList );
+
+    pidList = reallocf( pidList, MAX( count, 1 ) * sizeof( pid_t ) );
+
+    if ( pidList == NULL )
+    {
+        fprintf( stderr, "%s: out of memory.\n", __gDAStressName );
+
+        return EX_OSERR;
+    }
+
+    start = __DAStressGetTime( );
+
+    for ( index = 0; index < count; index++ )
+    {
+        char name[64];
+
+        pidList[index] = -1;
+
+        strlcpy( name, _PATH_DEV, sizeof( name ) );
+
+        if ( CFStringGetCString( CFArrayGetValueAtIndex( __gDAStressStormWholeList, index ), name + strlen( name ), sizeof( name ) - strlen( name ), kCFStringEncodingUTF8 ) )
+        {
+            char * arguments[] = { "hdiutil", "detach", "-force", name, NULL };
+
+            pidList[index] = __DAStressSpawn( arguments );
+        }
+    }
+
+    deadline = start + timeout * NSEC_PER_SEC;
+
+    for ( settled = FALSE; settled == FALSE && __DAStressGetTime( ) < deadline; )
+    {
+        footprintPeak = MAX( footprintPeak, __DAStressGetServerFootprint( server ) );
+
+        settled = __DAStressStormIsDisappeared( );
+
+        usleep( 10000 );
+    }
+
+    for ( index = 0; index < count; index++ )
+    {
+        __DAStressWait( pidList[index] );
+    }
+
+    notified = 0;
+
+    for ( index = 0; index < clients; index++ )
+    {
+        notified = MAX( notified, __gDAStressClientList[index].disappearedLast );
+    }
+
+    printf( "time to all disappeared:      %.1f ms\n", __DAStressGetInterval( start, notified ) );
+    printf( "server footprint:             %llu KB before, %llu KB at peak\n", footprint / 1024, footprintPeak / 1024 );
+
+    if ( settled == FALSE )
+    {
+        printf( "the disks did not disappear within %u seconds.\n", timeout );
+
+        status = EX_TEMPFAIL;
+    }
+
+    /*
+     * Clean up.
+     */
+
+    __DAStressClientListRelease( );
+
+    for ( index = 0; index < disks; index++ )
+    {
+        char * image;
+
+        asprintf( &image, "%s/disk%ld.dmg", directory, index );
+
+        if ( image )
+        {
+            unlink( image );
+
+            free( image );
+        }
+    }
+
+    rmdir( directory );
+
+    CFRelease( __gDAStressStormMountList );
+    CFRelease( __gDAStressStormWholeList );
+    CFRelease( match );
+    CFRelease( watch );
+
+    free( pidList );
+
+    return status;
+}
+
+int main( int argc, char * argv[] )
+{
+    __gDAStressName = basename( argv[0] );
+
+    if ( argc > 1 )
+    {
+        if ( strcmp( argv[1], "load" ) == 0 )
+        {
+            exit( __DAStressLoad( argc - 1, argv + 1 ) );
+        }
+
+        if ( strcmp( argv[1], "serialize" ) == 0 )
+        {
+            exit( __DAStressSerialize( argc - 1, argv + 1 ) );
+        }
+
+        if ( strcmp( argv[1], "storm" ) == 0 )
+        {
+            exit( __DAStressStorm( argc - 1, argv + 1 ) );
+        }
+    }
+
+    __usage( );
+
+    exit( EX_USAGE );
+}
@@ -45,7 +45,7 @@ DACallbackRef DACallbackCreate( CFAllocatorRef   allocator,
         ___CFDictionarySetIntegerValue( callback, _kDACallbackKindKey,    kind    );
         ___CFDictionarySetIntegerValue( callback, _kDACallbackOrderKey,   order   );
 
-        if ( match )  CFDictionarySetValue( callback, _kDACallbackMatchKey, match );
+        if ( match )  DACallbackSetMatch( ( void * ) callback, match );
         if ( watch )  CFDictionarySetValue( callback, _kDACallbackWatchKey, watch );
     }
 
@@ -97,6 +97,11 @@ SInt32 DACallbackGetOrder( DACallbackRef callback )
     return ___CFDictionaryGetIntegerValue( ( void * ) callback, _kDACallbackOrderKey );
 }
 
+CFDataRef DACallbackGetPredicate( DACallbackRef callback )
+{
+    return CFDictionaryGetValue( ( void * ) callback, _kDACallbackPredicateKey );
+}
+
 DASessionRef DACallbackGetSession( DACallbackRef callback )
 {
     return ( void * ) CFDictionaryGetValue( ( void * ) callback, _kDACallbackSessionKey );
@@ -160,13 +165,33 @@ void DACallbackSetDisk( DACallbackRef callback, DADiskRef disk )
 
 void DACallbackSetMatch( DACallbackRef callback, CFDictionaryRef match )
 {
+    /*
+     * The compiled predicate borrows from the match dictionary, so the two are always set together.
+     */
+
     if ( match )
     {
+        CFDataRef predicate;
+
         CFDictionarySetValue( ( void * ) callback, _kDACallbackMatchKey, match );
+
+        predicate = DADiskCreatePredicate( CFGetAllocator( callback ), match );
+
+        if ( predicate )
+        {
+            CFDictionarySetValue( ( void * ) callback, _kDACallbackPredicateKey, predicate );
+
+            CFRelease( predicate );
+        }
+        else
+        {
+            CFDictionaryRemoveValue( ( void * ) callback, _kDACallbackPredicateKey );
+        }
     }
     else
     {
-        CFDictionaryRemoveValue( ( void * ) callback, _kDACallbackMatchKey );
+        CFDictionaryRemoveValue( ( void * ) callback, _kDACallbackMatchKey     );
+        CFDictionaryRemoveValue( ( void * ) callback, _kDACallbackPredicateKey );
     }
 }
 
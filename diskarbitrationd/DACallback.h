@@ -52,6 +52,7 @@ extern DADiskRef        DACallbackGetDisk( DACallbackRef callback );
 extern _DACallbackKind  DACallbackGetKind( DACallbackRef callback );
 extern CFDictionaryRef  DACallbackGetMatch( DACallbackRef callback );
 extern SInt32           DACallbackGetOrder( DACallbackRef callback );
+extern CFDataRef        DACallbackGetPredicate( DACallbackRef callback );
 extern DASessionRef     DACallbackGetSession( DACallbackRef callback );
 extern CFAbsoluteTime   DACallbackGetTime( DACallbackRef callback );
 extern CFArrayRef       DACallbackGetWatch( DACallbackRef callback );
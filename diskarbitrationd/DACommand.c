@@ -25,6 +25,7 @@
 
 #include "DABase.h"
 #include "DAInternal.h"
+#include "DAWatchdog.h"
 
 #include <fcntl.h>
 #include <paths.h>
@@ -231,6 +232,8 @@ static void __DACommandRunLoopSourceCallback( CFMachPortRef port, void * message
     pid_t pid;
     int   status;
 
+    DAWatchdogBegin( "command port" );
+
     /*
      * Scan through exited or stopped children.
      */
@@ -326,6 +329,8 @@ static void __DACommandRunLoopSourceCallback( CFMachPortRef port, void * message
 
         pthread_mutex_unlock( &__gDACommandRunLoopSourceLock );
     }
+
+    DAWatchdogEnd( );
 }
 
 static void __DACommandSignal( int sig )
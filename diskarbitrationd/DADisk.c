@@ -26,7 +26,9 @@
 #include "DABase.h"
 #include "DAInternal.h"
 #include "DALog.h"
+#include "DAPlatform.h"
 #include "DAPrivate.h"
+#include "DASnapshot.h"
 
 #include <grp.h>
 #include <paths.h>
@@ -58,6 +60,7 @@ struct __DADisk
     SInt32                 _deviceUnit;
     DAFileSystemRef        _filesystem;
     char *                 _id;
+    CFMutableDictionaryRef _match;
     io_service_t           _media;
     mode_t                 _mode;
     DADiskOptions          _options;
@@ -70,6 +73,37 @@ struct __DADisk
 
 typedef struct __DADisk __DADisk;
 
+struct __DADiskPredicateEntry
+{
+    CFStringRef key;
+    CFTypeRef   value;
+    CFTypeID    type;
+    CFHashCode  hash;
+};
+
+typedef struct __DADiskPredicateEntry __DADiskPredicateEntry;
+
+struct __DADiskPredicate
+{
+    CFDictionaryRef        media;
+    CFIndex                count;
+    __DADiskPredicateEntry entries[0];
+};
+
+typedef struct __DADiskPredicate __DADiskPredicate;
+
+static const CFDictionaryKeyCallBacks __kDADiskMatchKeyCallBacks =
+{
+    0,
+    kCFTypeDictionaryKeyCallBacks.retain,
+    kCFTypeDictionaryKeyCallBacks.release,
+    NULL,
+    NULL,
+    NULL
+};
+
+static const CFIndex __kDADiskMatchLimit = 64;
+
 static CFStringRef __DADiskCopyDescription( CFTypeRef object );
 static CFStringRef __DADiskCopyFormattingDescription( CFTypeRef object, CFDictionaryRef options );
 static void        __DADiskDeallocate( CFTypeRef object );
@@ -91,6 +125,8 @@ static const CFRuntimeClass __DADiskClass =
 
 static CFTypeID __kDADiskTypeID = _kCFRuntimeNotATypeID;
 
+static UInt64 __gDADiskGeneration = 0;
+
 extern CFHashCode CFHashBytes( UInt8 * bytes, CFIndex length );
 
 static CFStringRef __DADiskCopyDescription( CFTypeRef object )
@@ -133,6 +169,7 @@ static DADiskRef __DADiskCreate( CFAllocatorRef allocator, const char * id )
         disk->_deviceUnit           = -1;
         disk->_filesystem           = NULL;
         disk->_id                   = strdup( id );
+        disk->_match                = NULL;
         disk->_media                = IO_OBJECT_NULL;
         disk->_mode                 = 0750;
         disk->_options              = 0;
@@ -175,6 +212,7 @@ static void __DADiskDeallocate( CFTypeRef object )
     if ( disk->_devicePath[1]        )  free( disk->_devicePath[1] );
     if ( disk->_filesystem           )  CFRelease( disk->_filesystem );
     if ( disk->_id                   )  free( disk->_id );
+    if ( disk->_match                )  CFRelease( disk->_match );
     if ( disk->_media                )  IOObjectRelease( disk->_media );
     if ( disk->_propertyNotification )  IOObjectRelease( disk->_propertyNotification );
     if ( disk->_serialization        )  CFRelease( disk->_serialization );
@@ -203,9 +241,9 @@ static void __DADiskMatch( const void * key, const void * value, void * context
     {
         if ( CFEqual( key, kDADiskDescriptionMediaMatchKey ) )
         {
-            boolean_t match = FALSE;
+            Boolean match = FALSE;
 
-            IOServiceMatchPropertyTable( disk->_media, value, &match );
+            match = DAPlatformMediaMatch( disk->_media, value );
 
             if ( match == FALSE )
             {
@@ -226,6 +264,70 @@ static void __DADiskMatch( const void * key, const void * value, void * context
     }
 }
 
+static Boolean __DADiskMatchMedia( DADiskRef disk, CFDictionaryRef match )
+{
+    /*
+     * Evaluate a media match against the IOKit registry, remembering the result for this disk.  The
+     * memo is keyed by the identity of the match table, which is owned by a registered callback.
+     */
+
+    CFBooleanRef value = NULL;
+
+    if ( disk->_match )
+    {
+        value = CFDictionaryGetValue( disk->_match, match );
+    }
+
+    if ( value == NULL )
+    {
+        Boolean matched = FALSE;
+
+        matched = DAPlatformMediaMatch( disk->_media, match );
+
+        value = matched ? kCFBooleanTrue : kCFBooleanFalse;
+
+        if ( disk->_match == NULL )
+        {
+            disk->_match = CFDictionaryCreateMutable( CFGetAllocator( disk ), 0, &__kDADiskMatchKeyCallBacks, NULL );
+        }
+
+        if ( disk->_match )
+        {
+            if ( CFDictionaryGetCount( disk->_match ) >= __kDADiskMatchLimit )
+            {
+                CFDictionaryRemoveAllValues( disk->_match );
+            }
+
+            CFDictionarySetValue( disk->_match, match, value );
+        }
+    }
+
+    return ( value == kCFBooleanTrue ) ? TRUE : FALSE;
+}
+
+static void __DADiskPredicateAppend( const void * key, const void * value, void * context )
+{
+    __DADiskPredicate * predicate = context;
+
+    if ( CFEqual( key, kDADiskDescriptionMediaMatchKey ) )
+    {
+        predicate->media = value;
+    }
+    else
+    {
+        __DADiskPredicateEntry * entry;
+
+        entry = predicate->entries + predicate->count;
+
+        entry->key   = key;
+        entry->value = value;
+        entry->type  = CFGetTypeID( value );
+        entry->hash  = CFHash( value );
+
+        predicate->count++;
+    }
+}
+
 CFComparisonResult DADiskCompareDescription( DADiskRef disk, CFStringRef description, CFTypeRef value )
 {
     CFTypeRef object1 = CFDictionaryGetValue( disk->_description, description );
@@ -238,6 +340,35 @@ CFComparisonResult DADiskCompareDescription( DADiskRef disk, CFStringRef descrip
     return CFEqual( object1, object2 ) ? kCFCompareEqualTo : kCFCompareLessThan;
 }
 
+CFDataRef DADiskCreatePredicate( CFAllocatorRef allocator, CFDictionaryRef match )
+{
+    /*
+     * Compile a match dictionary into a flat predicate.  The predicate borrows its keys and values
+     * from the match dictionary, which must outlive it.  The media match, if any, is kept aside so
+     * that it is only evaluated once the cheaper description comparisons have all succeeded.
+     */
+
+    CFMutableDataRef data;
+
+    data = CFDataCreateMutable( allocator, 0 );
+
+    if ( data )
+    {
+        __DADiskPredicate * predicate;
+
+        CFDataSetLength( data, sizeof( __DADiskPredicate ) + CFDictionaryGetCount( match ) * sizeof( __DADiskPredicateEntry ) );
+
+        predicate = ( void * ) CFDataGetMutableBytePtr( data );
+
+        predicate->media = NULL;
+        predicate->count = 0;
+
+        CFDictionaryApplyFunction( match, __DADiskPredicateAppend, predicate );
+    }
+
+    return data;
+}
+
 DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media )
 {
     io_service_t           bus        = IO_OBJECT_NULL;
@@ -366,11 +497,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk description -- media icon.
      */
 
-    object = IORegistryEntrySearchCFProperty( media,
-                                              kIOServicePlane,
-                                              CFSTR( kIOMediaIconKey ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( media, CFSTR( kIOMediaIconKey ), kIORegistryIterateParents | kIORegistryIterateRecursively );
     if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
 
     CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaIconKey, object );
@@ -652,11 +779,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk description -- device unit.
      */
 
-    object = IORegistryEntrySearchCFProperty( device,
-                                              kIOServicePlane,
-                                              CFSTR( "IOUnit" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( device, CFSTR( "IOUnit" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
     if ( object )
     {
@@ -668,11 +791,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk description -- device GUID (IEEE EUI-64).
      */
 
-    object = IORegistryEntrySearchCFProperty( device,
-                                              kIOServicePlane,
-                                              CFSTR( "GUID" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( device, CFSTR( "GUID" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
     if ( object )
     {
@@ -694,11 +813,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk description -- device is TDM locked
      */
 
-    object = IORegistryEntrySearchCFProperty( device,
-                                              kIOServicePlane,
-                                              CFSTR( "AppleTDMLocked" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( device, CFSTR( "AppleTDMLocked" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
     if ( object )
     {
@@ -788,11 +903,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk state -- mount automatic?
      */
 
-    object = IORegistryEntrySearchCFProperty( media,
-                                              kIOServicePlane,
-                                              CFSTR( "autodiskmount" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( media, CFSTR( "autodiskmount" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
     if ( object == NULL )
     {
@@ -809,11 +920,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk state -- owner.
      */
 
-    object = IORegistryEntrySearchCFProperty( media,
-                                              kIOServicePlane,
-                                              CFSTR( "owner-uid" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( media, CFSTR( "owner-uid" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
     if ( object )
     {
@@ -837,11 +944,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
         CFRelease( object );
     }
 
-    object = IORegistryEntrySearchCFProperty( media,
-                                              kIOServicePlane,
-                                              CFSTR( "owner-gid" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( media, CFSTR( "owner-gid" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
     if ( object )
     {
@@ -857,11 +960,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
         CFRelease( object );
     }
 
-    object = IORegistryEntrySearchCFProperty( media,
-                                              kIOServicePlane,
-                                              CFSTR( "owner-mode" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = DAPlatformMediaCopyProperty( media, CFSTR( "owner-mode" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
     if ( object )
     {
@@ -881,11 +980,7 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk state -- media BSD link.
      */
 
-    object = IORegistryEntrySearchCFProperty( media,
-                                              kIOServicePlane,
-                                              CFSTR( "dev-name" ),
-                                              allocator,
-                                              0 );
+    object = DAPlatformMediaCopyProperty( media, CFSTR( "dev-name" ), 0 );
 
     if ( object )
     {
@@ -1154,7 +1249,26 @@ CFDataRef DADiskGetSerialization( DADiskRef disk )
 {
     if ( disk->_serialization == NULL )
     {
-        disk->_serialization = _DASerializeDiskDescription( CFGetAllocator( disk ), disk->_description );
+        CFMutableDictionaryRef description;
+
+        /*
+         * Stamp each serialization with a new generation, so that clients holding an earlier copy of the
+         * description can tell which of the two is the more recent.  The generation goes into a copy of
+         * the description, as it is not a key that the server matches or reports on.
+         */
+
+        description = CFDictionaryCreateMutableCopy( CFGetAllocator( disk ), 0, disk->_description );
+
+        if ( description )
+        {
+            __gDADiskGeneration++;
+
+            ___CFDictionarySetIntegerValue( description, _kDADiskGenerationKey, __gDADiskGeneration );
+
+            disk->_serialization = _DASerializeDiskDescription( CFGetAllocator( disk ), description );
+
+            CFRelease( description );
+        }
     }
 
     return disk->_serialization;
@@ -1192,6 +1306,67 @@ Boolean DADiskMatch( DADiskRef disk, CFDictionaryRef match )
     return disk ? TRUE : FALSE;
 }
 
+Boolean DADiskMatchPredicate( DADiskRef disk, CFDataRef predicate )
+{
+    const __DADiskPredicate * match;
+    CFIndex                   matchIndex;
+
+    if ( disk == NULL )
+    {
+        return FALSE;
+    }
+
+    match = ( void * ) CFDataGetBytePtr( predicate );
+
+    for ( matchIndex = 0; matchIndex < match->count; matchIndex++ )
+    {
+        const __DADiskPredicateEntry * entry;
+        CFTypeRef                      compare;
+
+        entry = match->entries + matchIndex;
+
+        compare = CFDictionaryGetValue( disk->_description, entry->key );
+
+        if ( compare != entry->value )
+        {
+            if ( compare == NULL )
+            {
+                return FALSE;
+            }
+
+            if ( CFGetTypeID( compare ) != entry->type )
+            {
+                return FALSE;
+            }
+
+            if ( CFHash( compare ) != entry->hash )
+            {
+                return FALSE;
+            }
+
+            if ( CFEqual( compare, entry->value ) == FALSE )
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    if ( match->media )
+    {
+        return __DADiskMatchMedia( disk, match->media );
+    }
+
+    return TRUE;
+}
+
+void DADiskResetMatch( DADiskRef disk )
+{
+    if ( disk->_match )
+    {
+        CFDictionaryRemoveAllValues( disk->_match );
+    }
+}
+
 void DADiskSetBusy( DADiskRef disk, CFAbsoluteTime busy )
 {
     disk->_busy = busy;
@@ -1261,6 +1436,8 @@ void DADiskSetClaim( DADiskRef disk, DACallbackRef claim )
 
         disk->_claim = claim;
     }
+
+    DASnapshotUpdateDisk( disk, FALSE );
 }
 
 void DADiskSetContext( DADiskRef disk, CFTypeRef context )
@@ -1314,6 +1491,10 @@ void DADiskSetDescription( DADiskRef disk, CFStringRef description, CFTypeRef va
 
         disk->_serialization = NULL;
     }
+
+    DADiskResetMatch( disk );
+
+    DASnapshotUpdateDisk( disk, TRUE );
 }
 
 void DADiskSetFileSystem( DADiskRef disk, DAFileSystemRef filesystem )
@@ -1342,6 +1523,8 @@ void DADiskSetOptions( DADiskRef disk, DADiskOptions options, Boolean value )
 {
     disk->_options &= ~options;
     disk->_options |= value ? options : 0;
+
+    DASnapshotUpdateDisk( disk, FALSE );
 }
 
 void DADiskSetPropertyNotification( DADiskRef disk, io_object_t notification )
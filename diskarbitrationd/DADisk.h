@@ -61,6 +61,7 @@ typedef UInt32 DADiskState;
 extern CFComparisonResult DADiskCompareDescription( DADiskRef disk, CFStringRef description, CFTypeRef value );
 extern DADiskRef          DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media );
 extern DADiskRef          DADiskCreateFromVolumePath( CFAllocatorRef allocator, const struct statfs * fs );
+extern CFDataRef          DADiskCreatePredicate( CFAllocatorRef allocator, CFDictionaryRef match );
 extern CFAbsoluteTime     DADiskGetBusy( DADiskRef disk );
 extern io_object_t        DADiskGetBusyNotification( DADiskRef disk );
 extern CFURLRef           DADiskGetBypath( DADiskRef disk );
@@ -87,6 +88,8 @@ extern gid_t              DADiskGetUserGID( DADiskRef disk );
 extern uid_t              DADiskGetUserUID( DADiskRef disk );
 extern void               DADiskInitialize( void );
 extern Boolean            DADiskMatch( DADiskRef disk, CFDictionaryRef match );
+extern Boolean            DADiskMatchPredicate( DADiskRef disk, CFDataRef predicate );
+extern void               DADiskResetMatch( DADiskRef disk );
 extern void               DADiskSetBusy( DADiskRef disk, CFAbsoluteTime busy );
 extern void               DADiskSetBusyNotification( DADiskRef disk, io_object_t notification );
 extern void               DADiskSetBypath( DADiskRef disk, CFURLRef bypath );
@@ -25,6 +25,7 @@
 
 #include <paths.h>
 #include <DiskArbitration/DiskArbitration.h>
+#include <libkern/OSByteOrder.h>
 
 __private_extern__ const char * _kDAAuthorizeRightAdopt   = "adopt";
 __private_extern__ const char * _kDAAuthorizeRightEncode  = "encode";
@@ -40,12 +41,17 @@ __private_extern__ const CFStringRef _kDACallbackDiskKey          = CFSTR( "DACa
 __private_extern__ const CFStringRef _kDACallbackKindKey          = CFSTR( "DACallbackKind"      );
 __private_extern__ const CFStringRef _kDACallbackMatchKey         = CFSTR( "DACallbackMatch"     );
 __private_extern__ const CFStringRef _kDACallbackOrderKey         = CFSTR( "DACallbackOrder"     );
+__private_extern__ const CFStringRef _kDACallbackPredicateKey     = CFSTR( "DACallbackPredicate" );
 __private_extern__ const CFStringRef _kDACallbackSessionKey       = CFSTR( "DACallbackSession"   );
 __private_extern__ const CFStringRef _kDACallbackTimeKey          = CFSTR( "DACallbackTime"      );
 __private_extern__ const CFStringRef _kDACallbackWatchKey         = CFSTR( "DACallbackWatch"     );
 
+__private_extern__ const CFStringRef _kDADiskGenerationKey        = CFSTR( "DADiskGeneration"    );
 __private_extern__ const CFStringRef _kDADiskIDKey                = CFSTR( "DADiskID"            );
 
+__private_extern__ const CFStringRef _kDADiskListDisksKey         = CFSTR( "DAListDisks"         );
+__private_extern__ const CFStringRef _kDADiskListGenerationKey    = CFSTR( "DAListGeneration"    );
+
 __private_extern__ const CFStringRef _kDADissenterProcessIDKey    = CFSTR( "DAProcessID"         );
 __private_extern__ const CFStringRef _kDADissenterStatusKey       = CFSTR( "DAStatus"            );
 __private_extern__ const CFStringRef _kDADissenterStatusStringKey = CFSTR( "DAStatusString"      );
@@ -59,6 +65,7 @@ __private_extern__ const CFStringRef _kDARequestDissenterKey      = CFSTR( "DARe
 __private_extern__ const CFStringRef _kDARequestKindKey           = CFSTR( "DARequestKind"       );
 __private_extern__ const CFStringRef _kDARequestLinkKey           = CFSTR( "DARequestLink"       );
 __private_extern__ const CFStringRef _kDARequestStateKey          = CFSTR( "DARequestState"      );
+__private_extern__ const CFStringRef _kDARequestTimeKey           = CFSTR( "DARequestTime"       );
 __private_extern__ const CFStringRef _kDARequestUserGIDKey        = CFSTR( "DARequestUserGID"    );
 __private_extern__ const CFStringRef _kDARequestUserUIDKey        = CFSTR( "DARequestUserUID"    );
 
@@ -126,11 +133,95 @@ static const char * __kDAKindNameList[] =
     "disk unmount",
     "disk unmount approval",
     "idle",
-    "disk list complete"
+    "disk list complete",
+    "disk list snapshot",
+    "disk descriptions"
 };
 
+struct __CFBinaryPlistTrailer
+{
+    uint8_t  _unused[5];
+    uint8_t  _sortVersion;
+    uint8_t  _offsetIntSize;
+    uint8_t  _objectRefSize;
+    uint64_t _numObjects;
+    uint64_t _topObject;
+    uint64_t _offsetTableOffset;
+};
+
+typedef struct __CFBinaryPlistTrailer __CFBinaryPlistTrailer;
+
+_Static_assert( sizeof( __CFBinaryPlistTrailer ) == sizeof( ( ( _DADiskDescriptionIndex * ) 0 )->trailer ), "trailer size" );
+
+extern bool    __CFBinaryPlistCreateObject( const uint8_t *                databytes,
+                                            uint64_t                       datalen,
+                                            uint64_t                       startOffset,
+                                            const __CFBinaryPlistTrailer * trailer,
+                                            CFAllocatorRef                 allocator,
+                                            CFOptionFlags                  mutabilityOption,
+                                            CFMutableDictionaryRef         objects,
+                                            CFPropertyListRef *            plist );
+extern bool    __CFBinaryPlistGetOffsetForValueFromDictionary3( const uint8_t *                databytes,
+                                                                uint64_t                       datalen,
+                                                                uint64_t                       startOffset,
+                                                                const __CFBinaryPlistTrailer * trailer,
+                                                                CFTypeRef                      key,
+                                                                uint64_t *                     koffset,
+                                                                uint64_t *                     voffset,
+                                                                Boolean                        unused,
+                                                                CFMutableDictionaryRef         objects );
+extern bool    __CFBinaryPlistGetTopLevelInfo( const uint8_t *          databytes,
+                                               uint64_t                 datalen,
+                                               uint8_t *                marker,
+                                               uint64_t *               offset,
+                                               __CFBinaryPlistTrailer * trailer );
 extern CFIndex __CFBinaryPlistWriteToStream( CFPropertyListRef plist, CFTypeRef stream );
 
+static Boolean __DABinaryPlistTrailerIsValid( const uint8_t * bytes, uint64_t length, const __CFBinaryPlistTrailer * trailer )
+{
+    const uint8_t * end;
+
+    /*
+     * Check the trailer returned by CoreFoundation against the one written at the end of the data,
+     * which is documented by the binary property list format, so that a change in the private layout
+     * is caught here rather than misread as offsets.
+     */
+
+    if ( length < 8 + sizeof( __CFBinaryPlistTrailer ) )
+    {
+        return FALSE;
+    }
+
+    end = bytes + length - sizeof( __CFBinaryPlistTrailer );
+
+    if ( trailer->_offsetIntSize != end[6] )
+    {
+        return FALSE;
+    }
+
+    if ( trailer->_objectRefSize != end[7] )
+    {
+        return FALSE;
+    }
+
+    if ( trailer->_numObjects != OSReadBigInt64( end, 8 ) )
+    {
+        return FALSE;
+    }
+
+    if ( trailer->_topObject != OSReadBigInt64( end, 16 ) )
+    {
+        return FALSE;
+    }
+
+    if ( trailer->_offsetTableOffset != OSReadBigInt64( end, 24 ) )
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 __private_extern__ int ___statfs( const char * path, struct statfs * buf, int flags )
 {
     struct statfs * mountList;
@@ -426,6 +517,95 @@ __private_extern__ CFDataRef _DASerializeDiskDescription( CFAllocatorRef allocat
     return data;
 }
 
+__private_extern__ Boolean _DASnapshotCopyRecord( const _DASnapshot * snapshot, const char * id, _DASnapshotRecord * record )
+{
+    /*
+     * Each record is guarded by a sequence count that the writer makes odd for the duration of an
+     * update.  A copy is only accepted if the count was even and unchanged across it.  The reader
+     * gives up after a bounded number of attempts, so that a writer that has stopped mid-update
+     * leaves the caller to fall back to the server.
+     */
+
+    UInt32 index;
+    UInt32 probe;
+
+    if ( strlen( id ) >= sizeof( record->id ) )
+    {
+        return FALSE;
+    }
+
+    index = _DASnapshotHash( id ) % _kDASnapshotCount;
+
+    for ( probe = 0; probe < _kDASnapshotCount; probe++ )
+    {
+        const _DASnapshotRecord * entry;
+        UInt32                    attempt;
+
+        entry = &snapshot->records[index];
+
+        for ( attempt = 0; attempt < 1000; attempt++ )
+        {
+            UInt32 sequence;
+
+            sequence = __atomic_load_n( &entry->sequence, __ATOMIC_ACQUIRE );
+
+            if ( ( sequence & 1 ) == 0 )
+            {
+                memcpy( record, entry, sizeof( _DASnapshotRecord ) );
+
+                __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+                if ( __atomic_load_n( &entry->sequence, __ATOMIC_RELAXED ) == sequence )
+                {
+                    break;
+                }
+            }
+        }
+
+        if ( attempt == 1000 )
+        {
+            return FALSE;
+        }
+
+        if ( record->state == _kDASnapshotRecordEmpty )
+        {
+            return FALSE;
+        }
+
+        if ( record->state == _kDASnapshotRecordPresent )
+        {
+            record->id[ sizeof( record->id ) - 1 ] = 0;
+
+            record->mediaBSDName[ sizeof( record->mediaBSDName ) - 1 ] = 0;
+            record->volumePath[ sizeof( record->volumePath ) - 1 ] = 0;
+
+            if ( strcmp( record->id, id ) == 0 )
+            {
+                return TRUE;
+            }
+        }
+
+        index = ( index + 1 ) % _kDASnapshotCount;
+    }
+
+    return FALSE;
+}
+
+__private_extern__ UInt32 _DASnapshotHash( const char * id )
+{
+    UInt32 hash;
+
+    hash = 2166136261U;
+
+    for ( ; *id; id++ )
+    {
+        hash ^= ( UInt8 ) *id;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
 __private_extern__ CFTypeRef _DAUnserialize( CFAllocatorRef allocator, CFDataRef data )
 {
     return CFPropertyListCreateWithData( allocator, data, kCFPropertyListImmutable, NULL, NULL );
@@ -487,6 +667,107 @@ __private_extern__ CFMutableDictionaryRef _DAUnserializeDiskDescription( CFAlloc
     return description;
 }
 
+__private_extern__ CFTypeRef _DAUnserializeDiskDescriptionValue( CFAllocatorRef allocator, CFDataRef data, _DADiskDescriptionIndex * index, CFStringRef key )
+{
+    const uint8_t *         bytes;
+    _DADiskDescriptionIndex indexLocal;
+    uint64_t                length;
+    CFTypeRef               object = NULL;
+
+    /*
+     * Locate the one value in the serialized description, rather than decode the whole of it.  The
+     * description is always written as a binary property list whose top-level object is a dictionary.
+     * The trailer and the offset of the dictionary are read once, and kept in the index supplied by
+     * the caller for the next key.  Should the trailer not be understood, the description is decoded
+     * in full through the public interface instead.
+     */
+
+    bytes  = CFDataGetBytePtr( data );
+    length = CFDataGetLength( data );
+
+    if ( index == NULL )
+    {
+        index = &indexLocal;
+
+        index->state = _kDADiskDescriptionIndexUnknown;
+    }
+
+    if ( index->state == _kDADiskDescriptionIndexUnknown )
+    {
+        uint8_t marker;
+
+        index->state = _kDADiskDescriptionIndexInvalid;
+
+        if ( __CFBinaryPlistGetTopLevelInfo( bytes, length, &marker, &index->offset, ( __CFBinaryPlistTrailer * ) index->trailer ) )
+        {
+            if ( ( marker & 0xF0 ) == 0xD0 )
+            {
+                if ( __DABinaryPlistTrailerIsValid( bytes, length, ( __CFBinaryPlistTrailer * ) index->trailer ) )
+                {
+                    index->state = _kDADiskDescriptionIndexValid;
+                }
+            }
+        }
+    }
+
+    if ( index->state == _kDADiskDescriptionIndexValid )
+    {
+        uint64_t valueOffset;
+
+        if ( __CFBinaryPlistGetOffsetForValueFromDictionary3( bytes, length, index->offset, ( __CFBinaryPlistTrailer * ) index->trailer, key, NULL, &valueOffset, FALSE, NULL ) )
+        {
+            if ( __CFBinaryPlistCreateObject( bytes, length, valueOffset, ( __CFBinaryPlistTrailer * ) index->trailer, allocator, kCFPropertyListImmutable, NULL, &object ) == FALSE )
+            {
+                object = NULL;
+            }
+        }
+    }
+    else
+    {
+        CFPropertyListRef description;
+
+        description = CFPropertyListCreateWithData( allocator, data, kCFPropertyListImmutable, NULL, NULL );
+
+        if ( description )
+        {
+            if ( CFGetTypeID( description ) == CFDictionaryGetTypeID( ) )
+            {
+                object = CFDictionaryGetValue( description, key );
+
+                if ( object )
+                {
+                    CFRetain( object );
+                }
+            }
+
+            CFRelease( description );
+        }
+    }
+
+    if ( object )
+    {
+        CFTypeRef value = NULL;
+
+        if ( CFEqual( key, kDADiskDescriptionMediaUUIDKey ) || CFEqual( key, kDADiskDescriptionVolumeUUIDKey ) )
+        {
+            value = CFUUIDCreateFromString( allocator, object );
+        }
+        else if ( CFEqual( key, kDADiskDescriptionVolumePathKey ) )
+        {
+            value = CFURLCreateWithFileSystemPath( allocator, object, kCFURLPOSIXPathStyle, TRUE );
+        }
+
+        if ( value )
+        {
+            CFRelease( object );
+
+            object = value;
+        }
+    }
+
+    return object;
+}
+
 __private_extern__ CFMutableDictionaryRef _DAUnserializeDiskDescriptionWithBytes( CFAllocatorRef allocator, vm_address_t bytes, vm_size_t length )
 {
     CFMutableDictionaryRef description = NULL;
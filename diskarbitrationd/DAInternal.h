@@ -68,7 +68,9 @@ enum
     _kDADiskUnmountApprovalCallback,
     _kDAIdleCallback,
     _kDADiskListCompleteCallback,
-    _kDADiskLastKind = _kDADiskListCompleteCallback
+    _kDADiskListSnapshotCallback,
+    _kDADiskDescriptionsCallback,
+    _kDADiskLastKind = _kDADiskDescriptionsCallback
 };
 
 typedef UInt32 _DACallbackKind;
@@ -86,6 +88,94 @@ enum
 
 typedef UInt32 _DARequestKind;
 
+#define _kDAEventRingCount   1024
+#define _kDAEventRingVersion 1
+
+struct _DAEventRecord
+{
+    UInt64 index;
+    UInt32 kind;
+    char   id[116];
+};
+
+typedef struct _DAEventRecord _DAEventRecord;
+
+struct _DAEventRing
+{
+    UInt32         version;
+    UInt32         count;
+    UInt64         head;
+    UInt32         queue;
+    UInt32         reserved;
+    _DAEventRecord records[_kDAEventRingCount];
+};
+
+typedef struct _DAEventRing _DAEventRing;
+
+#define _kDASnapshotCount   1024
+#define _kDASnapshotVersion 2
+
+enum
+{
+    _kDASnapshotRecordEmpty   = 0,
+    _kDASnapshotRecordPresent = 1,
+    _kDASnapshotRecordRemoved = 2
+};
+
+enum
+{
+    _kDASnapshotFieldMediaBSDName    = 0x00000001,
+    _kDASnapshotFieldMediaEjectable  = 0x00000002,
+    _kDASnapshotFieldMediaRemovable  = 0x00000004,
+    _kDASnapshotFieldMediaWhole      = 0x00000008,
+    _kDASnapshotFieldMediaWritable   = 0x00000010,
+    _kDASnapshotFieldVolumeMountable = 0x00000020,
+    _kDASnapshotFieldVolumePath      = 0x00000040
+};
+
+struct _DASnapshotRecord
+{
+    UInt32 sequence;
+    UInt32 state;
+    UInt64 generation;
+    UInt32 claimed;
+    UInt32 options;
+    UInt32 userUID;
+    UInt32 fields;
+    UInt32 present;
+    UInt32 values;
+    char   id[116];
+    char   mediaBSDName[32];
+    char   volumePath[1024];
+};
+
+typedef struct _DASnapshotRecord _DASnapshotRecord;
+
+struct _DASnapshot
+{
+    UInt32            version;
+    UInt32            count;
+    _DASnapshotRecord records[_kDASnapshotCount];
+};
+
+typedef struct _DASnapshot _DASnapshot;
+
+enum
+{
+    _kDADiskDescriptionIndexUnknown = 0,
+    _kDADiskDescriptionIndexValid   = 1,
+    _kDADiskDescriptionIndexInvalid = 2
+};
+
+struct _DADiskDescriptionIndex
+{
+    UInt32   state;
+    uint64_t offset;
+    uint64_t trailer[4];
+};
+
+typedef struct _DADiskDescriptionIndex _DADiskDescriptionIndex;
+
 const char * _kDAAuthorizeRightAdopt;
 const char * _kDAAuthorizeRightEncode;
 const char * _kDAAuthorizeRightMount;
@@ -100,12 +190,17 @@ const CFStringRef _kDACallbackDiskKey;          /* ( DADisk       ) */
 const CFStringRef _kDACallbackKindKey;          /* ( CFNumber     ) */
 const CFStringRef _kDACallbackMatchKey;         /* ( CFDictionary ) */
 const CFStringRef _kDACallbackOrderKey;         /* ( CFNumber     ) */
+const CFStringRef _kDACallbackPredicateKey;     /* ( CFData       ) */
 const CFStringRef _kDACallbackSessionKey;       /* ( DASession    ) */
 const CFStringRef _kDACallbackTimeKey;          /* ( CFDate       ) */
 const CFStringRef _kDACallbackWatchKey;         /* ( CFArray      ) */
 
+const CFStringRef _kDADiskGenerationKey;        /* ( CFNumber     ) */
 const CFStringRef _kDADiskIDKey;                /* ( CFData       ) */
 
+const CFStringRef _kDADiskListDisksKey;         /* ( CFArray      ) */
+const CFStringRef _kDADiskListGenerationKey;    /* ( CFNumber     ) */
+
 const CFStringRef _kDADissenterProcessIDKey;    /* ( CFNumber     ) */
 const CFStringRef _kDADissenterStatusKey;       /* ( CFNumber     ) */
 const CFStringRef _kDADissenterStatusStringKey; /* ( CFString     ) */
@@ -119,6 +214,7 @@ const CFStringRef _kDARequestDissenterKey;      /* ( DADissenter  ) */
 const CFStringRef _kDARequestKindKey;           /* ( CFNumber     ) */
 const CFStringRef _kDARequestLinkKey;           /* ( CFArray      ) */
 const CFStringRef _kDARequestStateKey;          /* ( CFNumber     ) */
+const CFStringRef _kDARequestTimeKey;           /* ( CFDate       ) */
 const CFStringRef _kDARequestUserGIDKey;        /* ( CFNumber     ) */
 const CFStringRef _kDARequestUserUIDKey;        /* ( CFNumber     ) */
 
@@ -140,9 +236,13 @@ __private_extern__ CFDataRef              _DASerialize( CFAllocatorRef allocator
 __private_extern__ CFDataRef              _DASerializeDiskDescription( CFAllocatorRef allocator, CFDictionaryRef description );
 __private_extern__ CFTypeRef              _DAUnserialize( CFAllocatorRef allocator, CFDataRef data );
 __private_extern__ CFMutableDictionaryRef _DAUnserializeDiskDescription( CFAllocatorRef allocator, CFDataRef data );
+__private_extern__ CFTypeRef              _DAUnserializeDiskDescriptionValue( CFAllocatorRef allocator, CFDataRef data, _DADiskDescriptionIndex * index, CFStringRef key );
 __private_extern__ CFMutableDictionaryRef _DAUnserializeDiskDescriptionWithBytes( CFAllocatorRef allocator, vm_address_t bytes, vm_size_t length );
 __private_extern__ CFTypeRef              _DAUnserializeWithBytes( CFAllocatorRef allocator, vm_address_t bytes, vm_size_t length );
 
+__private_extern__ Boolean _DASnapshotCopyRecord( const _DASnapshot * snapshot, const char * id, _DASnapshotRecord * record );
+__private_extern__ UInt32  _DASnapshotHash( const char * id );
+
 __private_extern__ char * _DAVolumeCopyID( const struct statfs * fs );
 __private_extern__ char * _DAVolumeGetID( const struct statfs * fs );
 
@@ -24,99 +24,794 @@
 #include "DALog.h"
 
 #include "DABase.h"
+#include "DADisk.h"
 #include "DAInternal.h"
+#include "DASession.h"
 
 
 #include <os/log.h>
+#include <pthread.h>
 #include <syslog.h>
 
+/*
+ * Messages are not formatted when they are logged.  The caller records the format and its raw
+ * arguments into a ring of its own thread, and a log thread later formats them and hands them
+ * to os_log, syslog and the debug file, the last of which is flushed once per pass.  Records are
+ * formatted under the log lock, but written out under a lock of their own, so that a caller with
+ * a full ring need not wait on the writes.
+ */
+
+#define __kDALogArgumentCountMax 12
+#define __kDALogMessageSizeMax   2048
+#define __kDALogRingLatency      100000000
+#define __kDALogRingSize         512
+
+enum
+{
+    __kDALogArgumentKindInt      = 0,
+    __kDALogArgumentKindLong     = 1,
+    __kDALogArgumentKindLongLong = 2,
+    __kDALogArgumentKindDouble   = 3,
+    __kDALogArgumentKindObject   = 4,
+    __kDALogArgumentKindPointer  = 5,
+    __kDALogArgumentKindString   = 6
+};
+
+typedef UInt32 __DALogArgumentKind;
+
+struct __DALogArgument
+{
+    __DALogArgumentKind kind;
+
+    union
+    {
+        long long  integer;
+        double     real;
+        CFTypeRef  object;
+        void *     pointer;
+        char *     string;
+    };
+};
+
+typedef struct __DALogArgument __DALogArgument;
+
+struct __DALogRecord
+{
+    int             level;
+    time_t          time;
+    const char *    format;
+    char *          message;
+    UInt32          count;
+    __DALogArgument arguments[__kDALogArgumentCountMax];
+};
+
+typedef struct __DALogRecord __DALogRecord;
+
+struct __DALogRing
+{
+    UInt64               head;
+    UInt64               tail;
+    Boolean              exited;
+    struct __DALogRing * next;
+    __DALogRecord        records[__kDALogRingSize];
+};
+
+typedef struct __DALogRing __DALogRing;
+
+struct __DALogEntry
+{
+    int                   level;
+    time_t                time;
+    char *                message;
+    struct __DALogEntry * next;
+};
+
+typedef struct __DALogEntry __DALogEntry;
+
 static Boolean __gDALogDebug            = FALSE;
 static FILE *  __gDALogDebugFile        = NULL;
 static char *  __gDALogDebugHeaderLast  = NULL;
-static char *  __gDALogDebugHeaderNext  = NULL;
 static Boolean __gDALogDebugHeaderReset = FALSE;
 static Boolean __gDALogError            = FALSE;
 static os_log_t __gDALog                   = NULL;
 
+DADebugLogSubsystems gDALogDebugSubsystems = 0;
 
-static void __DALog( int level, const char * format, va_list arguments )
+static pthread_cond_t  __gDALogCondition   = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t __gDALogLock        = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  __gDALogOnce        = PTHREAD_ONCE_INIT;
+static __DALogEntry *  __gDALogPending     = NULL;
+static __DALogEntry ** __gDALogPendingTail = &__gDALogPending;
+static __DALogRing *   __gDALogRingList    = NULL;
+static __DALogRecord   __gDALogDebugHeaderNext;
+static pthread_key_t   __gDALogRingKey;
+static Boolean         __gDALogThread      = FALSE;
+static pthread_mutex_t __gDALogWriteLock   = PTHREAD_MUTEX_INITIALIZER;
+
+static void __DALogRecordRelease( __DALogRecord * record )
 {
-    char * message;
+    UInt32 index;
 
-    if ( arguments )
+    for ( index = 0; index < record->count; index++ )
     {
-        message = ___CFStringCreateCStringWithFormatAndArguments( format, arguments );
+        switch ( record->arguments[index].kind )
+        {
+            case __kDALogArgumentKindObject:
+            {
+                if ( record->arguments[index].object )
+                {
+                    CFRelease( record->arguments[index].object );
+                }
+
+                break;
+            }
+            case __kDALogArgumentKindString:
+            {
+                if ( record->arguments[index].string )
+                {
+                    free( record->arguments[index].string );
+                }
+
+                break;
+            }
+        }
     }
-    else
+
+    if ( record->message )
     {
-        message = strdup( format );
+        free( record->message );
     }
 
-    if ( message )
+    record->count   = 0;
+    record->message = NULL;
+}
+
+static Boolean __DALogRecordCapture( __DALogRecord * record, const char * format, va_list arguments, Boolean local )
+{
+    /*
+     * Capture the raw arguments for the format.  A format that cannot be captured is formatted by
+     * the caller instead.  A local record is formatted later on the calling thread, and so may hold
+     * on to the objects themselves.
+     */
+
+    const char * cursor;
+
+    record->count = 0;
+
+    for ( cursor = format; *cursor; cursor++ )
     {
-        switch ( level )
+        __DALogArgument * argument;
+        UInt32            length = 0;
+
+        if ( *cursor != '%' )
         {
-            case LOG_DEBUG:
-            {
-                if ( __gDALogDebug )
-                {
+            continue;
+        }
 
+        cursor++;
 
-                     /* Remove in next version */
-                    if ( __gDALogDebugFile )
-                    {
-                        time_t clock = time( NULL );
-                        char   stamp[10];
+        if ( *cursor == '%' )
+        {
+            continue;
+        }
 
-                        if ( strftime( stamp, sizeof( stamp ), "%T ", localtime( &clock ) ) )
-                        {
-                            fprintf( __gDALogDebugFile, "%s", stamp );
-                        }
+        while ( *cursor && strchr( "-+ #0123456789.", *cursor ) )
+        {
+            cursor++;
+        }
 
-                        fprintf( __gDALogDebugFile, "%s", message );
-                        fprintf( __gDALogDebugFile, "\n" );
-                        fflush( __gDALogDebugFile );
-                    }
+        while ( *cursor && strchr( "hljqzt", *cursor ) )
+        {
+            if ( *cursor == 'l' || *cursor == 'j' || *cursor == 'q' || *cursor == 'z' || *cursor == 't' )
+            {
+                length++;
+            }
 
+            if ( *cursor == 'j' || *cursor == 'q' )
+            {
+                length++;
+            }
 
+            cursor++;
+        }
 
+        if ( record->count == __kDALogArgumentCountMax )
+        {
+            return FALSE;
+        }
+
+        argument = record->arguments + record->count;
+
+        switch ( *cursor )
+        {
+            case 'c':
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+            {
+                if ( length == 0 )
+                {
+                    argument->kind    = __kDALogArgumentKindInt;
+                    argument->integer = va_arg( arguments, int );
+                }
+                else if ( length == 1 )
+                {
+                    argument->kind    = __kDALogArgumentKindLong;
+                    argument->integer = va_arg( arguments, long );
+                }
+                else
+                {
+                    argument->kind    = __kDALogArgumentKindLongLong;
+                    argument->integer = va_arg( arguments, long long );
                 }
 
-                os_log_info(__gDALog ,"%{public}s" , message);
+                break;
+            }
+            case 'a':
+            case 'A':
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            {
+                argument->kind = __kDALogArgumentKindDouble;
+                argument->real = va_arg( arguments, double );
+
+                break;
+            }
+            case 'p':
+            {
+                argument->kind    = __kDALogArgumentKindPointer;
+                argument->pointer = va_arg( arguments, void * );
+
+                break;
+            }
+            case 's':
+            {
+                char * string;
+
+                string = va_arg( arguments, char * );
+
+                argument->kind   = __kDALogArgumentKindString;
+                argument->string = string ? strdup( string ) : NULL;
 
                 break;
             }
-            case LOG_ERR:
+            case '@':
             {
-                if ( __gDALogError )
+                CFTypeRef object;
+
+                object = va_arg( arguments, CFTypeRef );
+
+                argument->kind   = __kDALogArgumentKindObject;
+                argument->object = NULL;
+
+                if ( object )
                 {
-                    /* Remove in next version */
-                    syslog( level, "%s", message );
+                    CFTypeID type;
+
+                    type = CFGetTypeID( object );
+
+                    /*
+                     * The log thread must not touch an object the daemon may mutate or release once we
+                     * return.  A string is copied, which for an immutable string is merely a retain, and
+                     * a number or boolean is retained.  A disk or session is retained too, since it is
+                     * described only by what it was created with.  Any other object is described now.
+                     */
+
+                    if ( local )
+                    {
+                        argument->object = CFRetain( object );
+                    }
+                    else if ( type == CFStringGetTypeID( ) )
+                    {
+                        argument->object = CFStringCreateCopy( kCFAllocatorDefault, object );
+                    }
+                    else if ( type == CFNumberGetTypeID( ) || type == CFBooleanGetTypeID( ) )
+                    {
+                        argument->object = CFRetain( object );
+                    }
+                    else if ( type == DADiskGetTypeID( ) || type == DASessionGetTypeID( ) )
+                    {
+                        argument->object = CFRetain( object );
+                    }
+                    else
+                    {
+                        argument->object = CFStringCreateWithFormat( kCFAllocatorDefault, NULL, CFSTR( "%@" ), object );
+                    }
                 }
 
-                os_log_error(__gDALog, "%{public}s", message );
+                break;
+            }
+            default:
+            {
+                return FALSE;
+            }
+        }
+
+        record->count++;
+    }
+
+    return TRUE;
+}
+
+static void __DALogRecordFormat( __DALogRecord * record, char * message, size_t messageSize )
+{
+    const char * cursor;
+    size_t       length = 0;
+    UInt32       index  = 0;
+
+    message[0] = 0;
+
+    for ( cursor = record->format; *cursor && length < messageSize - 1; )
+    {
+        __DALogArgument * argument;
+        char              specification[32];
+        const char *      start;
+
+        if ( *cursor != '%' )
+        {
+            message[length++] = *cursor++;
+
+            continue;
+        }
+
+        if ( cursor[1] == '%' )
+        {
+            message[length++] = '%';
+
+            cursor += 2;
+
+            continue;
+        }
+
+        start = cursor++;
+
+        while ( *cursor && strchr( "-+ #0123456789.hljqzt", *cursor ) )
+        {
+            cursor++;
+        }
+
+        if ( *cursor == 0 || index == record->count || ( size_t ) ( cursor - start + 2 ) > sizeof( specification ) )
+        {
+            break;
+        }
+
+        cursor++;
+
+        strlcpy( specification, start, cursor - start + 1 );
+
+        argument = record->arguments + index++;
+
+        switch ( argument->kind )
+        {
+            case __kDALogArgumentKindInt:
+            {
+                snprintf( message + length, messageSize - length, specification, ( int ) argument->integer );
 
                 break;
             }
+            case __kDALogArgumentKindLong:
+            {
+                snprintf( message + length, messageSize - length, specification, ( long ) argument->integer );
 
-            case LOG_INFO:
+                break;
+            }
+            case __kDALogArgumentKindLongLong:
             {
-               //For info we use the default case
+                snprintf( message + length, messageSize - length, specification, argument->integer );
+
+                break;
             }
+            case __kDALogArgumentKindDouble:
+            {
+                snprintf( message + length, messageSize - length, specification, argument->real );
 
-            default:
+                break;
+            }
+            case __kDALogArgumentKindPointer:
+            {
+                snprintf( message + length, messageSize - length, specification, argument->pointer );
+
+                break;
+            }
+            case __kDALogArgumentKindString:
+            {
+                snprintf( message + length, messageSize - length, specification, argument->string ? argument->string : "(null)" );
+
+                break;
+            }
+            case __kDALogArgumentKindObject:
+            {
+                if ( argument->object )
+                {
+                    CFStringRef string;
+
+                    string = CFStringCreateWithFormat( kCFAllocatorDefault, NULL, CFSTR( "%@" ), argument->object );
+
+                    if ( string )
+                    {
+                        ___CFStringGetCString( string, message + length, messageSize - length );
+
+                        CFRelease( string );
+                    }
+                }
+                else
+                {
+                    strlcpy( message + length, "(null)", messageSize - length );
+                }
+
+                break;
+            }
+        }
+
+        length += strlen( message + length );
+    }
+
+    message[length] = 0;
+}
+
+static void __DALogWrite( int level, time_t clock, const char * message )
+{
+    switch ( level )
+    {
+        case LOG_DEBUG:
+        {
+            if ( __gDALogDebug )
             {
 
+
+                 /* Remove in next version */
+                if ( __gDALogDebugFile )
+                {
+                    char   stamp[10];
+
+                    if ( strftime( stamp, sizeof( stamp ), "%T ", localtime( &clock ) ) )
+                    {
+                        fprintf( __gDALogDebugFile, "%s", stamp );
+                    }
+
+                    fprintf( __gDALogDebugFile, "%s", message );
+                    fprintf( __gDALogDebugFile, "\n" );
+                }
+
+
+
+            }
+
+            os_log_info(__gDALog ,"%{public}s" , message);
+
+            break;
+        }
+        case LOG_ERR:
+        {
+            if ( __gDALogError )
+            {
                 /* Remove in next version */
                 syslog( level, "%s", message );
+            }
 
-                os_log(__gDALog ,"%{public}s" , message);
+            os_log_error(__gDALog, "%{public}s", message );
 
-                break;
+            break;
+        }
+
+        case LOG_INFO:
+        {
+           //For info we use the default case
+        }
+
+        default:
+        {
+
+            /* Remove in next version */
+            syslog( level, "%s", message );
+
+            os_log(__gDALog ,"%{public}s" , message);
+
+            break;
+        }
+    }
+}
+
+static void __DALogDrain( void )
+{
+    /*
+     * Format the records of every ring onto the pending list.  The caller holds the log lock.
+     */
+
+    __DALogRing ** link;
+
+    link = &__gDALogRingList;
+
+    while ( *link )
+    {
+        __DALogRing * ring;
+        UInt64        head;
+        UInt64        tail;
+
+        ring = *link;
+
+        head = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+
+        for ( tail = ring->tail; tail < head; tail++ )
+        {
+            __DALogEntry *  entry;
+            __DALogRecord * record;
+
+            record = ring->records + ( tail % __kDALogRingSize );
+
+            entry = malloc( sizeof( __DALogEntry ) );
+
+            if ( entry )
+            {
+                if ( record->format == NULL )
+                {
+                    entry->message  = record->message;
+
+                    record->message = NULL;
+                }
+                else
+                {
+                    char message[__kDALogMessageSizeMax];
+
+                    __DALogRecordFormat( record, message, sizeof( message ) );
+
+                    entry->message = strdup( message );
+                }
+
+                if ( entry->message )
+                {
+                    entry->level = record->level;
+                    entry->time  = record->time;
+                    entry->next  = NULL;
+
+                    *__gDALogPendingTail = entry;
+
+                    __gDALogPendingTail = &entry->next;
+                }
+                else
+                {
+                    free( entry );
+                }
             }
+
+            __DALogRecordRelease( record );
         }
 
-        free( message );
+        __atomic_store_n( &ring->tail, tail, __ATOMIC_RELEASE );
+
+        if ( __atomic_load_n( &ring->exited, __ATOMIC_ACQUIRE ) && tail == __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) )
+        {
+            *link = ring->next;
+
+            free( ring );
+        }
+        else
+        {
+            link = &ring->next;
+        }
+    }
+}
+
+static void __DALogEmit( void )
+{
+    /*
+     * Write out the pending list.  The caller holds the log lock, which is released here once the
+     * write lock is taken, so that the writes are kept in order without holding up the callers.
+     */
+
+    __DALogEntry * entry;
+
+    entry = __gDALogPending;
+
+    __gDALogPending     = NULL;
+    __gDALogPendingTail = &__gDALogPending;
+
+    pthread_mutex_lock( &__gDALogWriteLock );
+
+    pthread_mutex_unlock( &__gDALogLock );
+
+    while ( entry )
+    {
+        __DALogEntry * next;
+
+        next = entry->next;
+
+        __DALogWrite( entry->level, entry->time, entry->message );
+
+        free( entry->message );
+        free( entry );
+
+        entry = next;
+    }
+
+    if ( __gDALogDebugFile )
+    {
+        fflush( __gDALogDebugFile );
+    }
+
+    pthread_mutex_unlock( &__gDALogWriteLock );
+}
+
+static void __DALogFlush( void )
+{
+    pthread_mutex_lock( &__gDALogLock );
+
+    __DALogDrain( );
+
+    __DALogEmit( );
+}
+
+static void __DALogRingExit( void * context )
+{
+    __DALogRing * ring = context;
+
+    __atomic_store_n( &ring->exited, TRUE, __ATOMIC_RELEASE );
+}
+
+static void __DALogRingInitialize( void )
+{
+    pthread_key_create( &__gDALogRingKey, __DALogRingExit );
+}
+
+static __DALogRing * __DALogGetRing( void )
+{
+    __DALogRing * ring;
+
+    pthread_once( &__gDALogOnce, __DALogRingInitialize );
+
+    ring = pthread_getspecific( __gDALogRingKey );
+
+    if ( ring == NULL )
+    {
+        ring = calloc( 1, sizeof( __DALogRing ) );
+
+        if ( ring )
+        {
+            pthread_setspecific( __gDALogRingKey, ring );
+
+            pthread_mutex_lock( &__gDALogLock );
+
+            ring->next = __gDALogRingList;
+
+            __gDALogRingList = ring;
+
+            pthread_mutex_unlock( &__gDALogLock );
+        }
+    }
+
+    return ring;
+}
+
+static void * __DALogThread( void * context )
+{
+    for ( ; ; )
+    {
+        struct timespec deadline;
+
+        __DALogFlush( );
+
+        pthread_mutex_lock( &__gDALogLock );
+
+        clock_gettime( CLOCK_REALTIME, &deadline );
+
+        deadline.tv_nsec += __kDALogRingLatency;
+
+        if ( deadline.tv_nsec >= 1000000000 )
+        {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        pthread_cond_timedwait( &__gDALogCondition, &__gDALogLock, &deadline );
+
+        pthread_mutex_unlock( &__gDALogLock );
+    }
+
+    return NULL;
+}
+
+static void __DALog( int level, const char * format, va_list arguments )
+{
+    __DALogRing * ring;
+
+    if ( level == LOG_DEBUG )
+    {
+        /*
+         * A debug message that no subsystem is selected for, such as the copy of an error, is not
+         * captured at all, so that its objects are not described for nothing.
+         */
+
+        if ( __atomic_load_n( &gDALogDebugSubsystems, __ATOMIC_RELAXED ) == 0 )
+        {
+            return;
+        }
+    }
+
+    ring = __DALogGetRing( );
+
+    if ( ring )
+    {
+        __DALogRecord * record;
+        UInt64          head;
+
+        head = ring->head;
+
+        if ( head - __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE ) >= __kDALogRingSize )
+        {
+            /*
+             * The ring is full, so drain it here rather than lose the message.  The writes are left
+             * to the log thread, when there is one.
+             */
+
+            if ( __gDALogThread )
+            {
+                pthread_mutex_lock( &__gDALogLock );
+
+                __DALogDrain( );
+
+                pthread_mutex_unlock( &__gDALogLock );
+
+                pthread_cond_signal( &__gDALogCondition );
+            }
+            else
+            {
+                __DALogFlush( );
+            }
+        }
+
+        record = ring->records + ( head % __kDALogRingSize );
+
+        record->level   = level;
+        record->time    = time( NULL );
+        record->format  = format;
+        record->message = NULL;
+        record->count   = 0;
+
+        if ( arguments )
+        {
+            va_list capture;
+
+            va_copy( capture, arguments );
+
+            if ( __DALogRecordCapture( record, format, capture, FALSE ) == FALSE )
+            {
+                __DALogRecordRelease( record );
+
+                record->format  = NULL;
+                record->message = ___CFStringCreateCStringWithFormatAndArguments( format, arguments );
+            }
+
+            va_end( capture );
+        }
+        else
+        {
+            record->format  = NULL;
+            record->message = strdup( format );
+        }
+
+        if ( record->message || record->format )
+        {
+            __atomic_store_n( &ring->head, head + 1, __ATOMIC_RELEASE );
+        }
+
+        if ( __gDALogThread == FALSE )
+        {
+            if ( __gDALog )
+            {
+                __DALogFlush( );
+            }
+        }
+        else if ( level != LOG_DEBUG )
+        {
+            pthread_cond_signal( &__gDALogCondition );
+        }
     }
 }
 
@@ -134,9 +829,12 @@ void DALog( const char * format, ... )
   /* Remove in next version */
 void DALogClose( void )
 {
+    __DALogFlush( );
+
     __gDALogDebug   = FALSE;
     __gDALogError   = FALSE;
 
+    pthread_mutex_lock( &__gDALogWriteLock );
 
     if ( __gDALogDebugFile )
     {
@@ -145,10 +843,12 @@ void DALogClose( void )
         __gDALogDebugFile = NULL;
     }
 
+    pthread_mutex_unlock( &__gDALogWriteLock );
+
     closelog( );
 }
 
-void DALogDebug( const char * format, ... )
+void _DALogDebug( const char * format, ... )
 {
     va_list arguments;
 
@@ -156,20 +856,42 @@ void DALogDebug( const char * format, ... )
 
     if ( __gDALogDebugHeaderReset )
     {
-        assert( __gDALogDebugHeaderNext );
+        char header[__kDALogMessageSizeMax];
+
+        /*
+         * The header is formatted only now that a message is to appear under it, and is written out
+         * only if it differs from the one the previous message appeared under.
+         */
 
-        if ( __gDALogDebugHeaderLast )
+        if ( __gDALogDebugHeaderNext.format )
         {
-            free( __gDALogDebugHeaderLast );
+            __DALogRecordFormat( &__gDALogDebugHeaderNext, header, sizeof( header ) );
         }
+        else
+        {
+            strlcpy( header, __gDALogDebugHeaderNext.message ? __gDALogDebugHeaderNext.message : "", sizeof( header ) );
+        }
+
+        __DALogRecordRelease( &__gDALogDebugHeaderNext );
 
-        __gDALogDebugHeaderLast  = __gDALogDebugHeaderNext;
-        __gDALogDebugHeaderNext  = NULL;
         __gDALogDebugHeaderReset = FALSE;
 
-        __DALog( LOG_DEBUG, "", NULL );
+        if ( __gDALogDebugHeaderLast == NULL || strcmp( __gDALogDebugHeaderLast, header ) )
+        {
+            if ( __gDALogDebugHeaderLast )
+            {
+                free( __gDALogDebugHeaderLast );
+            }
+
+            __gDALogDebugHeaderLast = strdup( header );
+
+            if ( __gDALogDebugHeaderLast )
+            {
+                __DALog( LOG_DEBUG, "", NULL );
 
-        __DALog( LOG_DEBUG, __gDALogDebugHeaderLast, NULL );
+                __DALog( LOG_DEBUG, __gDALogDebugHeaderLast, NULL );
+            }
+        }
     }
 
     __DALog( LOG_DEBUG, format, arguments );
@@ -177,46 +899,45 @@ void DALogDebug( const char * format, ... )
     va_end( arguments );
 }
 
-void DALogDebugHeader( const char * format, ... )
+void _DALogDebugHeader( const char * format, ... )
 {
     va_list arguments;
 
     va_start( arguments, format );
 
-    if ( __gDALogDebugHeaderNext )
+    /*
+     * Capture the header rather than format it, since most headers are replaced before any message
+     * appears under them.
+     */
+
+    if ( __gDALogDebugHeaderReset )
     {
-        free( __gDALogDebugHeaderNext );
+        __DALogRecordRelease( &__gDALogDebugHeaderNext );
 
-        __gDALogDebugHeaderNext  = NULL;
         __gDALogDebugHeaderReset = FALSE;
     }
 
     if ( format )
     {
-        char * header;
+        va_list capture;
 
-        header = ___CFStringCreateCStringWithFormatAndArguments( format, arguments );
+        __gDALogDebugHeaderNext.format  = format;
+        __gDALogDebugHeaderNext.message = NULL;
+        __gDALogDebugHeaderNext.count   = 0;
 
-        if ( header )
+        va_copy( capture, arguments );
+
+        if ( __DALogRecordCapture( &__gDALogDebugHeaderNext, format, capture, TRUE ) == FALSE )
         {
-            if ( __gDALogDebugHeaderLast )
-            {
-                if ( strcmp( __gDALogDebugHeaderLast, header ) )
-                {
-                    __gDALogDebugHeaderNext  = header;
-                    __gDALogDebugHeaderReset = TRUE;
-                }
-                else
-                {
-                    free( header );
-                }
-            }
-            else
-            {
-                __gDALogDebugHeaderNext  = header;
-                __gDALogDebugHeaderReset = TRUE;
-            }
+            __DALogRecordRelease( &__gDALogDebugHeaderNext );
+
+            __gDALogDebugHeaderNext.format  = NULL;
+            __gDALogDebugHeaderNext.message = ___CFStringCreateCStringWithFormatAndArguments( format, arguments );
         }
+
+        va_end( capture );
+
+        __gDALogDebugHeaderReset = TRUE;
     }
 
     va_end( arguments );
@@ -264,5 +985,32 @@ void DALogOpen( char * name, Boolean debug, Boolean error )
     __gDALogDebug   = debug;
     __gDALogError   = error;
 
+    /*
+     * Debug messages are gated at the call site.  They are kept when debugging is enabled, or when
+     * os_log would persist them, and may be selected later through DALogSetDebugSubsystems( ).
+     */
+
+    if ( debug || os_log_info_enabled( __gDALog ) )
+    {
+        gDALogDebugSubsystems = kDADebugLogSubsystemAll;
+    }
+
+    if ( __gDALogThread == FALSE )
+    {
+        pthread_t thread;
+
+        if ( pthread_create( &thread, NULL, __DALogThread, NULL ) == 0 )
+        {
+            pthread_detach( thread );
+
+            atexit( __DALogFlush );
+
+            __gDALogThread = TRUE;
+        }
+    }
 }
 
+void DALogSetDebugSubsystems( DADebugLogSubsystems subsystems )
+{
+    __atomic_store_n( &gDALogDebugSubsystems, subsystems, __ATOMIC_RELAXED );
+}
@@ -25,17 +25,39 @@
 #define __DISKARBITRATIOND_DALOG__
 
 #include <CoreFoundation/CoreFoundation.h>
+#include <DiskArbitration/DiskArbitrationPrivate.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/*
+ * A source file may define DA_LOG_SUBSYSTEM ahead of its includes to attribute its debug messages
+ * to a subsystem.  A debug message for a subsystem that is not enabled costs one branch, and its
+ * arguments are not evaluated.  A header is kept whenever any subsystem is enabled, since the next
+ * debug message to follow it may come from any subsystem.
+ */
+
+#ifndef DA_LOG_SUBSYSTEM
+#define DA_LOG_SUBSYSTEM kDADebugLogSubsystemDefault
+#endif /* !DA_LOG_SUBSYSTEM */
+
+extern DADebugLogSubsystems gDALogDebugSubsystems;
+
+#define DALogDebugEnabled( )       __builtin_expect( ( gDALogDebugSubsystems & ( DA_LOG_SUBSYSTEM ) ) != 0, 0 )
+#define DALogDebugHeaderEnabled( ) __builtin_expect( gDALogDebugSubsystems != 0, 0 )
+
+#define DALogDebug( ... )       do { if ( DALogDebugEnabled( )       ) _DALogDebug( __VA_ARGS__ );       } while ( 0 )
+#define DALogDebugHeader( ... ) do { if ( DALogDebugHeaderEnabled( ) ) _DALogDebugHeader( __VA_ARGS__ ); } while ( 0 )
+
 extern void DALog( const char * format, ... );
 extern void DALogClose( void );
-extern void DALogDebug( const char * format, ... );
-extern void DALogDebugHeader( const char * format, ... );
 extern void DALogError( const char * format, ... );
 extern void DALogOpen( char * name, Boolean debug, Boolean error );
+extern void DALogSetDebugSubsystems( DADebugLogSubsystems subsystems );
+
+extern void _DALogDebug( const char * format, ... );
+extern void _DALogDebugHeader( const char * format, ... );
 
 #ifdef __cplusplus
 }
@@ -29,11 +29,14 @@
 #include "DAFileSystem.h"
 #include "DAInternal.h"
 #include "DALog.h"
+#include "DAMetrics.h"
+#include "DARecord.h"
 #include "DAServer.h"
 #include "DASession.h"
 #include "DAStage.h"
 #include "DASupport.h"
 #include "DAThread.h"
+#include "DAWatchdog.h"
 
 #include <assert.h>
 #include <dirent.h>
@@ -43,6 +46,7 @@
 #include <signal.h>
 #include <sysexits.h>
 #include <unistd.h>
+#include <sys/event.h>
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -54,6 +58,9 @@ static const CFStringRef __kDABundlePath = CFSTR( "/System/Library/Frameworks/Di
 
 static SCDynamicStoreRef     __gDAConfigurationPort   = NULL;
 static Boolean               __gDAOptionDebug         = FALSE;
+static const char *          __gDAOptionRecord        = NULL;
+static const char *          __gDAOptionReplay        = NULL;
+static double                __gDAOptionReplaySpeed   = 1;
 static CFMachPortRef         __gDAVolumeMountedPort   = NULL;
 static CFMachPortRef         __gDAVolumeUnmountedPort = NULL;
 static CFMachPortRef         __gDAVolumeUpdatedPort   = NULL;
@@ -82,7 +89,7 @@ pid_t                  gDAProcessID                    = 0;
 char *                 gDAProcessName                  = NULL;
 char *                 gDAProcessNameID                = NULL;
 CFMutableArrayRef      gDARequestList                  = NULL;
-CFMutableArrayRef      gDAResponseList                 = NULL;
+CFMutableDictionaryRef gDAResponseList                 = NULL;
 CFMutableArrayRef      gDASessionList                  = NULL;
 CFMutableDictionaryRef gDAUnitList                     = NULL;
 
@@ -117,9 +124,12 @@ static void __usage( void )
      * Print usage.
      */
 
-    fprintf( stderr, "%s: [-d]\n", gDAProcessName );
+    fprintf( stderr, "%s: [-d] [-r file] [-R file [-s speed]]\n", gDAProcessName );
     fprintf( stderr, "options:\n" );
     fprintf( stderr, "\t-d\tenable debugging\n" );
+    fprintf( stderr, "\t-r\trecord inputs to file\n" );
+    fprintf( stderr, "\t-R\treplay inputs from file\n" );
+    fprintf( stderr, "\t-s\treplay at speed, or as fast as possible at 0\n" );
 
     exit( EX_USAGE );
 }
@@ -289,15 +299,49 @@ static void __DAMainSignal( int sig )
 #endif
 }
 
+static void __DAMainInfoCallback( CFFileDescriptorRef descriptor, CFOptionFlags types, void * info )
+{
+    /*
+     * Process SIGINFO signals, which write out the metrics.
+     */
+
+    struct kevent   event;
+    FILE *          file;
+    char            path[MAXPATHLEN];
+    struct timespec timeout = { 0, 0 };
+
+    while ( kevent( CFFileDescriptorGetNativeDescriptor( descriptor ), NULL, 0, &event, 1, &timeout ) > 0 )
+    {
+        continue;
+    }
+
+    snprintf( path, sizeof( path ), "/var/run/%s.metrics", gDAProcessName );
+
+    file = fopen( path, "w" );
+
+    if ( file )
+    {
+        DAMetricsWrite( file );
+
+        fclose( file );
+    }
+
+    CFFileDescriptorEnableCallBacks( descriptor, kCFFileDescriptorReadCallBack );
+}
+
 static void __DAMain( void )
 {
-    FILE *             file;
-    CFStringRef        key;
-    CFMutableArrayRef  keys;
-    char               path[MAXPATHLEN];
-    mach_port_t        port;
-    CFRunLoopSourceRef source;
-    int                token;
+    CFFileDescriptorRef  descriptor;
+    struct kevent        event;
+    FILE *               file;
+    CFStringRef          key;
+    CFMutableArrayRef    keys;
+    CFRunLoopObserverRef observer;
+    char                 path[MAXPATHLEN];
+    mach_port_t          port;
+    int                  queue;
+    CFRunLoopSourceRef   source;
+    int                  token;
 
     /*
      * Initialize classes.
@@ -404,7 +448,7 @@ static void __DAMain( void )
      * Create the response list.
      */
 
-    gDAResponseList = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+    gDAResponseList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
     assert( gDAResponseList );
 
@@ -528,6 +572,60 @@ static void __DAMain( void )
 
     CFRelease( source );
 
+    /*
+     * Create the watchdog run loop observer.
+     */
+
+    observer = DAWatchdogCreateRunLoopObserver( kCFAllocatorDefault, 0 );
+
+    if ( observer == NULL )
+    {
+        DALogError( "could not create watchdog run loop observer." );
+        exit( EX_SOFTWARE );
+    }
+
+    CFRunLoopAddObserver( CFRunLoopGetCurrent( ), observer, kCFRunLoopDefaultMode );
+
+    CFRelease( observer );
+
+    /*
+     * Create the SIGINFO run loop source.
+     */
+
+    signal( SIGINFO, SIG_IGN );
+
+    EV_SET( &event, SIGINFO, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL );
+
+    queue = kqueue( );
+
+    if ( queue == -1 || kevent( queue, &event, 1, NULL, 0, NULL ) == -1 )
+    {
+        DALogError( "could not create SIGINFO notification." );
+        exit( EX_SOFTWARE );
+    }
+
+    descriptor = CFFileDescriptorCreate( kCFAllocatorDefault, queue, TRUE, __DAMainInfoCallback, NULL );
+
+    if ( descriptor == NULL )
+    {
+        DALogError( "could not create SIGINFO notification descriptor." );
+        exit( EX_SOFTWARE );
+    }
+
+    CFFileDescriptorEnableCallBacks( descriptor, kCFFileDescriptorReadCallBack );
+
+    source = CFFileDescriptorCreateRunLoopSource( kCFAllocatorDefault, descriptor, 0 );
+
+    if ( source == NULL )
+    {
+        DALogError( "could not create SIGINFO notification run loop source." );
+        exit( EX_SOFTWARE );
+    }
+
+    CFRunLoopAddSource( CFRunLoopGetCurrent( ), source, kCFRunLoopDefaultMode );
+
+    CFRelease( source );
+
     /*
      * Create the "media disappeared" notification.
      */
@@ -737,6 +835,19 @@ static void __DAMain( void )
 
     DAPreferenceListRefresh( );
 
+    /*
+     * Open the record of inputs.
+     */
+
+    if ( __gDAOptionRecord )
+    {
+        if ( DARecordOpen( __gDAOptionRecord ) == FALSE )
+        {
+            DALogError( "could not open record %s.", __gDAOptionRecord );
+            exit( EX_CANTCREAT );
+        }
+    }
+
     /*
      * Process the initial set of media objects in I/O Kit.
      */
@@ -745,6 +856,19 @@ static void __DAMain( void )
 
     _DAMediaAppearedCallback( NULL, gDAMediaAppearedNotification );
 
+    /*
+     * Replay the record of inputs.
+     */
+
+    if ( __gDAOptionReplay )
+    {
+        if ( DARecordReplay( __gDAOptionReplay, __gDAOptionReplaySpeed ) == FALSE )
+        {
+            DALogError( "could not replay record %s.", __gDAOptionReplay );
+            exit( EX_NOINPUT );
+        }
+    }
+
     /*
      * Start the server.
      */
@@ -781,7 +905,7 @@ int main( int argc, char * argv[], char * envp[] )
      * Process arguments.
      */
 
-    while ( ( option = getopt( argc, argv, "d" ) ) != -1 )
+    while ( ( option = getopt( argc, argv, "dr:R:s:" ) ) != -1 )
     {
         switch ( option )
         {
@@ -791,6 +915,24 @@ int main( int argc, char * argv[], char * envp[] )
 
                 break;
             }
+            case 'r':
+            {
+                __gDAOptionRecord = optarg;
+
+                break;
+            }
+            case 'R':
+            {
+                __gDAOptionReplay = optarg;
+
+                break;
+            }
+            case 's':
+            {
+                __gDAOptionReplaySpeed = strtod( optarg, NULL );
+
+                break;
+            }
             default:
             {
                 __usage( );
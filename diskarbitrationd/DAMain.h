@@ -56,7 +56,7 @@ extern pid_t                  gDAProcessID;
 extern char *                 gDAProcessName;
 extern char *                 gDAProcessNameID;
 extern CFMutableArrayRef      gDARequestList;
-extern CFMutableArrayRef      gDAResponseList;
+extern CFMutableDictionaryRef gDAResponseList;
 extern CFMutableArrayRef      gDASessionList;
 extern CFMutableDictionaryRef gDAUnitList;
 
@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "DAMetrics.h"
+
+#include "DABase.h"
+#include "DAInternal.h"
+#include "DAMain.h"
+
+#include <math.h>
+#include <sys/resource.h>
+
+#define __kDAMetricsBucketCount 528
+#define __kDAMetricsSeriesLimit 256
+#define __kDAMetricsSpanLimit   1024
+#define __kDAMetricsValueLimit  ( ( 1ULL << 36 ) - 1 )
+
+/*
+ * Metrics are kept as a set of series, each named for what it measures and qualified by a key
+ * such as a file system kind, a client or a routine.  A series is either a counter or a histogram.
+ * Histograms are log-linear, after HdrHistogram: values below 32 are counted exactly and larger
+ * values in sixteen buckets per power of two, for a precision of about six percent.  Intervals are
+ * recorded in microseconds.  Metrics are recorded on the main thread.  A series is never freed, so
+ * a hot path may look its histogram up once and record into it with DAMetricsRecordValue( ).
+ */
+
+struct __DAMetricsSeries
+{
+    char    name[32];
+    char    key[48];
+    Boolean histogram;
+    UInt64  count;
+    UInt64  sum;
+    UInt64  min;
+    UInt64  max;
+    UInt32  bucket[__kDAMetricsBucketCount];
+};
+
+typedef struct __DAMetricsSeries __DAMetricsSeries;
+
+static CFMutableDictionaryRef __gDAMetricsSeriesList = NULL;
+static CFMutableDictionaryRef __gDAMetricsSpanList   = NULL;
+
+static CFIndex __DAMetricsGetBucket( UInt64 value )
+{
+    CFIndex magnitude;
+
+    if ( value < 32 )
+    {
+        return value;
+    }
+
+    magnitude = 63 - __builtin_clzll( value );
+
+    return ( ( magnitude - 3 ) * 16 ) + ( ( value >> ( magnitude - 4 ) ) & 15 );
+}
+
+static UInt64 __DAMetricsGetBucketLimit( CFIndex bucket )
+{
+    /*
+     * Obtain the largest value counted in a bucket.
+     */
+
+    CFIndex magnitude;
+
+    if ( bucket < 32 )
+    {
+        return bucket;
+    }
+
+    magnitude = ( bucket / 16 ) + 3;
+
+    return ( ( ( UInt64 ) ( 16 + ( bucket % 16 ) + 1 ) ) << ( magnitude - 4 ) ) - 1;
+}
+
+static CFStringRef __DAMetricsCreateSpanID( DADiskRef disk, const char * name, const char * key )
+{
+    return CFStringCreateWithFormat( kCFAllocatorDefault, NULL, CFSTR( "%s\n%s\n%s" ), disk ? DADiskGetID( disk ) : "", name, key ? key : "" );
+}
+
+static int __DAMetricsSeriesCompare( const void * a, const void * b )
+{
+    const __DAMetricsSeries * series1 = *( const __DAMetricsSeries ** ) a;
+    const __DAMetricsSeries * series2 = *( const __DAMetricsSeries ** ) b;
+    int                       compare;
+
+    compare = strcmp( series1->name, series2->name );
+
+    if ( compare == 0 )
+    {
+        compare = strcmp( series1->key, series2->key );
+    }
+
+    return compare;
+}
+
+static __DAMetricsSeries ** __DAMetricsCopySeriesList( CFIndex * count )
+{
+    /*
+     * Obtain the series, sorted by name and key.
+     */
+
+    __DAMetricsSeries ** list = NULL;
+
+    *count = 0;
+
+    if ( __gDAMetricsSeriesList )
+    {
+        *count = CFDictionaryGetCount( __gDAMetricsSeriesList );
+
+        list = malloc( ( *count + 1 ) * sizeof( __DAMetricsSeries * ) );
+
+        if ( list )
+        {
+            CFIndex index;
+
+            CFDictionaryGetKeysAndValues( __gDAMetricsSeriesList, NULL, ( const void ** ) list );
+
+            for ( index = 0; index < *count; index++ )
+            {
+                list[index] = ( void * ) CFDataGetBytePtr( ( CFDataRef ) list[index] );
+            }
+
+            qsort( list, *count, sizeof( __DAMetricsSeries * ), __DAMetricsSeriesCompare );
+        }
+        else
+        {
+            *count = 0;
+        }
+    }
+
+    return list;
+}
+
+static __DAMetricsSeries * __DAMetricsGetSeries( const char * name, const char * key, Boolean histogram )
+{
+    CFMutableDataRef data = NULL;
+    CFStringRef      id;
+
+    if ( __gDAMetricsSeriesList == NULL )
+    {
+        __gDAMetricsSeriesList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        if ( __gDAMetricsSeriesList == NULL )
+        {
+            return NULL;
+        }
+    }
+
+    key = key ? key : "";
+
+    id = CFStringCreateWithFormat( kCFAllocatorDefault, NULL, CFSTR( "%s\n%s" ), name, key );
+
+    if ( id )
+    {
+        data = ( void * ) CFDictionaryGetValue( __gDAMetricsSeriesList, id );
+
+        if ( data == NULL )
+        {
+            if ( CFDictionaryGetCount( __gDAMetricsSeriesList ) >= __kDAMetricsSeriesLimit )
+            {
+                /*
+                 * Keys such as clients are not bounded in number.  Once the limit is reached, the
+                 * series for any further key is folded into one.
+                 */
+
+                CFRelease( id );
+
+                key = "*";
+
+                id = CFStringCreateWithFormat( kCFAllocatorDefault, NULL, CFSTR( "%s\n%s" ), name, key );
+
+                if ( id == NULL )
+                {
+                    return NULL;
+                }
+
+                data = ( void * ) CFDictionaryGetValue( __gDAMetricsSeriesList, id );
+            }
+        }
+
+        if ( data == NULL )
+        {
+            data = CFDataCreateMutable( kCFAllocatorDefault, sizeof( __DAMetricsSeries ) );
+
+            if ( data )
+            {
+                __DAMetricsSeries * series;
+
+                CFDataSetLength( data, sizeof( __DAMetricsSeries ) );
+
+                series = ( void * ) CFDataGetMutableBytePtr( data );
+
+                strlcpy( series->name, name, sizeof( series->name ) );
+                strlcpy( series->key,  key,  sizeof( series->key  ) );
+
+                series->histogram = histogram;
+
+                CFDictionarySetValue( __gDAMetricsSeriesList, id, data );
+
+                CFRelease( data );
+            }
+        }
+
+        CFRelease( id );
+    }
+
+    return data ? ( void * ) CFDataGetMutableBytePtr( data ) : NULL;
+}
+
+static void __DAMetricsUpdateProcessTime( void )
+{
+    /*
+     * Give the processor time of the server, in microseconds, as the counts of a pair of counters,
+     * such that the load on the server can be weighed against the latency of its routines.
+     */
+
+    struct rusage usage;
+
+    if ( getrusage( RUSAGE_SELF, &usage ) == 0 )
+    {
+        __DAMetricsSeries * series;
+
+        series = __DAMetricsGetSeries( "cpu time", "user", FALSE );
+
+        if ( series && strcmp( series->key, "user" ) == 0 )
+        {
+            series->count = usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec;
+        }
+
+        series = __DAMetricsGetSeries( "cpu time", "system", FALSE );
+
+        if ( series && strcmp( series->key, "system" ) == 0 )
+        {
+            series->count = usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec;
+        }
+    }
+}
+
+static UInt64 __DAMetricsSeriesGetQuantile( __DAMetricsSeries * series, double quantile )
+{
+    UInt64  rank;
+    UInt64  total = 0;
+    CFIndex index;
+
+    rank = ( UInt64 ) ceil( quantile * series->count );
+
+    for ( index = 0; index < __kDAMetricsBucketCount; index++ )
+    {
+        total += series->bucket[index];
+
+        if ( total && total >= rank )
+        {
+            UInt64 value;
+
+            value = __DAMetricsGetBucketLimit( index );
+
+            return ( value < series->max ) ? value : series->max;
+        }
+    }
+
+    return series->max;
+}
+
+void DAMetricsBegin( DADiskRef disk, const char * name, const char * key )
+{
+    CFDateRef   date;
+    CFStringRef id;
+
+    if ( __gDAMetricsSpanList == NULL )
+    {
+        __gDAMetricsSpanList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        if ( __gDAMetricsSpanList == NULL )
+        {
+            return;
+        }
+    }
+
+    if ( CFDictionaryGetCount( __gDAMetricsSpanList ) >= __kDAMetricsSpanLimit )
+    {
+        /*
+         * Spans that never end, such as those of a disk that disappears midway, are discarded.
+         */
+
+        CFDictionaryRemoveAllValues( __gDAMetricsSpanList );
+    }
+
+    id = __DAMetricsCreateSpanID( disk, name, key );
+
+    if ( id )
+    {
+        date = CFDateCreate( kCFAllocatorDefault, CFAbsoluteTimeGetCurrent( ) );
+
+        if ( date )
+        {
+            CFDictionarySetValue( __gDAMetricsSpanList, id, date );
+
+            CFRelease( date );
+        }
+
+        CFRelease( id );
+    }
+}
+
+CFDictionaryRef DAMetricsCopy( void )
+{
+    CFMutableDictionaryRef metrics;
+
+    metrics = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( metrics )
+    {
+        __DAMetricsSeries ** list;
+        CFIndex              count;
+        CFIndex              index;
+
+        __DAMetricsUpdateProcessTime( );
+
+        list = __DAMetricsCopySeriesList( &count );
+
+        for ( index = 0; index < count; index++ )
+        {
+            __DAMetricsSeries *    series;
+            CFMutableDictionaryRef keys;
+            CFMutableDictionaryRef value;
+            CFStringRef            string;
+
+            series = list[index];
+
+            string = CFStringCreateWithCString( kCFAllocatorDefault, series->name, kCFStringEncodingUTF8 );
+
+            if ( string == NULL )
+            {
+                continue;
+            }
+
+            keys = ( void * ) CFDictionaryGetValue( metrics, string );
+
+            if ( keys == NULL )
+            {
+                keys = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                if ( keys )
+                {
+                    CFDictionarySetValue( metrics, string, keys );
+
+                    CFRelease( keys );
+                }
+            }
+
+            CFRelease( string );
+
+            value = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            string = CFStringCreateWithCString( kCFAllocatorDefault, series->key, kCFStringEncodingUTF8 );
+
+            if ( keys && value && string )
+            {
+                ___CFDictionarySetIntegerValue( value, CFSTR( "count" ), series->count );
+
+                if ( series->histogram )
+                {
+                    CFMutableArrayRef buckets;
+                    CFIndex           bucket;
+
+                    ___CFDictionarySetIntegerValue( value, CFSTR( "sum"  ), series->sum );
+                    ___CFDictionarySetIntegerValue( value, CFSTR( "min"  ), series->min );
+                    ___CFDictionarySetIntegerValue( value, CFSTR( "max"  ), series->max );
+                    ___CFDictionarySetIntegerValue( value, CFSTR( "p50"  ), __DAMetricsSeriesGetQuantile( series, 0.50  ) );
+                    ___CFDictionarySetIntegerValue( value, CFSTR( "p90"  ), __DAMetricsSeriesGetQuantile( series, 0.90  ) );
+                    ___CFDictionarySetIntegerValue( value, CFSTR( "p99"  ), __DAMetricsSeriesGetQuantile( series, 0.99  ) );
+                    ___CFDictionarySetIntegerValue( value, CFSTR( "p999" ), __DAMetricsSeriesGetQuantile( series, 0.999 ) );
+
+                    /*
+                     * Give the occupied buckets, as pairs of upper limit and count, such that histograms
+                     * can be merged across hosts.
+                     */
+
+                    buckets = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                    if ( buckets )
+                    {
+                        for ( bucket = 0; bucket < __kDAMetricsBucketCount; bucket++ )
+                        {
+                            if ( series->bucket[bucket] )
+                            {
+                                CFNumberRef number;
+
+                                number = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, __DAMetricsGetBucketLimit( bucket ) );
+
+                                if ( number )
+                                {
+                                    CFArrayAppendValue( buckets, number );
+
+                                    CFRelease( number );
+                                }
+
+                                number = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, series->bucket[bucket] );
+
+                                if ( number )
+                                {
+                                    CFArrayAppendValue( buckets, number );
+
+                                    CFRelease( number );
+                                }
+                            }
+                        }
+
+                        CFDictionarySetValue( value, CFSTR( "buckets" ), buckets );
+
+                        CFRelease( buckets );
+                    }
+                }
+
+                CFDictionarySetValue( keys, string, value );
+            }
+
+            if ( string )  CFRelease( string );
+            if ( value  )  CFRelease( value  );
+        }
+
+        if ( list )  free( list );
+    }
+
+    return metrics;
+}
+
+void DAMetricsCount( const char * name, const char * key )
+{
+    __DAMetricsSeries * series;
+
+    series = __DAMetricsGetSeries( name, key, FALSE );
+
+    if ( series )
+    {
+        series->count++;
+    }
+}
+
+void DAMetricsEnd( DADiskRef disk, const char * name, const char * key )
+{
+    if ( __gDAMetricsSpanList )
+    {
+        CFStringRef id;
+
+        id = __DAMetricsCreateSpanID( disk, name, key );
+
+        if ( id )
+        {
+            CFDateRef date;
+
+            date = CFDictionaryGetValue( __gDAMetricsSpanList, id );
+
+            if ( date )
+            {
+                DAMetricsRecordInterval( name, key, CFAbsoluteTimeGetCurrent( ) - CFDateGetAbsoluteTime( date ) );
+
+                CFDictionaryRemoveValue( __gDAMetricsSpanList, id );
+            }
+
+            CFRelease( id );
+        }
+    }
+}
+
+DAMetricsSeriesRef DAMetricsGetHistogram( const char * name, const char * key )
+{
+    return __DAMetricsGetSeries( name, key, TRUE );
+}
+
+void DAMetricsRecord( const char * name, const char * key, UInt64 value )
+{
+    DAMetricsRecordValue( __DAMetricsGetSeries( name, key, TRUE ), value );
+}
+
+void DAMetricsRecordInterval( const char * name, const char * key, CFTimeInterval interval )
+{
+    DAMetricsRecord( name, key, ( interval > 0 ) ? ( UInt64 ) ( interval * 1000000.0 ) : 0 );
+}
+
+void DAMetricsRecordValue( DAMetricsSeriesRef series, UInt64 value )
+{
+    if ( series )
+    {
+        if ( value > __kDAMetricsValueLimit )
+        {
+            value = __kDAMetricsValueLimit;
+        }
+
+        if ( series->count == 0 || value < series->min )
+        {
+            series->min = value;
+        }
+
+        if ( value > series->max )
+        {
+            series->max = value;
+        }
+
+        series->count++;
+
+        series->sum += value;
+
+        series->bucket[__DAMetricsGetBucket( value )]++;
+    }
+}
+
+void DAMetricsWrite( FILE * file )
+{
+    /*
+     * Write the metrics as a table, one series per line, with tab-separated fields.  Intervals are
+     * given in microseconds.  The fields of a histogram that do not apply to a counter are written
+     * as a dash.
+     */
+
+    __DAMetricsSeries ** list;
+    CFIndex              count;
+    CFIndex              index;
+
+    fprintf( file, "# %s, %.0f\n", gDAProcessNameID, CFAbsoluteTimeGetCurrent( ) + kCFAbsoluteTimeIntervalSince1970 );
+
+    fprintf( file, "# name\tkey\tcount\tsum\tmin\tp50\tp90\tp99\tp999\tmax\n" );
+
+    __DAMetricsUpdateProcessTime( );
+
+    list = __DAMetricsCopySeriesList( &count );
+
+    for ( index = 0; index < count; index++ )
+    {
+        __DAMetricsSeries * series;
+
+        series = list[index];
+
+        if ( series->histogram )
+        {
+            fprintf( file,
+                     "%s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+                     series->name,
+                     series->key[0] ? series->key : "-",
+                     series->count,
+                     series->sum,
+                     series->min,
+                     __DAMetricsSeriesGetQuantile( series, 0.50  ),
+                     __DAMetricsSeriesGetQuantile( series, 0.90  ),
+                     __DAMetricsSeriesGetQuantile( series, 0.99  ),
+                     __DAMetricsSeriesGetQuantile( series, 0.999 ),
+                     series->max );
+        }
+        else
+        {
+            fprintf( file, "%s\t%s\t%llu\t-\t-\t-\t-\t-\t-\t-\n", series->name, series->key[0] ? series->key : "-", series->count );
+        }
+    }
+
+    if ( list )  free( list );
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef __DISKARBITRATIOND_DAMETRICS__
+#define __DISKARBITRATIOND_DAMETRICS__
+
+#include <stdio.h>
+#include <CoreFoundation/CoreFoundation.h>
+
+#include "DADisk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct __DAMetricsSeries * DAMetricsSeriesRef;
+
+extern void               DAMetricsBegin( DADiskRef disk, const char * name, const char * key );
+extern CFDictionaryRef    DAMetricsCopy( void );
+extern void               DAMetricsCount( const char * name, const char * key );
+extern void               DAMetricsEnd( DADiskRef disk, const char * name, const char * key );
+extern DAMetricsSeriesRef DAMetricsGetHistogram( const char * name, const char * key );
+extern void               DAMetricsRecord( const char * name, const char * key, UInt64 value );
+extern void               DAMetricsRecordInterval( const char * name, const char * key, CFTimeInterval interval );
+extern void               DAMetricsRecordValue( DAMetricsSeriesRef series, UInt64 value );
+extern void               DAMetricsWrite( FILE * file );
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__DISKARBITRATIOND_DAMETRICS__ */
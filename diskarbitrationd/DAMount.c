@@ -21,13 +21,17 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
+#define DA_LOG_SUBSYSTEM kDADebugLogSubsystemFileSystem
+
 #include "DAMount.h"
 
 #include "DABase.h"
 #include "DAInternal.h"
 #include "DALog.h"
 #include "DAMain.h"
+#include "DAPlatform.h"
 #include "DASupport.h"
+#include "DATrace.h"
 
 #include <fstab.h>
 #include <sys/stat.h>
@@ -92,9 +96,17 @@ static void __DAMountWithArgumentsCallbackStage1( int status, void * parameter )
      */
 
     __DAMountCallbackContext * context = parameter;
+    char                       kind[48];
 
     DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
 
+    ___CFStringGetCString( DAFileSystemGetKind( DADiskGetFileSystem( context->disk ) ), kind, sizeof( kind ) );
+
+    if ( status != ECANCELED )
+    {
+        DATraceEnd( context->disk, "repair", kind );
+    }
+
     if ( context->assertionID != kIOPMNullAssertionID )
     {
         IOPMAssertionRelease( context->assertionID );
@@ -162,6 +174,8 @@ static void __DAMountWithArgumentsCallbackStage1( int status, void * parameter )
         {
             DALogDebug( "  mounted disk, id = %@, ongoing.", context->disk );
 
+            DATraceBegin( context->disk, "mount", kind );
+
             DAFileSystemMountWithArguments( DADiskGetFileSystem( context->disk ),
                                             DADiskGetDevice( context->disk ),
                                             context->mountpoint,
@@ -186,9 +200,14 @@ static void __DAMountWithArgumentsCallbackStage2( int status, void * parameter )
      */
 
     __DAMountCallbackContext * context = parameter;
+    char                       kind[48];
 
     DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
 
+    ___CFStringGetCString( DAFileSystemGetKind( DADiskGetFileSystem( context->disk ) ), kind, sizeof( kind ) );
+
+    DATraceEnd( context->disk, "mount", kind );
+
     if ( status )
     {
         /*
@@ -671,11 +690,7 @@ static Boolean DAAPFSCompareVolumeRole(DADiskRef disk, CFStringRef inRole)
     CFTypeRef              roles;
     Boolean                matchesRole = FALSE;
 
-    roles = IORegistryEntrySearchCFProperty ( DADiskGetIOMedia( disk ),
-                                            kIOServicePlane,
-                                            CFSTR( "Role" ),
-                                            kCFAllocatorDefault,
-                                            0 );
+    roles = DAPlatformMediaCopyProperty( DADiskGetIOMedia( disk ), CFSTR( "Role" ), 0 );
 
     if ( roles )
     {
@@ -909,15 +924,11 @@ void DAMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DAMountCallback
             }
             else if ( CFGetTypeID( id ) == CFDictionaryGetTypeID( ) )
             {
-                boolean_t match = FALSE;
-
                 /*
                  * Determine whether the device description matches.
                  */
 
-                IOServiceMatchPropertyTable( DADiskGetIOMedia( disk ), id, &match );
-
-                if ( match )
+                if ( DAPlatformMediaMatch( DADiskGetIOMedia( disk ), id ) )
                 {
                     break;
                 }
@@ -1161,8 +1172,14 @@ void DAMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DAMountCallback
 
     if ( check == kCFBooleanTrue )
     {
+        char kind[48];
+
         DALogDebug( "  repaired disk, id = %@, ongoing.", disk );
 
+        ___CFStringGetCString( DAFileSystemGetKind( DADiskGetFileSystem( disk ) ), kind, sizeof( kind ) );
+
+        DATraceBegin( disk, "repair", kind );
+
         IOPMAssertionCreateWithDescription( kIOPMAssertionTypePreventUserIdleSystemSleep,
                                             CFSTR( _kDADaemonName ),
                                             NULL,
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "DAPlatform.h"
+
+#include "DABase.h"
+#include "DAInternal.h"
+
+#include <libproc.h>
+
+/*
+ * The platform layer holds the services of the operating system that the stage, request, session
+ * and mount logic call upon directly: the mount table, the media registry, the processes using a
+ * volume and the signal of a client.  It is a seam only, with the one backend below, behind which
+ * another, such as a synthetic mount table and media registry, could later be put.  The media
+ * notifications, the probe and repair helpers and the mount tools are outside the layer.
+ */
+
+int DAPlatformGetMountList( struct statfs ** mountList )
+{
+    return getmntinfo( mountList, MNT_NOWAIT );
+}
+
+pid_t DAPlatformGetVolumeProcessID( const char * path )
+{
+    pid_t pid = 0;
+
+    proc_listpidspath( PROC_ALL_PIDS, 0, path, PROC_LISTPIDSPATH_EXCLUDE_EVTONLY | PROC_LISTPIDSPATH_PATH_IS_VOLUME, &pid, sizeof( pid ) );
+
+    return pid;
+}
+
+CFTypeRef DAPlatformMediaCopyProperty( io_service_t media, CFStringRef key, IOOptionBits options )
+{
+    return IORegistryEntrySearchCFProperty( media, kIOServicePlane, key, kCFAllocatorDefault, options );
+}
+
+Boolean DAPlatformMediaMatch( io_service_t media, CFDictionaryRef match )
+{
+    boolean_t matched = FALSE;
+
+    IOServiceMatchPropertyTable( media, match, &matched );
+
+    return matched ? TRUE : FALSE;
+}
+
+void DAPlatformSignal( mach_port_t port )
+{
+    /*
+     * The client port holds no more than one message, so a signal that is already pending absorbs
+     * this one.
+     */
+
+    mach_msg_header_t message;
+    kern_return_t     status;
+
+    message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
+    message.msgh_id          = 0;
+    message.msgh_local_port  = MACH_PORT_NULL;
+    message.msgh_remote_port = port;
+    message.msgh_reserved    = 0;
+    message.msgh_size        = sizeof( message );
+
+    status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+
+    if ( status == MACH_SEND_TIMED_OUT )
+    {
+        mach_msg_destroy( &message );
+    }
+}
@@ -28,6 +28,8 @@
 #include "DAMain.h"
 #include "DAMount.h"
 #include "DAQueue.h"
+#include "DAPlatform.h"
+#include "DASnapshot.h"
 #include "DAStage.h"
 #include "DAThread.h"
 #include "DASupport.h"
@@ -151,7 +153,7 @@ DAReturn _DADiskRefresh( DADiskRef disk )
         int             mountListCount;
         int             mountListIndex;
 
-        mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+        mountListCount = DAPlatformGetMountList( &mountList );
 
         for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
         {
@@ -307,6 +309,8 @@ DAReturn _DADiskRefresh( DADiskRef disk )
 
                 DADiskSetState( disk, kDADiskStateZombie, TRUE );
 
+                DASnapshotRemoveDisk( disk );
+
                 ___CFArrayRemoveValue( gDADiskList, disk );
             }
 
@@ -321,7 +325,7 @@ DAReturn _DADiskRefresh( DADiskRef disk )
         int             mountListCount;
         int             mountListIndex;
 
-        mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+        mountListCount = DAPlatformGetMountList( &mountList );
 
         for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
         {
@@ -21,11 +21,15 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
+#define DA_LOG_SUBSYSTEM kDADebugLogSubsystemFileSystem
+
 #include "DAProbe.h"
 
 #include "DALog.h"
 #include "DAMain.h"
+#include "DAPlatform.h"
 #include "DASupport.h"
+#include "DATrace.h"
 
 #include <fsproperties.h>
 #include <sys/loadable_fs.h>
@@ -60,9 +64,14 @@ static void __DAProbeCallback( int status, CFBooleanRef clean, CFStringRef name,
         if ( context->filesystem )
         {
             CFStringRef kind;
+            char        trace[48];
 
             kind = DAFileSystemGetKind( context->filesystem );
 
+            ___CFStringGetCString( kind, trace, sizeof( trace ) );
+
+            DATraceEnd( context->disk, "probe", trace );
+
             DALogDebug( "  probed disk, id = %@, with %@, failure.", context->disk, kind );
 
             if ( status != FSUR_UNRECOGNIZED )
@@ -99,9 +108,9 @@ static void __DAProbeCallback( int status, CFBooleanRef clean, CFStringRef name,
 
                     if ( properties )
                     {
-                        boolean_t match = FALSE;
+                        Boolean match = FALSE;
 
-                        IOServiceMatchPropertyTable( DADiskGetIOMedia( context->disk ), properties, &match );
+                        match = DAPlatformMediaMatch( DADiskGetIOMedia( context->disk ), properties );
 
                         if ( match )
                         {
@@ -110,6 +119,7 @@ static void __DAProbeCallback( int status, CFBooleanRef clean, CFStringRef name,
                              */
 
                             CFStringRef kind;
+                            char        trace[48];
 
                             kind = DAFileSystemGetKind( filesystem );
 
@@ -127,6 +137,10 @@ static void __DAProbeCallback( int status, CFBooleanRef clean, CFStringRef name,
 
                             DALogDebug( "  probed disk, id = %@, with %@, ongoing.", context->disk, kind );
 
+                            ___CFStringGetCString( kind, trace, sizeof( trace ) );
+
+                            DATraceBegin( context->disk, "probe", trace );
+
                             DAFileSystemProbe( filesystem, DADiskGetDevice( context->disk ), __DAProbeCallback, context );
 
                             return;
@@ -145,9 +159,14 @@ static void __DAProbeCallback( int status, CFBooleanRef clean, CFStringRef name,
          */
 
         CFStringRef kind;
+        char        trace[48];
 
         kind = DAFileSystemGetKind( context->filesystem );
 
+        ___CFStringGetCString( kind, trace, sizeof( trace ) );
+
+        DATraceEnd( context->disk, "probe", trace );
+
         DALogDebug( "  probed disk, id = %@, with %@, success.", context->disk, kind );
     }
 
@@ -21,6 +21,8 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
+#define DA_LOG_SUBSYSTEM kDADebugLogSubsystemQueue
+
 #include "DAQueue.h"
 
 #include "DABase.h"
@@ -31,6 +33,8 @@
 #include "DARequest.h"
 #include "DASession.h"
 #include "DAStage.h"
+#include "DATrace.h"
+#include "DAWatchdog.h"
 
 struct __DAResponseContext
 {
@@ -41,16 +45,492 @@ struct __DAResponseContext
 
 typedef struct __DAResponseContext __DAResponseContext;
 
+struct __DAQueueIndex
+{
+    CFMutableArrayRef      list;
+    CFMutableArrayRef      other;
+    CFMutableDictionaryRef match;
+    CFMutableDictionaryRef watch;
+};
+
+typedef struct __DAQueueIndex __DAQueueIndex;
+
+struct __DAQueueIndexContext
+{
+    CFMutableArrayRef candidates;
+    DADiskRef         disk;
+};
+
+typedef struct __DAQueueIndexContext __DAQueueIndexContext;
+
 const CFTimeInterval __kDAResponseTimerGrace = 1;
 const CFTimeInterval __kDAResponseTimerLimit = 10;
 
+static __DAQueueIndex         __gDAQueueIndex[ _kDADiskLastKind + 1 ];
+static UInt64                 __gDAQueueGeneration    = 0;
+static CFMutableDictionaryRef __gDAQueueIndexSequence = NULL;
+static CFMutableDictionaryRef __gDAResponseListDisk    = NULL;
+static CFMutableDictionaryRef __gDAResponseListSession = NULL;
+static CFRunLoopTimerRef      __gDAResponseTimer       = NULL;
+
 static void __DAResponseTimerRefresh( void );
 
+static CFStringRef __DAQueueIndexCopyAnchor( DACallbackRef callback )
+{
+    /*
+     * Choose the description key under which an equality-only match is indexed.  Any key other than
+     * the media match is an equality test that a disk must pass, so any one of them will do.
+     */
+
+    CFDictionaryRef match;
+    CFStringRef     anchor = NULL;
+
+    match = DACallbackGetMatch( callback );
+
+    if ( match )
+    {
+        CFIndex count;
+
+        count = CFDictionaryGetCount( match );
+
+        if ( count )
+        {
+            const void ** keys;
+
+            keys = malloc( count * sizeof( void * ) );
+
+            if ( keys )
+            {
+                CFIndex index;
+
+                CFDictionaryGetKeysAndValues( match, keys, NULL );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    if ( CFEqual( keys[index], kDADiskDescriptionMediaMatchKey ) == FALSE )
+                    {
+                        anchor = CFRetain( keys[index] );
+
+                        break;
+                    }
+                }
+
+                free( keys );
+            }
+        }
+    }
+
+    return anchor;
+}
+
+static void __DAQueueIndexAdd( DACallbackRef callback )
+{
+    static uintptr_t sequence = 0;
+
+    __DAQueueIndex * index;
+    CFStringRef      anchor;
+    CFArrayRef       watch;
+
+    if ( __gDAQueueIndexSequence == NULL )
+    {
+        _DACallbackKind kind;
+
+        for ( kind = 0; kind <= _kDADiskLastKind; kind++ )
+        {
+            __gDAQueueIndex[kind].list  = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+            __gDAQueueIndex[kind].other = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+            __gDAQueueIndex[kind].match = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+            __gDAQueueIndex[kind].watch = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            assert( __gDAQueueIndex[kind].list  );
+            assert( __gDAQueueIndex[kind].other );
+            assert( __gDAQueueIndex[kind].match );
+            assert( __gDAQueueIndex[kind].watch );
+        }
+
+        __gDAQueueIndexSequence = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, NULL );
+
+        assert( __gDAQueueIndexSequence );
+    }
+
+    index = __gDAQueueIndex + DACallbackGetKind( callback );
+
+    CFArrayAppendValue( index->list, callback );
+
+    CFDictionarySetValue( __gDAQueueIndexSequence, callback, ( void * ) ++sequence );
+
+    watch = ( DACallbackGetKind( callback ) == _kDADiskDescriptionChangedCallback ) ? DACallbackGetWatch( callback ) : NULL;
+
+    anchor = watch ? NULL : __DAQueueIndexCopyAnchor( callback );
+
+    if ( watch )
+    {
+        CFIndex count;
+        CFIndex watchIndex;
+
+        /*
+         * A callback with a watch list is indexed under each key it watches, and is only considered
+         * when one of those keys changes.
+         */
+
+        count = CFArrayGetCount( watch );
+
+        for ( watchIndex = 0; watchIndex < count; watchIndex++ )
+        {
+            CFMutableArrayRef callbacks;
+            CFTypeRef         key;
+
+            key = CFArrayGetValueAtIndex( watch, watchIndex );
+
+            callbacks = ( void * ) CFDictionaryGetValue( index->watch, key );
+
+            if ( callbacks == NULL )
+            {
+                callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                if ( callbacks )
+                {
+                    CFDictionarySetValue( index->watch, key, callbacks );
+
+                    CFRelease( callbacks );
+                }
+            }
+
+            if ( callbacks )
+            {
+                if ( ___CFArrayContainsValue( callbacks, callback ) == FALSE )
+                {
+                    CFArrayAppendValue( callbacks, callback );
+                }
+            }
+        }
+    }
+    else if ( anchor )
+    {
+        CFMutableDictionaryRef values;
+        CFMutableArrayRef      callbacks;
+        CFTypeRef              value;
+
+        value = CFDictionaryGetValue( DACallbackGetMatch( callback ), anchor );
+
+        values = ( void * ) CFDictionaryGetValue( index->match, anchor );
+
+        if ( values == NULL )
+        {
+            values = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            if ( values )
+            {
+                CFDictionarySetValue( index->match, anchor, values );
+
+                CFRelease( values );
+            }
+        }
+
+        if ( values )
+        {
+            callbacks = ( void * ) CFDictionaryGetValue( values, value );
+
+            if ( callbacks == NULL )
+            {
+                callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                if ( callbacks )
+                {
+                    CFDictionarySetValue( values, value, callbacks );
+
+                    CFRelease( callbacks );
+                }
+            }
+
+            if ( callbacks )
+            {
+                CFArrayAppendValue( callbacks, callback );
+            }
+        }
+
+        CFRelease( anchor );
+    }
+    else
+    {
+        CFArrayAppendValue( index->other, callback );
+    }
+}
+
+static CFComparisonResult __DAQueueIndexCompare( const void * value1, const void * value2, void * context )
+{
+    uintptr_t sequence1 = ( uintptr_t ) CFDictionaryGetValue( __gDAQueueIndexSequence, value1 );
+    uintptr_t sequence2 = ( uintptr_t ) CFDictionaryGetValue( __gDAQueueIndexSequence, value2 );
+
+    if ( sequence1 > sequence2 )  return kCFCompareGreaterThan;
+    if ( sequence1 < sequence2 )  return kCFCompareLessThan;
+
+    return kCFCompareEqualTo;
+}
+
+static void __DAQueueIndexCollect( const void * key, const void * value, void * context )
+{
+    __DAQueueIndexContext * collect = context;
+    CFTypeRef               compare;
+
+    compare = DADiskGetDescription( collect->disk, key );
+
+    if ( compare )
+    {
+        CFArrayRef callbacks;
+
+        callbacks = CFDictionaryGetValue( value, compare );
+
+        if ( callbacks )
+        {
+            CFArrayAppendArray( collect->candidates, callbacks, CFRangeMake( 0, CFArrayGetCount( callbacks ) ) );
+        }
+    }
+}
+
+static void __DAQueueIndexRemove( DACallbackRef callback )
+{
+    __DAQueueIndex * index;
+    CFStringRef      anchor;
+    CFArrayRef       watch;
+
+    index = __gDAQueueIndex + DACallbackGetKind( callback );
+
+    CFRetain( callback );
+
+    ___CFArrayRemoveValue( index->list, callback );
+
+    CFDictionaryRemoveValue( __gDAQueueIndexSequence, callback );
+
+    watch = ( DACallbackGetKind( callback ) == _kDADiskDescriptionChangedCallback ) ? DACallbackGetWatch( callback ) : NULL;
+
+    anchor = watch ? NULL : __DAQueueIndexCopyAnchor( callback );
+
+    if ( watch )
+    {
+        CFIndex count;
+        CFIndex watchIndex;
+
+        count = CFArrayGetCount( watch );
+
+        for ( watchIndex = 0; watchIndex < count; watchIndex++ )
+        {
+            CFMutableArrayRef callbacks;
+            CFTypeRef         key;
+
+            key = CFArrayGetValueAtIndex( watch, watchIndex );
+
+            callbacks = ( void * ) CFDictionaryGetValue( index->watch, key );
+
+            if ( callbacks )
+            {
+                ___CFArrayRemoveValue( callbacks, callback );
+
+                if ( CFArrayGetCount( callbacks ) == 0 )
+                {
+                    CFDictionaryRemoveValue( index->watch, key );
+                }
+            }
+        }
+    }
+    else if ( anchor )
+    {
+        CFMutableDictionaryRef values;
+
+        values = ( void * ) CFDictionaryGetValue( index->match, anchor );
+
+        if ( values )
+        {
+            CFMutableArrayRef callbacks;
+            CFTypeRef         value;
+
+            value = CFDictionaryGetValue( DACallbackGetMatch( callback ), anchor );
+
+            callbacks = ( void * ) CFDictionaryGetValue( values, value );
+
+            if ( callbacks )
+            {
+                ___CFArrayRemoveValue( callbacks, callback );
+
+                if ( CFArrayGetCount( callbacks ) == 0 )
+                {
+                    CFDictionaryRemoveValue( values, value );
+
+                    if ( CFDictionaryGetCount( values ) == 0 )
+                    {
+                        CFDictionaryRemoveValue( index->match, anchor );
+                    }
+                }
+            }
+        }
+
+        CFRelease( anchor );
+    }
+    else
+    {
+        ___CFArrayRemoveValue( index->other, callback );
+    }
+
+    CFRelease( callback );
+}
+
+static Boolean __DAQueueCallbackMatch( DACallbackRef callback, DADiskRef disk )
+{
+    CFDataRef predicate;
+
+    /*
+     * Match the disk against the compiled predicate of the callback, or against its match dictionary
+     * where it has no predicate.
+     */
+
+    predicate = DACallbackGetPredicate( callback );
+
+    if ( predicate )
+    {
+        return DADiskMatchPredicate( disk, predicate );
+    }
+    else
+    {
+        CFDictionaryRef match;
+
+        match = DACallbackGetMatch( callback );
+
+        if ( match )
+        {
+            return DADiskMatch( disk, match );
+        }
+    }
+
+    return TRUE;
+}
+
 static void __DAQueueCallbacks( _DACallbackKind kind, DADiskRef argument0, CFTypeRef argument1 )
+{
+    if ( kind == _kDAIdleCallback )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        /*
+         * The idle callback is delivered once per busy session, and marks every session idle.
+         */
+
+        count = CFArrayGetCount( gDASessionList );
+
+        for ( index = 0; index < count; index++ )
+        {
+            DASessionRef session;
+
+            session = ( void * ) CFArrayGetValueAtIndex( gDASessionList, index );
+
+            if ( DASessionGetState( session, kDASessionStateIdle ) )
+            {
+                continue;
+            }
+
+            DAQueueCallbacks( session, kind, argument0, argument1 );
+
+            DASessionSetState( session, kDASessionStateIdle, TRUE );
+        }
+    }
+    else if ( __gDAQueueIndexSequence )
+    {
+        __DAQueueIndex *  index;
+        CFMutableArrayRef candidates;
+
+        /*
+         * Gather the callbacks interested in this event.  Callbacks whose match has an equality test
+         * are only considered when the disk carries the indexed value; the rest of the match is then
+         * evaluated as usual.  Candidates are dispatched in registration order.
+         */
+
+        index = __gDAQueueIndex + kind;
+
+        if ( argument0 == NULL || ( CFDictionaryGetCount( index->match ) == 0 && CFDictionaryGetCount( index->watch ) == 0 ) )
+        {
+            candidates = CFArrayCreateMutableCopy( kCFAllocatorDefault, 0, index->list );
+        }
+        else
+        {
+            candidates = CFArrayCreateMutableCopy( kCFAllocatorDefault, 0, index->other );
+
+            if ( candidates )
+            {
+                __DAQueueIndexContext context;
+
+                context.candidates = candidates;
+                context.disk       = argument0;
+
+                CFDictionaryApplyFunction( index->match, __DAQueueIndexCollect, &context );
+
+                if ( kind == _kDADiskDescriptionChangedCallback )
+                {
+                    CFIndex count;
+                    CFIndex keysIndex;
+
+                    /*
+                     * Only the subscribers watching one of the changed keys are considered.
+                     */
+
+                    count = CFArrayGetCount( argument1 );
+
+                    for ( keysIndex = 0; keysIndex < count; keysIndex++ )
+                    {
+                        CFArrayRef callbacks;
+
+                        callbacks = CFDictionaryGetValue( index->watch, CFArrayGetValueAtIndex( argument1, keysIndex ) );
+
+                        if ( callbacks )
+                        {
+                            CFArrayAppendArray( candidates, callbacks, CFRangeMake( 0, CFArrayGetCount( callbacks ) ) );
+                        }
+                    }
+                }
+
+                CFArraySortValues( candidates, CFRangeMake( 0, CFArrayGetCount( candidates ) ), __DAQueueIndexCompare, NULL );
+            }
+        }
+
+        if ( candidates )
+        {
+            DACallbackRef previous = NULL;
+            CFIndex       count;
+            CFIndex       candidatesIndex;
+
+            count = CFArrayGetCount( candidates );
+
+            for ( candidatesIndex = 0; candidatesIndex < count; candidatesIndex++ )
+            {
+                DACallbackRef callback;
+
+                callback = ( void * ) CFArrayGetValueAtIndex( candidates, candidatesIndex );
+
+                /*
+                 * A subscriber watching several of the changed keys is gathered once per key.
+                 */
+
+                if ( callback != previous )
+                {
+                    DAQueueCallback( callback, argument0, argument1 );
+                }
+
+                previous = callback;
+            }
+
+            CFRelease( candidates );
+        }
+    }
+}
+
+static void __DAQueueEvents( _DACallbackKind kind, DADiskRef disk )
 {
     CFIndex count;
     CFIndex index;
 
+    /*
+     * Record the event in the ring of each session that has one.
+     */
+
     count = CFArrayGetCount( gDASessionList );
 
     for ( index = 0; index < count; index++ )
@@ -59,57 +539,109 @@ static void __DAQueueCallbacks( _DACallbackKind kind, DADiskRef argument0, CFTyp
 
         session = ( void * ) CFArrayGetValueAtIndex( gDASessionList, index );
 
-        if ( kind == _kDAIdleCallback )
+        if ( DASessionGetState( session, kDASessionStateZombie ) == FALSE )
         {
-            if ( DASessionGetState( session, kDASessionStateIdle ) )
+            DASessionQueueEvent( session, kind, DADiskGetID( disk ) );
+        }
+    }
+}
+
+static void __DAQueueGetTraceKey( DASessionRef session, char * key, size_t keySize )
+{
+    /*
+     * Trace events for a client are keyed by its name and session port, which tell apart clients of
+     * the same name.
+     */
+
+    snprintf( key, keySize, "%s:%d", _DASessionGetName( session ), DASessionGetID( session ) );
+}
+
+static void __DAQueueRequest( _DARequestKind kind, DADiskRef argument0, CFIndex argument1, CFTypeRef argument2, CFTypeRef argument3, DACallbackRef callback )
+{
+    DARequestRef request;
+
+    request = DARequestCreate( kCFAllocatorDefault, kind, argument0, argument1, argument2, argument3, ___UID_ROOT, ___GID_WHEEL, callback );
+
+    if ( request )
+    {
+        DAQueueRequest( request );
+
+        CFRelease( request );
+    }
+}
+
+static void __DAResponseAppend( DACallbackRef response )
+{
+    /*
+     * Outstanding responses are keyed by response ID, and are also grouped by disk and by session so
+     * that they can be completed or released without a search of the whole response list.
+     */
+
+    CFMutableArrayRef responses;
+    const void *      keys[2];
+    CFIndex           index;
+    char              key[48];
+
+    if ( __gDAResponseListDisk == NULL )
+    {
+        __gDAResponseListDisk    = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks );
+        __gDAResponseListSession = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDAResponseListDisk    );
+        assert( __gDAResponseListSession );
+    }
+
+    CFDictionarySetValue( gDAResponseList, DACallbackGetArgument1( response ), response );
+
+    keys[0] = DACallbackGetDisk( response );
+    keys[1] = DACallbackGetSession( response );
+
+    for ( index = 0; index < 2; index++ )
+    {
+        CFMutableDictionaryRef list;
+
+        list = index ? __gDAResponseListSession : __gDAResponseListDisk;
+
+        responses = ( void * ) CFDictionaryGetValue( list, keys[index] );
+
+        if ( responses == NULL )
+        {
+            responses = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( responses )
             {
-                continue;
+                CFDictionarySetValue( list, keys[index], responses );
+
+                CFRelease( responses );
             }
         }
 
-        DAQueueCallbacks( session, kind, argument0, argument1 );
-
-        if ( kind == _kDAIdleCallback )
+        if ( responses )
         {
-            DASessionSetState( session, kDASessionStateIdle, TRUE );
+            CFArrayAppendValue( responses, response );
         }
     }
-}
-
-static void __DAQueueRequest( _DARequestKind kind, DADiskRef argument0, CFIndex argument1, CFTypeRef argument2, CFTypeRef argument3, DACallbackRef callback )
-{
-    DARequestRef request;
-
-    request = DARequestCreate( kCFAllocatorDefault, kind, argument0, argument1, argument2, argument3, ___UID_ROOT, ___GID_WHEEL, callback );
-
-    if ( request )
-    {
-        DAQueueRequest( request );
-
-        CFRelease( request );
-    }
-}
 
-static void __DAResponseComplete( DADiskRef disk )
-{
-    CFIndex count;
-    CFIndex index;
+    __DAQueueGetTraceKey( DACallbackGetSession( response ), key, sizeof( key ) );
 
-    count = CFArrayGetCount( gDAResponseList );
+    DATraceBegin( DACallbackGetDisk( response ), _DACallbackKindGetName( DACallbackGetKind( response ) ), key );
 
-    for ( index = 0; index < count; index++ )
+    if ( DASessionGetOption( DACallbackGetSession( response ), kDASessionOptionNoTimeout ) == FALSE )
     {
-        DACallbackRef callback;
+        CFAbsoluteTime timeout;
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+        timeout = DACallbackGetTime( response ) + __kDAResponseTimerLimit + __kDAResponseTimerGrace;
 
-        if ( DACallbackGetDisk( callback ) == disk )
+        if ( __gDAResponseTimer == NULL || timeout < CFRunLoopTimerGetNextFireDate( __gDAResponseTimer ) )
         {
-            break;
+            __DAResponseTimerRefresh( );
         }
     }
+}
 
-    if ( index == count )
+static void __DAResponseComplete( DADiskRef disk )
+{
+    if ( __gDAResponseListDisk == NULL || CFDictionaryGetValue( __gDAResponseListDisk, disk ) == NULL )
     {
         __DAResponseContext context;
 
@@ -121,8 +653,23 @@ static void __DAResponseComplete( DADiskRef disk )
 
         if ( context.response )  CFRelease( context.response );
     }
+}
 
-    __DAResponseTimerRefresh( );
+static CFArrayRef __DAResponseCopyList( CFDictionaryRef list, const void * key )
+{
+    CFArrayRef responses = NULL;
+
+    if ( list )
+    {
+        responses = CFDictionaryGetValue( list, key );
+
+        if ( responses )
+        {
+            responses = CFArrayCreateCopy( kCFAllocatorDefault, responses );
+        }
+    }
+
+    return responses;
 }
 
 static void __DAResponsePrepare( DADiskRef disk, DAResponseCallback callback, void * callbackContext )
@@ -148,23 +695,86 @@ static void __DAResponsePrepare( DADiskRef disk, DAResponseCallback callback, vo
     }
 }
 
+static void __DAResponseRemove( DACallbackRef response )
+{
+    const void * keys[2];
+    CFIndex      index;
+    char         key[48];
+
+    CFRetain( response );
+
+    __DAQueueGetTraceKey( DACallbackGetSession( response ), key, sizeof( key ) );
+
+    DATraceEnd( DACallbackGetDisk( response ), _DACallbackKindGetName( DACallbackGetKind( response ) ), key );
+
+    CFDictionaryRemoveValue( gDAResponseList, DACallbackGetArgument1( response ) );
+
+    keys[0] = DACallbackGetDisk( response );
+    keys[1] = DACallbackGetSession( response );
+
+    for ( index = 0; index < 2; index++ )
+    {
+        CFMutableDictionaryRef list;
+        CFMutableArrayRef      responses;
+
+        list = index ? __gDAResponseListSession : __gDAResponseListDisk;
+
+        responses = ( void * ) CFDictionaryGetValue( list, keys[index] );
+
+        if ( responses )
+        {
+            ___CFArrayRemoveValue( responses, response );
+
+            if ( CFArrayGetCount( responses ) == 0 )
+            {
+                CFDictionaryRemoveValue( list, keys[index] );
+            }
+        }
+    }
+
+    CFRelease( response );
+}
+
 static void __DAResponseTimerCallback( CFRunLoopTimerRef timer, void * info )
 {
     CFAbsoluteTime clock;
     CFIndex        count;
     CFIndex        index;
+    CFArrayRef     responses;
+    const void **  values;
+
+    DAWatchdogBegin( "response timer" );
 
     clock = CFAbsoluteTimeGetCurrent( );
 
-    count = CFArrayGetCount( gDAResponseList );
+    count = CFDictionaryGetCount( gDAResponseList );
+
+    values = malloc( count * sizeof( void * ) );
+
+    responses = NULL;
+
+    if ( values )
+    {
+        CFDictionaryGetKeysAndValues( gDAResponseList, NULL, values );
+
+        responses = CFArrayCreate( kCFAllocatorDefault, values, count, &kCFTypeArrayCallBacks );
+
+        free( values );
+    }
+
+    count = responses ? CFArrayGetCount( responses ) : 0;
 
     for ( index = count - 1; index > -1; index-- )
     {
         DACallbackRef callback;
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+        callback = ( void * ) CFArrayGetValueAtIndex( responses, index );
 
-        if ( callback )
+        /*
+         * Skip any response that was released by the completion of an earlier one.
+         */
+
+        if ( CFDictionaryGetValue( gDAResponseList, DACallbackGetArgument1( callback ) ) == callback )
         {
             DASessionRef session;
 
@@ -195,7 +805,7 @@ static void __DAResponseTimerCallback( CFRunLoopTimerRef timer, void * info )
 
                     CFRetain( disk );
 
-                    CFArrayRemoveValueAtIndex( gDAResponseList, index );
+                    __DAResponseRemove( callback );
 
                     __DAResponseComplete( disk );
 
@@ -204,25 +814,50 @@ static void __DAResponseTimerCallback( CFRunLoopTimerRef timer, void * info )
             }
         }
     }
+
+    if ( responses )
+    {
+        CFRelease( responses );
+    }
+
+    __DAResponseTimerRefresh( );
+
+    DAWatchdogEnd( );
 }
 
 static void __DAResponseTimerRefresh( void )
 {
-    static CFRunLoopTimerRef timer = NULL;
+    /*
+     * The timer is armed for the earliest deadline when a response is added, and is recomputed each
+     * time it fires.  Completed responses do not rearm it; a timer that fires early finds nothing to
+     * expire and simply recomputes.
+     */
 
     CFAbsoluteTime clock;
     CFIndex        count;
     CFIndex        index;
+    const void **  values;
 
     clock = kCFAbsoluteTimeIntervalSince1904;
 
-    count = CFArrayGetCount( gDAResponseList );
+    count = CFDictionaryGetCount( gDAResponseList );
+
+    values = malloc( count * sizeof( void * ) );
+
+    if ( values )
+    {
+        CFDictionaryGetKeysAndValues( gDAResponseList, NULL, values );
+    }
+    else
+    {
+        count = 0;
+    }
 
     for ( index = 0; index < count; index++ )
     {
         DACallbackRef callback;
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+        callback = ( void * ) values[index];
 
         if ( callback )
         {
@@ -244,112 +879,123 @@ static void __DAResponseTimerRefresh( void )
         }
     }
 
-    if ( timer )
+    if ( values )
+    {
+        free( values );
+    }
+
+    if ( __gDAResponseTimer )
     {
-        CFRunLoopTimerSetNextFireDate( timer, clock );
+        CFRunLoopTimerSetNextFireDate( __gDAResponseTimer, clock );
     }
     else
     {
-        timer = CFRunLoopTimerCreate( kCFAllocatorDefault, clock, kCFAbsoluteTimeIntervalSince1904, 0, 0, __DAResponseTimerCallback, NULL );
+        __gDAResponseTimer = CFRunLoopTimerCreate( kCFAllocatorDefault, clock, kCFAbsoluteTimeIntervalSince1904, 0, 0, __DAResponseTimerCallback, NULL );
 
-        if ( timer )
+        if ( __gDAResponseTimer )
         {
-            CFRunLoopAddTimer( CFRunLoopGetCurrent( ), timer, kCFRunLoopDefaultMode );
+            CFRunLoopAddTimer( CFRunLoopGetCurrent( ), __gDAResponseTimer, kCFRunLoopDefaultMode );
         }
     }
 }
 
 Boolean _DAResponseDispatch( CFTypeRef response, SInt32 responseID )
 {
-    CFIndex count;
-    CFIndex index;
+    DACallbackRef callback = NULL;
+    CFNumberRef   key;
 
-    count = CFArrayGetCount( gDAResponseList );
+    key = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, responseID );
 
-    for ( index = 0; index < count; index++ )
+    if ( key )
     {
-        DACallbackRef callback;
+        callback = ( void * ) CFDictionaryGetValue( gDAResponseList, key );
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+        CFRelease( key );
+    }
 
-        if ( ___CFNumberGetIntegerValue( DACallbackGetArgument1( callback ) ) == responseID )
-        {
-            DADiskRef disk;
+    if ( callback )
+    {
+        DADiskRef disk;
 
-            disk = DACallbackGetDisk( callback );
+        disk = DACallbackGetDisk( callback );
 
-            switch ( DACallbackGetKind( callback ) )
+        switch ( DACallbackGetKind( callback ) )
+        {
+            case _kDADiskClaimReleaseCallback:
+            case _kDADiskEjectApprovalCallback:
+            case _kDADiskMountApprovalCallback:
+            case _kDADiskUnmountApprovalCallback:
             {
-                case _kDADiskClaimReleaseCallback:
-                case _kDADiskEjectApprovalCallback:
-                case _kDADiskMountApprovalCallback:
-                case _kDADiskUnmountApprovalCallback:
+                DADissenterRef dissenter;
+
+                dissenter = ( void * ) response;
+
+                if ( dissenter )
                 {
-                    DADissenterRef dissenter;
+                    CFDataRef data;
 
-                    dissenter = ( void * ) response;
+                    data = DADiskGetContextRe( disk );
 
-                    if ( dissenter )
+                    if ( data )
                     {
-                        CFDataRef data;
+                        __DAResponseContext * context;
 
-                        data = DADiskGetContextRe( disk );
+                        context = ( void * ) CFDataGetBytePtr( data );
 
-                        if ( data )
+                        if ( context->response == NULL )
                         {
-                            __DAResponseContext * context;
-
-                            context = ( void * ) CFDataGetBytePtr( data );
-
-                            if ( context->response == NULL )
-                            {
-                                context->response = CFRetain( dissenter );
-                            }
+                            context->response = CFRetain( dissenter );
                         }
-
-                        DALogError( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, dissented, status = 0x%08X.",
-                                    DACallbackGetAddress( callback ),
-                                    DACallbackGetContext( callback ),
-                                    _DACallbackKindGetName( DACallbackGetKind( callback ) ),
-                                    disk,
-                                    DADissenterGetStatus( dissenter ) );
-                    }
-                    else
-                    {
-                        DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, approved.",
-                                    DACallbackGetAddress( callback ),
-                                    DACallbackGetContext( callback ),
-                                    _DACallbackKindGetName( DACallbackGetKind( callback ) ),
-                                    disk );
                     }
 
-                    break;
+                    DALogError( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, dissented, status = 0x%08X.",
+                                DACallbackGetAddress( callback ),
+                                DACallbackGetContext( callback ),
+                                _DACallbackKindGetName( DACallbackGetKind( callback ) ),
+                                disk,
+                                DADissenterGetStatus( dissenter ) );
                 }
-                case _kDADiskPeekCallback:
+                else
                 {
-                    DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@.",
+                    DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, approved.",
                                 DACallbackGetAddress( callback ),
                                 DACallbackGetContext( callback ),
                                 _DACallbackKindGetName( DACallbackGetKind( callback ) ),
                                 disk );
-
-                    break;
                 }
+
+                break;
             }
+            case _kDADiskPeekCallback:
+            {
+                DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@.",
+                            DACallbackGetAddress( callback ),
+                            DACallbackGetContext( callback ),
+                            _DACallbackKindGetName( DACallbackGetKind( callback ) ),
+                            disk );
 
-            CFArrayRemoveValueAtIndex( gDAResponseList, index );
+                break;
+            }
+        }
 
-            __DAResponseComplete( disk );
+        CFRetain( disk );
 
-            break;
-        }
+        __DAResponseRemove( callback );
+
+        __DAResponseComplete( disk );
+
+        CFRelease( disk );
     }
 
-    return ( index < count ) ? TRUE : FALSE;
+    return callback ? TRUE : FALSE;
 }
 
 void DADiskAppearedCallback( DADiskRef disk )
 {
+    __gDAQueueGeneration++;
+
+    __DAQueueEvents( _kDADiskAppearedCallback, disk );
+
     __DAQueueCallbacks( _kDADiskAppearedCallback, disk, NULL );
 }
 
@@ -364,6 +1010,8 @@ void DADiskClaimReleaseCallback( DADiskRef disk, DACallbackRef callback, DARespo
 
 void DADiskDescriptionChangedCallback( DADiskRef disk, CFTypeRef key )
 {
+    __DAQueueEvents( _kDADiskDescriptionChangedCallback, disk );
+
     if ( CFGetTypeID( key ) == CFArrayGetTypeID( ) )
     {
         __DAQueueCallbacks( _kDADiskDescriptionChangedCallback, disk, key );
@@ -384,6 +1032,10 @@ void DADiskDescriptionChangedCallback( DADiskRef disk, CFTypeRef key )
 
 void DADiskDisappearedCallback( DADiskRef disk )
 {
+    __gDAQueueGeneration++;
+
+    __DAQueueEvents( _kDADiskDisappearedCallback, disk );
+
     __DAQueueCallbacks( _kDADiskDisappearedCallback, disk, NULL );
 }
 
@@ -463,10 +1115,8 @@ void DADiskListCompleteCallback( void )
     __DAQueueCallbacks( _kDADiskListCompleteCallback, NULL, NULL );
 }
 
-void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef argument1 )
+void DADiskListSnapshotCallback( DACallbackRef callback, DACallbackRef appeared )
 {
-    static SInt32 responseID = 0;
-    
     DASessionRef session;
 
     session = DACallbackGetSession( callback );
@@ -477,16 +1127,93 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
     {
         if ( DACallbackGetAddress( callback ) )
         {
-            CFDictionaryRef match;
+            CFMutableArrayRef disks;
 
-            match = DACallbackGetMatch( callback );
+            /*
+             * Gather every disk that would have been replayed to the appeared callback into a single record,
+             * stamped with the generation of the disk list.  Appeared and disappeared callbacks queued after it
+             * describe changes made since that generation.  The disks are filtered with the match of the
+             * appeared callback, which the snapshot stands in for, and with the match of the snapshot
+             * callback itself.
+             */
 
-            if ( match )
+            disks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( disks )
             {
-                if ( DADiskMatch( argument0, match ) == FALSE )
+                CFMutableDictionaryRef snapshot;
+                CFIndex                count;
+                CFIndex                index;
+
+                count = CFArrayGetCount( gDADiskList );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    DADiskRef disk;
+
+                    disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+
+                    if ( DADiskGetState( disk, kDADiskStateStagedAppear ) )
+                    {
+                        if ( __DAQueueCallbackMatch( appeared, disk ) && __DAQueueCallbackMatch( callback, disk ) )
+                        {
+                            CFArrayAppendValue( disks, DADiskGetSerialization( disk ) );
+                        }
+                    }
+                }
+
+                snapshot = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                if ( snapshot )
                 {
-                    return;
+                    CFDictionarySetValue( snapshot, _kDADiskListDisksKey, disks );
+
+                    ___CFDictionarySetIntegerValue( snapshot, _kDADiskListGenerationKey, __gDAQueueGeneration );
+
+                    callback = DACallbackCreateCopy( kCFAllocatorDefault, callback );
+
+                    if ( callback )
+                    {
+                        DACallbackSetArgument1( callback, snapshot );
+
+                        DASessionQueueCallback( session, callback );
+
+                        DALogDebug( "  dispatched callback, id = %016llX:%016llX, kind = %s, count = %ld, generation = %llu.",
+                                    DACallbackGetAddress( callback ),
+                                    DACallbackGetContext( callback ),
+                                    _DACallbackKindGetName( DACallbackGetKind( callback ) ),
+                                    CFArrayGetCount( disks ),
+                                    __gDAQueueGeneration );
+
+                        CFRelease( callback );
+                    }
+
+                    CFRelease( snapshot );
                 }
+
+                CFRelease( disks );
+            }
+        }
+    }
+}
+
+void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef argument1 )
+{
+    static SInt32 responseID = 0;
+    
+    DASessionRef session;
+
+    session = DACallbackGetSession( callback );
+
+    DALogDebugHeader( "%s -> %@", gDAProcessNameID, session );
+
+    if ( DASessionGetState( session, kDASessionStateZombie ) == FALSE )
+    {
+        if ( DACallbackGetAddress( callback ) )
+        {
+            if ( __DAQueueCallbackMatch( callback, argument0 ) == FALSE )
+            {
+                return;
             }
 
             switch ( DACallbackGetKind( callback ) )
@@ -498,12 +1225,18 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
 
                     if ( callback )
                     {
+                        char key[48];
+
                         DACallbackSetDisk( callback, argument0 );
 
                         DACallbackSetArgument0( callback, DADiskGetSerialization( argument0 ) );
 
                         DASessionQueueCallback( session, callback );
 
+                        __DAQueueGetTraceKey( session, key, sizeof( key ) );
+
+                        DATraceInstant( argument0, _DACallbackKindGetName( DACallbackGetKind( callback ) ), key );
+
                         DALogDebug( "  dispatched callback, id = %016llX:%016llX, kind = %s, disk = %@.",
                                     DACallbackGetAddress( callback ),
                                     DACallbackGetContext( callback ),
@@ -571,7 +1304,7 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
 
                                 DACallbackSetTime( response, CFAbsoluteTimeGetCurrent( ) );
 
-                                CFArrayAppendValue( gDAResponseList, response );
+                                __DAResponseAppend( response );
 
                                 CFRelease( response );
                             }
@@ -630,7 +1363,7 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
 
                                 DACallbackSetTime( response, CFAbsoluteTimeGetCurrent( ) );
 
-                                CFArrayAppendValue( gDAResponseList, response );
+                                __DAResponseAppend( response );
 
                                 CFRelease( response );
                             }
@@ -781,23 +1514,28 @@ void DAQueueCallbacks( DASessionRef session, _DACallbackKind kind, DADiskRef arg
 
 void DAQueueReleaseDisk( DADiskRef disk )
 {
-    CFIndex count;
-    CFIndex index;
+    CFArrayRef responses;
+    CFIndex    count;
+    CFIndex    index;
 
-    count = CFArrayGetCount( gDAResponseList );
+    responses = __DAResponseCopyList( __gDAResponseListDisk, disk );
 
-    for ( index = count - 1; index > -1; index-- )
+    if ( responses )
     {
-        DACallbackRef callback;
+        count = CFArrayGetCount( responses );
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
-
-        if ( DACallbackGetDisk( callback ) == disk )
+        for ( index = count - 1; index > -1; index-- )
         {
-            CFArrayRemoveValueAtIndex( gDAResponseList, index );
+            DACallbackRef callback;
+
+            callback = ( void * ) CFArrayGetValueAtIndex( responses, index );
+
+            __DAResponseRemove( callback );
 
             __DAResponseComplete( disk );
         }
+
+        CFRelease( responses );
     }
 
     count = CFArrayGetCount( gDARequestList );
@@ -817,29 +1555,64 @@ void DAQueueReleaseDisk( DADiskRef disk )
     }
 }
 
-void DAQueueReleaseSession( DASessionRef session )
+void DAQueueRegisterCallback( DACallbackRef callback )
 {
-    CFIndex count;
-    CFIndex index;
+    __DAQueueIndexAdd( callback );
+}
 
-    count = CFArrayGetCount( gDAResponseList );
+void DAQueueReleaseSession( DASessionRef session )
+{
+    CFArrayRef responses;
+    CFIndex    count;
+    CFIndex    index;
 
-    for ( index = count - 1; index > -1; index-- )
+    if ( __gDAQueueIndexSequence )
     {
-        DACallbackRef callback;
+        _DACallbackKind kind;
+
+        for ( kind = 0; kind <= _kDADiskLastKind; kind++ )
+        {
+            count = CFArrayGetCount( __gDAQueueIndex[kind].list );
+
+            for ( index = count - 1; index > -1; index-- )
+            {
+                DACallbackRef callback;
+
+                callback = ( void * ) CFArrayGetValueAtIndex( __gDAQueueIndex[kind].list, index );
+
+                if ( DACallbackGetSession( callback ) == session )
+                {
+                    __DAQueueIndexRemove( callback );
+                }
+            }
+        }
+    }
+
+    responses = __DAResponseCopyList( __gDAResponseListSession, session );
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+    if ( responses )
+    {
+        count = CFArrayGetCount( responses );
 
-        if ( DACallbackGetSession( callback ) == session )
+        for ( index = count - 1; index > -1; index-- )
         {
-            DADiskRef disk;
+            DACallbackRef callback;
+            DADiskRef     disk;
+
+            callback = ( void * ) CFArrayGetValueAtIndex( responses, index );
 
             disk = DACallbackGetDisk( callback );
 
-            CFArrayRemoveValueAtIndex( gDAResponseList, index );
+            CFRetain( disk );
+
+            __DAResponseRemove( callback );
 
             __DAResponseComplete( disk );
+
+            CFRelease( disk );
         }
+
+        CFRelease( responses );
     }
 
     count = CFArrayGetCount( gDARequestList );
@@ -1016,19 +1789,45 @@ void DAQueueRequest( DARequestRef request )
 
 void DAQueueUnregisterCallback( DACallbackRef callback )
 {
-    CFIndex count;
-    CFIndex index;
+    CFArrayRef callbacks;
+    CFIndex    count;
+    CFIndex    index;
+    CFArrayRef responses;
 
-    count = CFArrayGetCount( gDAResponseList );
+    callbacks = DASessionGetCallbackRegister( DACallbackGetSession( callback ) );
 
-    for ( index = count - 1; index > -1; index-- )
+    if ( callbacks && __gDAQueueIndexSequence )
     {
-        DACallbackRef item;
+        count = CFArrayGetCount( callbacks );
+
+        for ( index = count - 1; index > -1; index-- )
+        {
+            DACallbackRef item;
+
+            item = ( void * ) CFArrayGetValueAtIndex( callbacks, index );
+
+            if ( DACallbackGetAddress( item ) == DACallbackGetAddress( callback ) )
+            {
+                if ( DACallbackGetContext( item ) == DACallbackGetContext( callback ) )
+                {
+                    __DAQueueIndexRemove( item );
+                }
+            }
+        }
+    }
+
+    responses = __DAResponseCopyList( __gDAResponseListSession, DACallbackGetSession( callback ) );
 
-        item = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+    if ( responses )
+    {
+        count = CFArrayGetCount( responses );
 
-        if ( DACallbackGetSession( item ) == DACallbackGetSession( callback ) )
+        for ( index = count - 1; index > -1; index-- )
         {
+            DACallbackRef item;
+
+            item = ( void * ) CFArrayGetValueAtIndex( responses, index );
+
             if ( DACallbackGetAddress( item ) == DACallbackGetAddress( callback ) )
             {
                 if ( DACallbackGetContext( item ) == DACallbackGetContext( callback ) )
@@ -1037,11 +1836,17 @@ void DAQueueUnregisterCallback( DACallbackRef callback )
 
                     disk = DACallbackGetDisk( item );
 
-                    CFArrayRemoveValueAtIndex( gDAResponseList, index );
+                    CFRetain( disk );
+
+                    __DAResponseRemove( item );
 
                     __DAResponseComplete( disk );
+
+                    CFRelease( disk );
                 }
             }
         }
+
+        CFRelease( responses );
     }
 }
@@ -71,10 +71,14 @@ extern void DAIdleCallback( void );
 
 extern void DADiskListCompleteCallback( void );
 
+extern void DADiskListSnapshotCallback( DACallbackRef callback, DACallbackRef appeared );
+
 extern void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef argument1 );
 
 extern void DAQueueCallbacks( DASessionRef session, _DACallbackKind kind, DADiskRef argument0, CFTypeRef argument1 );
 
+extern void DAQueueRegisterCallback( DACallbackRef callback );
+
 extern void DAQueueReleaseDisk( DADiskRef disk );
 
 extern void DAQueueReleaseSession( DASessionRef session );
@@ -0,0 +1,758 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "DARecord.h"
+
+#include "DAInternal.h"
+#include "DALog.h"
+#include "DAPlatform.h"
+#include "DAServer.h"
+#include "DAWatchdog.h"
+
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <time.h>
+#include <unistd.h>
+
+#define __kDARecordMagic "DARECRD1"
+
+/*
+ * The record holds the inputs that reach the server from outside and that a replay can feed back,
+ * in the order that the run loop served them: the mount, unmount and update notifications of the
+ * VFS, and the requests of clients and the replies to them.  A record is the time since the prior
+ * record, in microseconds, its kind and its length, the first and last as variable-length numbers,
+ * followed by its payload, in native byte order.  The record is flushed as it is written, such that
+ * the trace survives a crash of the server.
+ *
+ * The replay feeds a trace back to the server, one record for each firing of a timer, with the
+ * spacing of the trace divided by the given speed, or with no spacing at all for a speed of zero.
+ * The session ports named in a trace are translated to those of the sessions created on replay.
+ *
+ * The media notifications of I/O Kit and the exit status of helpers are not recorded.  The server
+ * acts on the I/O Kit objects and processes behind them, neither of which a replay can recreate,
+ * so a replay runs against the media present on the host it runs on.  The mount table is kept with
+ * each notification of the VFS for the reader of a trace, while a replay consults the live mount
+ * table of the host.  A record of a kind that is not known is read and passed over.
+ *
+ * A request carries the audit token of its client, and a replay serves it under that identity, so
+ * that the mount, unmount and eject requests of a trace act on the media of the host as they did
+ * for the client.  The authorization of a session is not recorded, and the trace is created with
+ * access for its owner alone.
+ */
+
+struct __DARecordEntry
+{
+    DARecordKind  kind;
+    UInt64        time;
+    const UInt8 * bytes;
+    size_t        length;
+};
+
+typedef struct __DARecordEntry __DARecordEntry;
+
+static FILE *                 __gDARecordFile          = NULL;
+static UInt64                 __gDARecordTime          = 0;
+static UInt8 *                __gDARecordReplay        = NULL;
+static __DARecordEntry        __gDARecordReplayEntry;
+static size_t                 __gDARecordReplayLength  = 0;
+static size_t                 __gDARecordReplayOffset  = 0;
+static CFMutableDictionaryRef __gDARecordReplayPortMap = NULL;
+static const UInt8 *          __gDARecordReplayReply   = NULL;
+static UInt32                 __gDARecordReplaySkipped = 0;
+static double                 __gDARecordReplaySpeed   = 0;
+static UInt32                 __gDARecordReplayTotal   = 0;
+
+static mach_msg_descriptor_t * __DARecordGetNextDescriptor( mach_msg_descriptor_t * descriptor )
+{
+    size_t size;
+
+    switch ( descriptor->type.type )
+    {
+        case MACH_MSG_PORT_DESCRIPTOR:
+        {
+            size = sizeof( mach_msg_port_descriptor_t );
+
+            break;
+        }
+        case MACH_MSG_OOL_DESCRIPTOR:
+        case MACH_MSG_OOL_VOLATILE_DESCRIPTOR:
+        {
+            size = sizeof( mach_msg_ool_descriptor_t );
+
+            break;
+        }
+        default:
+        {
+            size = sizeof( mach_msg_ool_ports_descriptor_t );
+
+            break;
+        }
+    }
+
+    return ( void * ) ( ( uintptr_t ) descriptor + size );
+}
+
+static mach_msg_size_t __DARecordGetMessageSize( DARecordKind kind, const mach_msg_header_t * message )
+{
+    mach_msg_size_t size;
+
+    size = message->msgh_size;
+
+    /*
+     * A request is followed by the trailer of the kernel, which carries the audit token.
+     */
+
+    if ( kind == kDARecordKindRequest )
+    {
+        const mach_msg_trailer_t * trailer;
+
+        size = round_msg( size );
+
+        trailer = ( void * ) ( ( uintptr_t ) message + size );
+
+        size += trailer->msgh_trailer_size;
+    }
+
+    return size;
+}
+
+static void __DARecordWriteNumber( UInt64 number )
+{
+    do
+    {
+        UInt8 byte;
+
+        byte = number & 0x7F;
+
+        number >>= 7;
+
+        fputc( number ? ( byte | 0x80 ) : byte, __gDARecordFile );
+    }
+    while ( number );
+}
+
+static void __DARecordWriteHeader( DARecordKind kind, size_t length )
+{
+    UInt64 time;
+
+    time = clock_gettime_nsec_np( CLOCK_UPTIME_RAW );
+
+    __DARecordWriteNumber( ( time - __gDARecordTime ) / 1000 );
+
+    fputc( kind, __gDARecordFile );
+
+    __DARecordWriteNumber( length );
+
+    __gDARecordTime = time;
+}
+
+static void __DARecordWrite( DARecordKind kind, const void * bytes, size_t length )
+{
+    __DARecordWriteHeader( kind, length );
+
+    fwrite( bytes, 1, length, __gDARecordFile );
+
+    fflush( __gDARecordFile );
+}
+
+static Boolean __DARecordReadNumber( UInt64 * number )
+{
+    UInt32 shift;
+
+    *number = 0;
+
+    for ( shift = 0; shift < 64; shift += 7 )
+    {
+        UInt8 byte;
+
+        if ( __gDARecordReplayOffset == __gDARecordReplayLength )
+        {
+            break;
+        }
+
+        byte = __gDARecordReplay[__gDARecordReplayOffset++];
+
+        *number |= ( ( UInt64 ) ( byte & 0x7F ) ) << shift;
+
+        if ( ( byte & 0x80 ) == 0 )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static Boolean __DARecordReadEntry( __DARecordEntry * entry )
+{
+    UInt64 length;
+
+    /*
+     * A record cut short, as by a crash of the server, ends the trace.
+     */
+
+    if ( __DARecordReadNumber( &entry->time ) == FALSE )
+    {
+        return FALSE;
+    }
+
+    if ( __gDARecordReplayOffset == __gDARecordReplayLength )
+    {
+        return FALSE;
+    }
+
+    entry->kind = __gDARecordReplay[__gDARecordReplayOffset++];
+
+    if ( __DARecordReadNumber( &length ) == FALSE )
+    {
+        return FALSE;
+    }
+
+    if ( length > __gDARecordReplayLength - __gDARecordReplayOffset )
+    {
+        return FALSE;
+    }
+
+    entry->bytes  = __gDARecordReplay + __gDARecordReplayOffset;
+    entry->length = length;
+
+    __gDARecordReplayOffset += length;
+
+    return TRUE;
+}
+
+static mach_port_t __DARecordReplayGetPort( mach_port_t port )
+{
+    const void * value;
+
+    if ( CFDictionaryGetValueIfPresent( __gDARecordReplayPortMap, ( void * ) ( uintptr_t ) port, &value ) )
+    {
+        port = ( mach_port_t ) ( uintptr_t ) value;
+    }
+
+    return port;
+}
+
+static void __DARecordReplayRequest( const __DARecordEntry * entry )
+{
+    mach_msg_header_t * message;
+    mach_msg_size_t     size;
+
+    if ( entry->length < sizeof( mach_msg_header_t ) )
+    {
+        return;
+    }
+
+    if ( ( ( const mach_msg_header_t * ) entry->bytes )->msgh_size < sizeof( mach_msg_header_t ) )
+    {
+        return;
+    }
+
+    if ( round_msg( ( ( const mach_msg_header_t * ) entry->bytes )->msgh_size ) + sizeof( mach_msg_trailer_t ) > entry->length )
+    {
+        return;
+    }
+
+    size = __DARecordGetMessageSize( kDARecordKindRequest, ( const void * ) entry->bytes );
+
+    if ( size > entry->length )
+    {
+        return;
+    }
+
+    message = malloc( size );
+
+    if ( message )
+    {
+        memcpy( message, entry->bytes, size );
+
+        /*
+         * Address the request to the session of the replay, and ask for no reply, whose port is
+         * long gone.
+         */
+
+        message->msgh_local_port   = __DARecordReplayGetPort( message->msgh_local_port );
+        message->msgh_remote_port  = MACH_PORT_NULL;
+        message->msgh_voucher_port = MACH_PORT_NULL;
+
+        if ( message->msgh_bits & MACH_MSGH_BITS_COMPLEX )
+        {
+            mach_msg_descriptor_t * descriptor;
+            uintptr_t               end;
+            mach_msg_size_t         index;
+            size_t                  offset;
+
+            if ( message->msgh_size < sizeof( mach_msg_base_t ) )
+            {
+                free( message );
+
+                return;
+            }
+
+            descriptor = ( void * ) ( ( mach_msg_base_t * ) message + 1 );
+
+            end = ( uintptr_t ) message + message->msgh_size;
+
+            offset = size;
+
+            for ( index = 0; index < ( ( mach_msg_base_t * ) message )->body.msgh_descriptor_count; index++ )
+            {
+                /*
+                 * Trust no count of the trace, and pass up a request whose descriptors do not lie
+                 * within its body.
+                 */
+
+                if ( ( uintptr_t ) descriptor + sizeof( mach_msg_port_descriptor_t ) > end ||
+                     ( uintptr_t ) __DARecordGetNextDescriptor( descriptor ) > end )
+                {
+                    free( message );
+
+                    return;
+                }
+
+                switch ( descriptor->type.type )
+                {
+                    case MACH_MSG_PORT_DESCRIPTOR:
+                    {
+                        descriptor->port.name = MACH_PORT_NULL;
+
+                        break;
+                    }
+                    case MACH_MSG_OOL_DESCRIPTOR:
+                    case MACH_MSG_OOL_VOLATILE_DESCRIPTOR:
+                    {
+                        vm_address_t address = 0;
+                        vm_size_t    length;
+
+                        length = MIN( descriptor->out_of_line.size, entry->length - offset );
+
+                        if ( length )
+                        {
+                            if ( vm_allocate( mach_task_self( ), &address, length, VM_FLAGS_ANYWHERE ) == KERN_SUCCESS )
+                            {
+                                memcpy( ( void * ) address, entry->bytes + offset, length );
+                            }
+                            else
+                            {
+                                address = 0;
+                                length  = 0;
+                            }
+                        }
+
+                        offset += MIN( descriptor->out_of_line.size, entry->length - offset );
+
+                        descriptor->out_of_line.address    = ( void * ) address;
+                        descriptor->out_of_line.size       = length;
+                        descriptor->out_of_line.deallocate = TRUE;
+
+                        break;
+                    }
+                    default:
+                    {
+                        descriptor->ool_ports.address = NULL;
+                        descriptor->ool_ports.count   = 0;
+
+                        break;
+                    }
+                }
+
+                descriptor = __DARecordGetNextDescriptor( descriptor );
+            }
+        }
+
+        _DAServerCallback( NULL, message, size, NULL );
+
+        free( message );
+    }
+}
+
+static void __DARecordReplayCallback( CFRunLoopTimerRef timer, void * info )
+{
+    __DARecordEntry entry;
+
+    DAWatchdogBegin( "replay" );
+
+    entry = __gDARecordReplayEntry;
+
+    __gDARecordReplayTotal++;
+
+    /*
+     * Read ahead, such that the reply recorded for a request is at hand as the request is served.
+     */
+
+    if ( __DARecordReadEntry( &__gDARecordReplayEntry ) == FALSE )
+    {
+        __gDARecordReplayEntry.kind = 0;
+    }
+
+    switch ( entry.kind )
+    {
+        case kDARecordKindVolumeMounted:
+        {
+            _DAVolumeMountedCallback( NULL, NULL, 0, NULL );
+
+            break;
+        }
+        case kDARecordKindVolumeUnmounted:
+        {
+            _DAVolumeUnmountedCallback( NULL, NULL, 0, NULL );
+
+            break;
+        }
+        case kDARecordKindVolumeUpdated:
+        {
+            _DAVolumeUpdatedCallback( NULL, NULL, 0, NULL );
+
+            break;
+        }
+        case kDARecordKindRequest:
+        {
+            if ( __gDARecordReplayEntry.kind == kDARecordKindReply )
+            {
+                if ( __gDARecordReplayEntry.length >= sizeof( mach_msg_base_t ) )
+                {
+                    if ( ( ( const mach_msg_header_t * ) __gDARecordReplayEntry.bytes )->msgh_size <= __gDARecordReplayEntry.length )
+                    {
+                        __gDARecordReplayReply = __gDARecordReplayEntry.bytes;
+                    }
+                }
+            }
+
+            __DARecordReplayRequest( &entry );
+
+            __gDARecordReplayReply = NULL;
+
+            break;
+        }
+        case kDARecordKindReply:
+        {
+            break;
+        }
+        default:
+        {
+            __gDARecordReplaySkipped++;
+
+            break;
+        }
+    }
+
+    if ( __gDARecordReplayEntry.kind )
+    {
+        CFAbsoluteTime clock;
+
+        clock = CFAbsoluteTimeGetCurrent( );
+
+        if ( __gDARecordReplaySpeed > 0 )
+        {
+            clock += __gDARecordReplayEntry.time / 1000000.0 / __gDARecordReplaySpeed;
+        }
+
+        CFRunLoopTimerSetNextFireDate( timer, clock );
+    }
+    else
+    {
+        DALog( "replay complete, %u records, %u passed over.", __gDARecordReplayTotal, __gDARecordReplaySkipped );
+
+        CFRunLoopTimerInvalidate( timer );
+
+        free( __gDARecordReplay );
+
+        __gDARecordReplay = NULL;
+    }
+
+    DAWatchdogEnd( );
+}
+
+void DARecordAppendMessage( DARecordKind kind, mach_msg_header_t * message )
+{
+    mach_msg_size_t size;
+
+    size = __DARecordGetMessageSize( kind, message );
+
+    /*
+     * Learn the session ports of the replay from the ports of the reply, against those of the
+     * reply recorded in the trace.
+     */
+
+    if ( __gDARecordReplayReply && kind == kDARecordKindReply )
+    {
+        const mach_msg_header_t * reply;
+
+        reply = ( const void * ) __gDARecordReplayReply;
+
+        if ( ( reply->msgh_bits & message->msgh_bits & MACH_MSGH_BITS_COMPLEX ) && reply->msgh_size == message->msgh_size )
+        {
+            mach_msg_descriptor_t * descriptor;
+            mach_msg_descriptor_t * descriptorRecorded;
+            mach_msg_size_t         index;
+
+            descriptor         = ( void * ) ( ( mach_msg_base_t * ) message + 1 );
+            descriptorRecorded = ( void * ) ( ( const mach_msg_base_t * ) reply + 1 );
+
+            for ( index = 0; index < ( ( mach_msg_base_t * ) message )->body.msgh_descriptor_count; index++ )
+            {
+                if ( descriptor->type.type != descriptorRecorded->type.type )
+                {
+                    break;
+                }
+
+                if ( descriptor->type.type == MACH_MSG_PORT_DESCRIPTOR )
+                {
+                    CFDictionarySetValue( __gDARecordReplayPortMap,
+                                          ( void * ) ( uintptr_t ) descriptorRecorded->port.name,
+                                          ( void * ) ( uintptr_t ) descriptor->port.name );
+                }
+
+                descriptor         = __DARecordGetNextDescriptor( descriptor );
+                descriptorRecorded = __DARecordGetNextDescriptor( descriptorRecorded );
+            }
+        }
+    }
+
+    if ( __gDARecordFile )
+    {
+        size_t length;
+
+        length = size;
+
+        /*
+         * Carry the out-of-line memory of a request with it, as the server releases that memory
+         * once it has served the request.
+         */
+
+        if ( kind == kDARecordKindRequest && ( message->msgh_bits & MACH_MSGH_BITS_COMPLEX ) )
+        {
+            mach_msg_descriptor_t * descriptor;
+            mach_msg_size_t         index;
+
+            descriptor = ( void * ) ( ( mach_msg_base_t * ) message + 1 );
+
+            for ( index = 0; index < ( ( mach_msg_base_t * ) message )->body.msgh_descriptor_count; index++ )
+            {
+                if ( descriptor->type.type == MACH_MSG_OOL_DESCRIPTOR || descriptor->type.type == MACH_MSG_OOL_VOLATILE_DESCRIPTOR )
+                {
+                    length += descriptor->out_of_line.size;
+                }
+
+                descriptor = __DARecordGetNextDescriptor( descriptor );
+            }
+
+            __DARecordWriteHeader( kind, length );
+
+            fwrite( message, 1, size, __gDARecordFile );
+
+            descriptor = ( void * ) ( ( mach_msg_base_t * ) message + 1 );
+
+            for ( index = 0; index < ( ( mach_msg_base_t * ) message )->body.msgh_descriptor_count; index++ )
+            {
+                if ( descriptor->type.type == MACH_MSG_OOL_DESCRIPTOR || descriptor->type.type == MACH_MSG_OOL_VOLATILE_DESCRIPTOR )
+                {
+                    fwrite( descriptor->out_of_line.address, 1, descriptor->out_of_line.size, __gDARecordFile );
+                }
+
+                descriptor = __DARecordGetNextDescriptor( descriptor );
+            }
+
+            fflush( __gDARecordFile );
+        }
+        else
+        {
+            __DARecordWrite( kind, message, size );
+        }
+    }
+}
+
+void DARecordAppendMountList( DARecordKind kind )
+{
+    if ( __gDARecordFile )
+    {
+        CFMutableDataRef data;
+
+        data = CFDataCreateMutable( kCFAllocatorDefault, 0 );
+
+        if ( data )
+        {
+            struct statfs * mountList;
+            int             mountListCount;
+            int             mountListIndex;
+
+            /*
+             * Keep only those fields of the mount table that the server consults.
+             */
+
+            mountListCount = DAPlatformGetMountList( &mountList );
+
+            for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
+            {
+                struct statfs * list;
+
+                list = mountList + mountListIndex;
+
+                CFDataAppendBytes( data, ( void * ) &list->f_fsid, sizeof( fsid_t ) );
+                CFDataAppendBytes( data, ( void * ) &list->f_flags, sizeof( uint32_t ) );
+                CFDataAppendBytes( data, ( void * ) list->f_fstypename, strlen( list->f_fstypename ) + 1 );
+                CFDataAppendBytes( data, ( void * ) list->f_mntfromname, strlen( list->f_mntfromname ) + 1 );
+                CFDataAppendBytes( data, ( void * ) list->f_mntonname, strlen( list->f_mntonname ) + 1 );
+            }
+
+            __DARecordWrite( kind, CFDataGetBytePtr( data ), CFDataGetLength( data ) );
+
+            CFRelease( data );
+        }
+    }
+}
+
+void DARecordClose( void )
+{
+    if ( __gDARecordFile )
+    {
+        fclose( __gDARecordFile );
+
+        __gDARecordFile = NULL;
+    }
+}
+
+Boolean DARecordOpen( const char * path )
+{
+    int file;
+
+    DARecordClose( );
+
+    /*
+     * The trace holds the requests of clients, and so is created anew, with access for its owner
+     * alone, and never through a symbolic link.
+     */
+
+    file = open( path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600 );
+
+    if ( file != -1 )
+    {
+        __gDARecordFile = fdopen( file, "w" );
+
+        if ( __gDARecordFile == NULL )
+        {
+            close( file );
+        }
+    }
+
+    if ( __gDARecordFile )
+    {
+        fwrite( __kDARecordMagic, 1, strlen( __kDARecordMagic ), __gDARecordFile );
+
+        fflush( __gDARecordFile );
+
+        __gDARecordTime = clock_gettime_nsec_np( CLOCK_UPTIME_RAW );
+    }
+
+    return __gDARecordFile ? TRUE : FALSE;
+}
+
+Boolean DARecordReplay( const char * path, double speed )
+{
+    FILE *  file;
+    Boolean status = FALSE;
+
+    if ( __gDARecordReplay )
+    {
+        return FALSE;
+    }
+
+    file = fopen( path, "r" );
+
+    if ( file )
+    {
+        long length;
+
+        fseek( file, 0, SEEK_END );
+
+        length = ftell( file );
+
+        fseek( file, 0, SEEK_SET );
+
+        if ( length > ( long ) strlen( __kDARecordMagic ) )
+        {
+            __gDARecordReplay = malloc( length );
+
+            if ( __gDARecordReplay )
+            {
+                if ( fread( __gDARecordReplay, 1, length, file ) == ( size_t ) length )
+                {
+                    if ( memcmp( __gDARecordReplay, __kDARecordMagic, strlen( __kDARecordMagic ) ) == 0 )
+                    {
+                        __gDARecordReplayLength = length;
+                        __gDARecordReplayOffset = strlen( __kDARecordMagic );
+
+                        status = __DARecordReadEntry( &__gDARecordReplayEntry );
+                    }
+                }
+            }
+        }
+
+        fclose( file );
+    }
+
+    if ( status )
+    {
+        if ( __gDARecordReplayPortMap == NULL )
+        {
+            __gDARecordReplayPortMap = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, NULL );
+        }
+
+        status = FALSE;
+
+        if ( __gDARecordReplayPortMap )
+        {
+            CFRunLoopTimerRef timer;
+
+            __gDARecordReplaySkipped = 0;
+            __gDARecordReplaySpeed   = speed;
+            __gDARecordReplayTotal   = 0;
+
+            timer = CFRunLoopTimerCreate( kCFAllocatorDefault, CFAbsoluteTimeGetCurrent( ), 1.0, 0, 0, __DARecordReplayCallback, NULL );
+
+            if ( timer )
+            {
+                CFRunLoopAddTimer( CFRunLoopGetCurrent( ), timer, kCFRunLoopDefaultMode );
+
+                CFRelease( timer );
+
+                DALog( "replaying %s, whose requests act on the media of this host.", path );
+
+                status = TRUE;
+            }
+        }
+    }
+
+    if ( status == FALSE )
+    {
+        if ( __gDARecordReplay )
+        {
+            free( __gDARecordReplay );
+
+            __gDARecordReplay = NULL;
+        }
+    }
+
+    return status;
+}
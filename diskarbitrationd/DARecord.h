@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef __DISKARBITRATIOND_DARECORD__
+#define __DISKARBITRATIOND_DARECORD__
+
+#include <mach/mach.h>
+#include <CoreFoundation/CoreFoundation.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+enum
+{
+    kDARecordKindVolumeMounted   = 4,
+    kDARecordKindVolumeUnmounted = 5,
+    kDARecordKindVolumeUpdated   = 6,
+    kDARecordKindRequest         = 7,
+    kDARecordKindReply           = 8
+};
+
+typedef UInt8 DARecordKind;
+
+extern void    DARecordAppendMessage( DARecordKind kind, mach_msg_header_t * message );
+extern void    DARecordAppendMountList( DARecordKind kind );
+extern void    DARecordClose( void );
+extern Boolean DARecordOpen( const char * path );
+extern Boolean DARecordReplay( const char * path, double speed );
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__DISKARBITRATIOND_DARECORD__ */
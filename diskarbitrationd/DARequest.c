@@ -21,6 +21,8 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
+#define DA_LOG_SUBSYSTEM kDADebugLogSubsystemRequest
+
 #include "DARequest.h"
 
 #include "DABase.h"
@@ -31,14 +33,15 @@
 #include "DALog.h"
 #include "DAMain.h"
 #include "DAMount.h"
+#include "DAPlatform.h"
 #include "DAPrivate.h"
 #include "DAQueue.h"
+#include "DASnapshot.h"
 #include "DAStage.h"
 #include "DASupport.h"
 #include "DAThread.h"
 
 #include <fcntl.h>
-#include <libproc.h>
 #include <unistd.h>
 #include <sys/disk.h>
 #include <DiskArbitration/DiskArbitration.h>
@@ -1289,9 +1292,9 @@ static void __DARequestUnmountCallback( int status, void * context )
         int mountListIndex;
 
         /*
-         * getmntinfo returns 0 in case of failure. In that case, the following loop will not be executed.
+         * DAPlatformGetMountList returns 0 in case of failure. In that case, the following loop will not be executed.
          */
-        mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+        mountListCount = DAPlatformGetMountList( &mountList );
 
         for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
         {
@@ -1305,7 +1308,7 @@ static void __DARequestUnmountCallback( int status, void * context )
          * It is possible for the disk to be already unmounted by the filesystem
          * due to unmounting system or data volume.
          * If the mountpoint for the disk does not exist, ignore the error.
-         * In the case of getmntinfo returning 0 as mountListCount, then also the error is ignored.
+         * In the case of DAPlatformGetMountList returning 0 as mountListCount, then also the error is ignored.
          */
         if ( mountListIndex == mountListCount )
         {
@@ -1375,6 +1378,8 @@ handleumount:
 
             DADiskSetState( disk, kDADiskStateZombie, TRUE );
 
+            DASnapshotRemoveDisk( disk );
+
             ___CFArrayRemoveValue( gDADiskList, disk );
         }
 
@@ -1434,9 +1439,9 @@ static int  __DARequestUnmountGetProcessID( void * context )
 
     if ( path )
     {
-        pid_t dissenterPID = 0;
+        pid_t dissenterPID;
 
-        proc_listpidspath( PROC_ALL_PIDS, 0, path, PROC_LISTPIDSPATH_EXCLUDE_EVTONLY | PROC_LISTPIDSPATH_PATH_IS_VOLUME, &dissenterPID, sizeof( dissenterPID ) );
+        dissenterPID = DAPlatformGetVolumeProcessID( path );
 
         if ( dissenterPID )
         {
@@ -1502,6 +1507,7 @@ DARequestRef DARequestCreate( CFAllocatorRef allocator,
                               gid_t          userGID,
                               DACallbackRef  callback )
 {
+    CFDateRef              date;
     CFMutableDictionaryRef request;
 
     request = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
@@ -1519,6 +1525,15 @@ DARequestRef DARequestCreate( CFAllocatorRef allocator,
         ___CFDictionarySetIntegerValue( request, _kDARequestUserUIDKey, userUID );
 
         if ( callback )  CFDictionarySetValue( request, _kDARequestCallbackKey,  callback );
+
+        date = CFDateCreate( kCFAllocatorDefault, CFAbsoluteTimeGetCurrent( ) );
+
+        if ( date )
+        {
+            CFDictionarySetValue( request, _kDARequestTimeKey, date );
+
+            CFRelease( date );
+        }
     }
 
     return ( void * ) request;
@@ -1658,6 +1673,21 @@ Boolean DARequestGetState( DARequestRef request, DARequestState state )
     return ( ___CFDictionaryGetIntegerValue( ( void * ) request, _kDARequestStateKey ) & state ) ? TRUE : FALSE;
 }
 
+CFAbsoluteTime DARequestGetTime( DARequestRef request )
+{
+    CFDateRef      date;
+    CFAbsoluteTime time = 0;
+
+    date = CFDictionaryGetValue( ( void * ) request, _kDARequestTimeKey );
+
+    if ( date )
+    {
+        time = CFDateGetAbsoluteTime( date );
+    }
+
+    return time;
+}
+
 gid_t DARequestGetUserGID( DARequestRef request )
 {
     return ___CFDictionaryGetIntegerValue( ( void * ) request, _kDARequestUserGIDKey );
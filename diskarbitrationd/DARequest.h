@@ -71,6 +71,7 @@ extern DADissenterRef DARequestGetDissenter( DARequestRef request );
 extern _DARequestKind DARequestGetKind( DARequestRef request );
 extern CFArrayRef     DARequestGetLink( DARequestRef request );
 extern Boolean        DARequestGetState( DARequestRef request, DARequestState state );
+extern CFAbsoluteTime DARequestGetTime( DARequestRef request );
 extern gid_t          DARequestGetUserGID( DARequestRef request );
 extern uid_t          DARequestGetUserUID( DARequestRef request );
 extern void           DARequestSetCallback( DARequestRef request, DACallbackRef callback );
@@ -21,6 +21,8 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
+#define DA_LOG_SUBSYSTEM kDADebugLogSubsystemServer
+
 #include "DAServer.h"
 #include "DAServerServer.h"
 #include "DABase.h"
@@ -31,12 +33,18 @@
 #include "DAInternal.h"
 #include "DALog.h"
 #include "DAMain.h"
+#include "DAMetrics.h"
 #include "DAMount.h"
 #include "DAPrivate.h"
+#include "DAPlatform.h"
 #include "DAQueue.h"
+#include "DARecord.h"
 #include "DASession.h"
+#include "DASnapshot.h"
 #include "DAStage.h"
 #include "DASupport.h"
+#include "DATrace.h"
+#include "DAWatchdog.h"
 
 #include <paths.h>
 #include <bsm/libbsm.h>
@@ -87,6 +95,48 @@ static CFMachPortRef       __gDAServer      = NULL;
 static mach_port_t         __gDAServerPort  = MACH_PORT_NULL;
 static mach_msg_header_t * __gDAServerReply = NULL;
 
+static CFMutableDictionaryRef __gDASessionListIndex = NULL;
+
+/*
+ * The routine names, in the order of their declaration in DAServer.defs, which is the order of
+ * their message IDs.
+ */
+
+static const char * __kDAServerRoutineNameList[] =
+{
+    "DiskCopyDescription",
+    "DiskGetOptions",
+    "DiskGetUserUID",
+    "DiskIsClaimed",
+    "DiskSetAdoption",
+    "DiskSetEncoding",
+    "DiskSetOptions",
+    "DiskUnclaim",
+    "SessionCopyCallbackQueue",
+    "SessionCreate",
+    "SessionQueueRequest",
+    "SessionQueueResponse",
+    "SessionRegisterCallback",
+    "SessionRelease",
+    "SessionSetAuthorization",
+    "SessionSetClientPort",
+    "SessionUnregisterCallback",
+    "mkdir",
+    "rmdir",
+    "SessionSetCallbackBatching",
+    "SessionCopySnapshot",
+    "SessionCopyEventRing",
+    "SessionCopyDiskDescriptions",
+    "SessionQueueDiskDescriptions",
+    "SessionQueueRequests",
+    "SessionRegisterCallbacks",
+    "SessionUnregisterCallbacks",
+    "SessionSetDebugLogSubsystems",
+    "SessionCopyTrace",
+    "SessionCopyMetrics",
+    "SessionReleaseEventRing"
+};
+
 static void __DAMediaBusyStateChangedCallback( void * context, io_service_t service, void * argument );
 static void __DAMediaPropertyChangedCallback( void * context, io_service_t service, void * argument );
 
@@ -159,6 +209,8 @@ static void __DAMediaBusyStateChangedCallback( void * context, io_service_t serv
 
 static void __DAMediaChangedCallback( void * context, io_service_t service, natural_t message, void * argument )
 {
+    DAWatchdogBegin( "iokit port" );
+
     switch ( message )
     {
         case kIOMessageServiceBusyStateChange:
@@ -174,6 +226,8 @@ static void __DAMediaChangedCallback( void * context, io_service_t service, natu
             break;
         }
     }
+
+    DAWatchdogEnd( );
 }
 
 static void __DAMediaPropertyChangedCallback( void * context, io_service_t service, void * argument )
@@ -188,6 +242,8 @@ static void __DAMediaPropertyChangedCallback( void * context, io_service_t servi
     {
         CFMutableArrayRef keys;
 
+        DADiskResetMatch( disk );
+
         keys = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
         if ( keys )
@@ -211,7 +267,7 @@ static void __DAMediaPropertyChangedCallback( void * context, io_service_t servi
                     int             mountListCount;
                     int             mountListIndex;
                     
-                    mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+                    mountListCount = DAPlatformGetMountList( &mountList );
 
                     for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
                     {
@@ -393,11 +449,7 @@ static void __DAMediaPropertyChangedCallback( void * context, io_service_t servi
                     }
                 }
 
-                object = IORegistryEntrySearchCFProperty( service,
-                                                          kIOServicePlane,
-                                                          CFSTR( "AppleTDMLocked" ),
-                                                          kCFAllocatorDefault,
-                                                          kIORegistryIterateParents | kIORegistryIterateRecursively );
+                object = DAPlatformMediaCopyProperty( service, CFSTR( "AppleTDMLocked" ), kIORegistryIterateParents | kIORegistryIterateRecursively );
 
                 if ( DADiskCompareDescription( disk, kDADiskDescriptionDeviceTDMLockedKey, object ) )
                 {
@@ -430,28 +482,329 @@ static void __DAMediaPropertyChangedCallback( void * context, io_service_t servi
     }
 }
 
+static const char * __DAServerGetRoutineName( mach_msg_id_t id )
+{
+    id -= DAServer_subsystem.start;
+
+    if ( id >= 0 && id < ( mach_msg_id_t ) ( sizeof( __kDAServerRoutineNameList ) / sizeof( __kDAServerRoutineNameList[0] ) ) )
+    {
+        return __kDAServerRoutineNameList[id];
+    }
+
+    return "unknown";
+}
+
+static DACallbackRef __DASessionCreateCallback( DASessionRef           session,
+                                                mach_vm_offset_t       _address,
+                                                mach_vm_offset_t       _context,
+                                                uint32_t               _kind,
+                                                int32_t                _order,
+                                                vm_address_t           _match,
+                                                mach_msg_type_number_t _matchSize,
+                                                vm_address_t           _watch,
+                                                mach_msg_type_number_t _watchSize )
+{
+    DACallbackRef   callback = NULL;
+    CFDictionaryRef match    = NULL;
+    CFArrayRef      watch    = NULL;
+
+    if ( _kDADiskLastKind < _kind )
+    {
+        return NULL;
+    }
+
+    if ( _match )
+    {
+        match = _DAUnserializeDiskDescriptionWithBytes( kCFAllocatorDefault, _match, _matchSize );
+    }
+
+    if ( _watch )
+    {
+        watch = _DAUnserializeWithBytes( kCFAllocatorDefault, _watch, _watchSize );
+    }
+
+    callback = DACallbackCreate( kCFAllocatorDefault, session, _address, _context, _kind, _order, match, watch );
+
+    if ( match )
+    {
+        CFRelease( match );
+    }
+
+    if ( watch )
+    {
+        CFRelease( watch );
+    }
+
+    return callback;
+}
+
 static DASessionRef __DASessionListGetSession( mach_port_t sessionID )
 {
-    CFIndex count;
-    CFIndex index;
+    /*
+     * Sessions are indexed by the name of their server port, so that the cost of the lookup at the
+     * top of each server routine does not grow with the number of sessions.
+     */
 
-    count = CFArrayGetCount( gDASessionList );
+    if ( __gDASessionListIndex )
+    {
+        return ( void * ) CFDictionaryGetValue( __gDASessionListIndex, ( void * ) ( uintptr_t ) sessionID );
+    }
 
-    for ( index = 0; index < count; index++ )
+    return NULL;
+}
+
+static DAReturn __DASessionQueueRequest( DASessionRef     session,
+                                         _DARequestKind   _kind,
+                                         const char *     _argument0,
+                                         int32_t          _argument1,
+                                         CFTypeRef        argument2,
+                                         CFTypeRef        argument3,
+                                         mach_vm_offset_t _address,
+                                         mach_vm_offset_t _context,
+                                         audit_token_t    _token )
+{
+    DADiskRef disk;
+    DAReturn  status;
+
+    status = kDAReturnBadArgument;
+
+    disk = __DADiskListGetDisk( _argument0 );
+
+    if ( disk )
     {
-        DASessionRef session;
+        DACallbackRef callback;
+        DARequestRef  request;
+
+        callback = DACallbackCreate( kCFAllocatorDefault, session, _address, _context, _kind, 0, NULL, NULL );
+        
+        request = DARequestCreate( kCFAllocatorDefault, _kind, disk, _argument1, argument2, argument3, audit_token_to_euid( _token ), audit_token_to_egid( _token ), callback );
+
+        if ( request )
+        {
+            switch ( _kind )
+            {
+                case _kDADiskEject:
+                {
+                    status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightUnmount );
+
+                    break;
+                }
+                case _kDADiskMount:
+                {
+                    status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightMount );
+
+                    if ( status == 0 )
+                    {
+                        CFStringRef content;
+
+                        content = DADiskGetDescription( disk, kDADiskDescriptionMediaContentKey );
+
+                        if ( CFEqual( content, CFSTR( "C12A7328-F81F-11D2-BA4B-00A0C93EC93B" ) ) )
+                        {
+                            if ( audit_token_to_euid( _token ) )
+                            {
+                                if ( audit_token_to_euid( _token ) != DADiskGetUserUID( disk ) )
+                                {
+                                    status = kDAReturnNotPermitted;
+                                }
+                            }
+                        }
+                    }
+
+                    if ( status == 0 )
+                    {
+                        CFTypeRef mountpoint;
+
+                        mountpoint = argument2;
+
+                        if ( mountpoint )
+                        {
+                            mountpoint = CFURLCreateWithString( kCFAllocatorDefault, mountpoint, NULL );
+                        }
+
+                        if ( mountpoint )
+                        {
+                            char * path;
+
+                            path = ___CFURLCopyFileSystemRepresentation( mountpoint );
+
+                            if ( path )
+                            {
+                                status = sandbox_check_by_audit_token(_token, "file-mount", SANDBOX_FILTER_PATH | SANDBOX_CHECK_ALLOW_APPROVAL, path);
+
+                                if ( status )
+                                {
+                                    status = kDAReturnNotPrivileged;
+                                }
+
+                                free( path );
+                            }
+
+                            if ( audit_token_to_euid( _token ) )
+                            {
+                                if ( audit_token_to_euid( _token ) != DADiskGetUserUID( disk ) )
+                                {
+                                    status = kDAReturnNotPrivileged;
+                                }
+                            }
+
+                            CFRelease( mountpoint );
+                        }
+                    }
+
+                    break;
+                }
+                case _kDADiskRename:
+                {
+                    status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightRename );
+
+                    break;
+                }
+                case _kDADiskUnmount:
+                {
+                    status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightUnmount );
+
+                    break;
+                }
+                default:
+                {
+                    status = kDAReturnSuccess;
+
+                    break;
+                }
+            }
+
+            if ( status == kDAReturnSuccess )
+            {
+                DAQueueRequest( request );
+
+                DALogDebug( "  queued solicitation, id = %016llX:%016llX, kind = %s, disk = %@, options = 0x%08X.",
+                            _address,
+                            _context,
+                            _DARequestKindGetName( _kind ),
+                            disk,
+                            _argument1 );
+            }
 
-        session = ( void * ) CFArrayGetValueAtIndex( gDASessionList, index );
+            CFRelease( request );
+        }
 
-        if ( DASessionGetID( session ) == sessionID )
+        if ( callback )
         {
-            return session;
+            CFRelease( callback );
         }
     }
 
-    return NULL;
+    return status;
 }
 
+static void __DASessionRegisterCallback( DASessionRef session, DACallbackRef callback )
+{
+    DASessionRegisterCallback( session, callback );
+
+    DAQueueRegisterCallback( callback );
+
+    DALogDebug( "  registered callback, id = %016llX:%016llX, kind = %s.", DACallbackGetAddress( callback ), DACallbackGetContext( callback ), _DACallbackKindGetName( DACallbackGetKind( callback ) ) );
+
+    if ( DACallbackGetKind( callback ) == _kDADiskAppearedCallback )
+    {
+        CFArrayRef callbacks;
+        Boolean    snapshot = FALSE;
+        CFIndex    count;
+        CFIndex    index;
+
+        /*
+         * A session that registered a disk list snapshot callback beforehand receives the existing
+         * disks as one snapshot record, rather than as one appeared callback per disk.
+         */
+
+        callbacks = DASessionGetCallbackRegister( session );
+
+        count = callbacks ? CFArrayGetCount( callbacks ) : 0;
+
+        for ( index = 0; index < count; index++ )
+        {
+            DACallbackRef item;
+
+            item = ( void * ) CFArrayGetValueAtIndex( callbacks, index );
+
+            if ( DACallbackGetKind( item ) == _kDADiskListSnapshotCallback )
+            {
+                DADiskListSnapshotCallback( item, callback );
+
+                snapshot = TRUE;
+            }
+        }
+
+        if ( snapshot == FALSE )
+        {
+            count = CFArrayGetCount( gDADiskList );
+
+            for ( index = 0; index < count; index++ )
+            {
+                DADiskRef disk;
+
+                disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+
+                if ( DADiskGetState( disk, kDADiskStateStagedAppear ) )
+                {
+                    DAQueueCallback( callback, disk, NULL );
+                }
+            }
+        }
+
+        DAQueueCallbacks( session, _kDADiskListCompleteCallback, NULL, NULL );
+
+        if ( gDAIdle )
+        {
+            DAQueueCallbacks( session, _kDAIdleCallback, NULL, NULL );
+
+            DASessionSetState( session, kDASessionStateIdle, TRUE );
+        }
+    }
+    else if ( DACallbackGetKind( callback ) == _kDAIdleCallback )
+    {
+        if ( gDAIdle )
+        {
+            DAQueueCallback( callback, NULL, NULL );
+
+            DASessionSetState( session, kDASessionStateIdle, TRUE );
+        }
+        else
+        {
+            DASessionSetState( session, kDASessionStateIdle, FALSE );
+        }
+    }
+///w:start
+    else if ( DACallbackGetKind( callback ) == _kDADiskEjectApprovalCallback )
+    {
+        if ( strcmp( _DASessionGetName( session ), "SystemUIServer" ) == 0 )
+        {
+            CFStringRef key;
+
+            key = SCDynamicStoreKeyCreateConsoleUser( kCFAllocatorDefault );
+
+            if ( key )
+            {
+                CFMutableArrayRef keys;
+
+                keys = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                if ( keys )
+                {
+                    CFArrayAppendValue( keys, key );
+
+                    _DAConfigurationCallback( NULL, keys, NULL );
+
+                    CFRelease( keys );
+                }
+
+                CFRelease( key );
+            }
+        }
+    }
+///w:stop
+}
 
 void _DAConfigurationCallback( SCDynamicStoreRef session, CFArrayRef keys, void * info )
 {
@@ -468,6 +821,8 @@ void _DAConfigurationCallback( SCDynamicStoreRef session, CFArrayRef keys, void
     uid_t       userUID;
     CFArrayRef  userList;
 
+    DAWatchdogBegin( "configuration" );
+
     DALogDebugHeader( "configd [0] -> %s", gDAProcessNameID );
 
     previousUser     = gDAConsoleUser;
@@ -523,6 +878,8 @@ void _DAConfigurationCallback( SCDynamicStoreRef session, CFArrayRef keys, void
                     CFRelease( user );
                     CFRelease( userList );
 
+                    DAWatchdogEnd( );
+
                     return; /* wait */
                 }
             }
@@ -836,6 +1193,8 @@ void _DAConfigurationCallback( SCDynamicStoreRef session, CFArrayRef keys, void
     }
 
     DAStageSignal( );
+
+    DAWatchdogEnd( );
 }
 
 void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
@@ -846,6 +1205,8 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
 
     io_service_t media;
 
+    DAWatchdogBegin( "iokit port" );
+
     /*
      * Iterate through the media objects.
      */
@@ -900,6 +1261,8 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
 
             if ( disk )
             {
+                DATraceBegin( disk, "appear", NULL );
+
                 /*
                  * Determine whether a media object disappearance and appearance occurred.  We must do this
                  * since the I/O Kit appearance queue is separate from the I/O Kit disappearance queue, and
@@ -1067,6 +1430,8 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
 
                 CFArrayInsertValueAtIndex( gDADiskList, 0, disk );
 
+                DASnapshotAddDisk( disk );
+
                 CFRelease( disk );
             }
 
@@ -1085,6 +1450,8 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
     }
 
     DAStageSignal( );
+
+    DAWatchdogEnd( );
 }
 
 void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
@@ -1097,6 +1464,8 @@ void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
     SInt32 prevDeviceUnit = -1;
     CFMutableArrayRef diskInfoArray = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
+    DAWatchdogBegin( "iokit port" );
+
     /*
      * Iterate through the media objects.
      */
@@ -1252,6 +1621,8 @@ void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
 
             DADiskSetState( disk, kDADiskStateZombie, TRUE );
 
+            DASnapshotRemoveDisk( disk );
+
             ___CFArrayRemoveValue( gDADiskList, disk );
         }
 
@@ -1269,11 +1640,33 @@ void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
 
     CFRelease( diskInfoArray );
     DAStageSignal( );
+
+    DAWatchdogEnd( );
 }
 
 void _DAServerCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
 {
     mach_msg_header_t * message = parameter;
+    CFAbsoluteTime      clock;
+    const char *        name;
+    Boolean             record;
+
+    DAWatchdogBegin( "server port" );
+
+    name = __DAServerGetRoutineName( message->msgh_id );
+
+    /*
+     * The authorization of a session is a credential of its client, and is kept out of the record.
+     */
+
+    record = strcmp( name, "SessionSetAuthorization" ) ? TRUE : FALSE;
+
+    if ( record )
+    {
+        DARecordAppendMessage( kDARecordKindRequest, message );
+    }
+
+    clock = CFAbsoluteTimeGetCurrent( );
 
     if ( message->msgh_id == MACH_NOTIFY_NO_SENDERS )
     {
@@ -1287,6 +1680,13 @@ void _DAServerCallback( CFMachPortRef port, void * parameter, CFIndex messageSiz
                  ? KERN_SUCCESS
                  : ( ( mig_reply_error_t * ) __gDAServerReply )->RetCode;
 
+        DAMetricsRecordInterval( "routine", name, CFAbsoluteTimeGetCurrent( ) - clock );
+
+        if ( status != KERN_SUCCESS && status != MIG_NO_REPLY )
+        {
+            DAMetricsCount( "routine failure", name );
+        }
+
         /*
          * Any resources present in the request message are the responsibility of the service
          * function, if it is successful in responding to the request.  Success is defined in
@@ -1303,6 +1703,11 @@ void _DAServerCallback( CFMachPortRef port, void * parameter, CFIndex messageSiz
 
         if ( status != MIG_NO_REPLY )
         {
+            if ( record )
+            {
+                DARecordAppendMessage( kDARecordKindReply, __gDAServerReply );
+            }
+
             if ( status != KERN_SUCCESS )
             {
                 message->msgh_remote_port = MACH_PORT_NULL;
@@ -1321,6 +1726,8 @@ void _DAServerCallback( CFMachPortRef port, void * parameter, CFIndex messageSiz
             }
         }
     }
+
+    DAWatchdogEnd( );
 }
 
 kern_return_t _DAServermkdir( mach_port_t _session, ___path_t _path, audit_token_t _token )
@@ -1902,7 +2309,7 @@ kern_return_t _DAServerSessionCopyCallbackQueue( mach_port_t _session, vm_addres
                     CFRelease( queue );
                 }
 
-                CFArrayRemoveAllValues( callbacks );
+                DASessionClearCallbackQueue( session );
             }
 
             DASessionSetState( session, kDASessionStateTimeout, FALSE );
@@ -1917,74 +2324,115 @@ kern_return_t _DAServerSessionCopyCallbackQueue( mach_port_t _session, vm_addres
     return status;
 }
 
-kern_return_t _DAServerSessionCreate( mach_port_t   _session,
-                                      caddr_t       _name,
-                                      audit_token_t _token,
-                                      mach_port_t * _server )
+kern_return_t _DAServerSessionCopyDiskDescriptions( mach_port_t              _session,
+                                                   vm_address_t             _match,
+                                                   mach_msg_type_number_t   _matchSize,
+                                                   vm_address_t *           _descriptions,
+                                                   mach_msg_type_number_t * _descriptionsSize )
 {
     kern_return_t status;
 
     status = kDAReturnBadArgument;
 
-    DALogDebugHeader( "%s [%d] -> %s", _name, audit_token_to_pid( _token ), gDAProcessNameID );
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
 
     if ( _session )
     {
         DASessionRef session;
 
-        /*
-         * Create the session.
-         */
-
-        session = DASessionCreate( kCFAllocatorDefault, _name, audit_token_to_pid( _token ) );
+        session = __DASessionListGetSession( _session );
 
         if ( session )
         {
-            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+            CFMutableArrayRef descriptions;
+            CFDictionaryRef   match = NULL;
 
-            DALogDebug( "  created session, id = %@.", session );
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            *_server = DASessionGetServerPort( session );
+            if ( _match )
+            {
+                match = _DAUnserializeDiskDescriptionWithBytes( kCFAllocatorDefault, _match, _matchSize );
 
-            /*
-             * Add the session object to our tables.
-             */
+                if ( match == NULL )
+                {
+                    goto exit;
+                }
+            }
 
-            ___os_transaction_begin( );
+            status = kDAReturnNoResources;
 
-            CFArrayAppendValue( gDASessionList, session );
+            descriptions = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
-            /*
-             * Add the session to our run loop.
-             */
+            if ( descriptions )
+            {
+                CFIndex   count;
+                CFIndex   index;
+                CFDataRef data;
 
-            DASessionScheduleWithRunLoop( session, CFRunLoopGetCurrent( ), kCFRunLoopDefaultMode ); 
+                /*
+                 * Gather the same disks that an appeared callback registered now would be told of.
+                 */
 
-            CFRelease( session );
+                count = CFArrayGetCount( gDADiskList );
 
-            status = kDAReturnSuccess;
+                for ( index = 0; index < count; index++ )
+                {
+                    DADiskRef disk;
+
+                    disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+
+                    if ( DADiskGetState( disk, kDADiskStateStagedAppear ) )
+                    {
+                        if ( match == NULL || DADiskMatch( disk, match ) )
+                        {
+                            CFDataRef serialization;
+
+                            serialization = DADiskGetSerialization( disk );
+
+                            if ( serialization )
+                            {
+                                CFArrayAppendValue( descriptions, serialization );
+                            }
+                        }
+                    }
+                }
+
+                data = _DASerialize( kCFAllocatorDefault, descriptions );
+
+                if ( data )
+                {
+                    *_descriptions = ___CFDataCopyBytes( data, _descriptionsSize );
+
+                    if ( *_descriptions )
+                    {
+                        DALogDebug( "  copied disk descriptions, count = %ld.", CFArrayGetCount( descriptions ) );
+
+                        status = kDAReturnSuccess;
+                    }
+
+                    CFRelease( data );
+                }
+
+                CFRelease( descriptions );
+            }
+
+            if ( match )
+            {
+                CFRelease( match );
+            }
         }
     }
 
+exit:
     if ( status )
     {
-        DALogDebug( "unable to create session, id = %s [%d].", _name, audit_token_to_pid( _token ) );
+        DALogDebug( "unable to copy disk descriptions (status code 0x%08X).", status );
     }
 
     return status;
 }
 
-kern_return_t _DAServerSessionQueueRequest( mach_port_t            _session,
-                                            uint32_t                _kind,
-                                            caddr_t                _argument0,
-                                            int32_t                _argument1,
-                                            vm_address_t           _argument2,
-                                            mach_msg_type_number_t _argument2Size,
-                                            vm_address_t           _argument3,
-                                            mach_msg_type_number_t _argument3Size,
-                                            mach_vm_offset_t       _address,
-                                            mach_vm_offset_t       _context,
-                                            audit_token_t          _token )
+kern_return_t _DAServerSessionCopyEventRing( mach_port_t _session, mach_port_t * _ring )
 {
     kern_return_t status;
 
@@ -2000,171 +2448,603 @@ kern_return_t _DAServerSessionQueueRequest( mach_port_t            _session,
 
         if ( session )
         {
-            DADiskRef disk;
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            *_ring = DASessionGetEventRing( session );
+
+            if ( *_ring )
+            {
+                DALogDebug( "  copied event ring." );
+
+                status = kDAReturnSuccess;
+            }
+            else
+            {
+                status = kDAReturnNoResources;
+            }
+        }
+    }
 
+    if ( status )
+    {
+        DALogDebug( "unable to copy event ring (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCopyMetrics( mach_port_t              _session,
+                                           vm_address_t *           _metrics,
+                                           mach_msg_type_number_t * _metricsSize,
+                                           audit_token_t            _token )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _argument0 );
+            status = kDAReturnNotPrivileged;
 
-            if ( disk )
+            if ( audit_token_to_euid( _token ) == 0 )
             {
-                CFTypeRef     argument2 = NULL;
-                CFTypeRef     argument3 = NULL;
-                DACallbackRef callback;
-                DARequestRef  request;
+                CFDictionaryRef metrics;
 
-                DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+                status = kDAReturnNoResources;
 
-                if ( _argument2 )
+                metrics = DAMetricsCopy( );
+
+                if ( metrics )
                 {
-                    argument2 = _DAUnserializeWithBytes( kCFAllocatorDefault, _argument2, _argument2Size );
+                    CFDataRef data;
+
+                    data = _DASerialize( kCFAllocatorDefault, metrics );
+
+                    if ( data )
+                    {
+                        *_metrics = ___CFDataCopyBytes( data, _metricsSize );
+
+                        if ( *_metrics )
+                        {
+                            DALogDebug( "  copied metrics, count = %ld.", CFDictionaryGetCount( metrics ) );
+
+                            status = kDAReturnSuccess;
+                        }
+
+                        CFRelease( data );
+                    }
+
+                    CFRelease( metrics );
                 }
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to copy metrics (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCopySnapshot( mach_port_t _session, mach_port_t * _snapshot )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            *_snapshot = DASnapshotGetPort( );
+
+            if ( *_snapshot )
+            {
+                DALogDebug( "  copied snapshot table." );
+
+                status = kDAReturnSuccess;
+            }
+            else
+            {
+                status = kDAReturnNoResources;
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to copy snapshot table (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCopyTrace( mach_port_t              _session,
+                                         vm_address_t *           _trace,
+                                         mach_msg_type_number_t * _traceSize,
+                                         audit_token_t            _token )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            status = kDAReturnNotPrivileged;
+
+            if ( audit_token_to_euid( _token ) == 0 )
+            {
+                CFDataRef trace;
+
+                status = kDAReturnNoResources;
 
-                if ( _argument3 )
+                trace = DATraceCopyTimeline( );
+
+                if ( trace )
                 {
-                    argument3 = _DAUnserializeWithBytes( kCFAllocatorDefault, _argument3, _argument3Size );
+                    *_trace = ___CFDataCopyBytes( trace, _traceSize );
+
+                    if ( *_trace )
+                    {
+                        DALogDebug( "  copied trace, size = %u.", *_traceSize );
+
+                        status = kDAReturnSuccess;
+                    }
+
+                    CFRelease( trace );
                 }
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to copy trace (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCreate( mach_port_t   _session,
+                                      caddr_t       _name,
+                                      audit_token_t _token,
+                                      mach_port_t * _server )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "%s [%d] -> %s", _name, audit_token_to_pid( _token ), gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        /*
+         * Create the session.
+         */
+
+        session = DASessionCreate( kCFAllocatorDefault, _name, audit_token_to_pid( _token ) );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            DALogDebug( "  created session, id = %@.", session );
+
+            *_server = DASessionGetServerPort( session );
+
+            /*
+             * Add the session object to our tables.
+             */
+
+            ___os_transaction_begin( );
+
+            CFArrayAppendValue( gDASessionList, session );
+
+            if ( __gDASessionListIndex == NULL )
+            {
+                __gDASessionListIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, NULL );
+
+                assert( __gDASessionListIndex );
+            }
+
+            CFDictionarySetValue( __gDASessionListIndex, ( void * ) ( uintptr_t ) DASessionGetID( session ), session );
+
+            /*
+             * Add the session to our run loop.
+             */
+
+            DASessionScheduleWithRunLoop( session, CFRunLoopGetCurrent( ), kCFRunLoopDefaultMode ); 
+
+            CFRelease( session );
+
+            status = kDAReturnSuccess;
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to create session, id = %s [%d].", _name, audit_token_to_pid( _token ) );
+    }
 
-                callback = DACallbackCreate( kCFAllocatorDefault, session, _address, _context, _kind, 0, NULL, NULL );
-                
-                request = DARequestCreate( kCFAllocatorDefault, _kind, disk, _argument1, argument2, argument3, audit_token_to_euid( _token ), audit_token_to_egid( _token ), callback );
+    return status;
+}
 
-                if ( request )
+kern_return_t _DAServerSessionQueueDiskDescriptions( mach_port_t            _session,
+                                                    vm_address_t           _disks,
+                                                    mach_msg_type_number_t _disksSize,
+                                                    mach_vm_offset_t       _address,
+                                                    mach_vm_offset_t       _context )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            CFArrayRef disks;
+
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            disks = _DAUnserializeWithBytes( kCFAllocatorDefault, _disks, _disksSize );
+
+            if ( disks )
+            {
+                if ( CFGetTypeID( disks ) == CFArrayGetTypeID( ) )
                 {
-                    switch ( _kind )
+                    CFMutableArrayRef descriptions;
+
+                    status = kDAReturnNoResources;
+
+                    descriptions = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                    if ( descriptions )
                     {
-                        case _kDADiskEject:
-                        {
-                            status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightUnmount );
+                        DACallbackRef callback;
+                        CFIndex       count;
+                        CFIndex       index;
 
-                            break;
-                        }
-                        case _kDADiskMount:
+                        /*
+                         * Answer with the cached serialization of each disk, in the order asked.  A disk that is
+                         * not known, or not yet visible to clients, is answered with an empty serialization.
+                         */
+
+                        count = CFArrayGetCount( disks );
+
+                        for ( index = 0; index < count; index++ )
                         {
-                            status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightMount );
+                            CFDataRef serialization = NULL;
+                            CFTypeRef object;
+
+                            object = CFArrayGetValueAtIndex( disks, index );
 
-                            if ( status == 0 )
+                            if ( CFGetTypeID( object ) == CFStringGetTypeID( ) )
                             {
-                                CFStringRef content;
+                                char * id;
 
-                                content = DADiskGetDescription( disk, kDADiskDescriptionMediaContentKey );
+                                id = ___CFStringCopyCString( object );
 
-                                if ( CFEqual( content, CFSTR( "C12A7328-F81F-11D2-BA4B-00A0C93EC93B" ) ) )
+                                if ( id )
                                 {
-                                    if ( audit_token_to_euid( _token ) )
+                                    DADiskRef disk;
+
+                                    disk = __DADiskListGetDisk( id );
+
+                                    if ( disk && DADiskGetState( disk, kDADiskStateStagedAppear ) )
                                     {
-                                        if ( audit_token_to_euid( _token ) != DADiskGetUserUID( disk ) )
-                                        {
-                                            status = kDAReturnNotPermitted;
-                                        }
+                                        serialization = DADiskGetSerialization( disk );
                                     }
+
+                                    free( id );
                                 }
                             }
 
-                            if ( status == 0 )
+                            if ( serialization )
                             {
-                                CFTypeRef mountpoint;
+                                CFArrayAppendValue( descriptions, serialization );
+                            }
+                            else
+                            {
+                                CFDataRef empty;
 
-                                mountpoint = argument2;
+                                empty = CFDataCreate( kCFAllocatorDefault, NULL, 0 );
 
-                                if ( mountpoint )
+                                if ( empty )
                                 {
-                                    mountpoint = CFURLCreateWithString( kCFAllocatorDefault, mountpoint, NULL );
+                                    CFArrayAppendValue( descriptions, empty );
+
+                                    CFRelease( empty );
                                 }
+                            }
+                        }
+
+                        callback = DACallbackCreate( kCFAllocatorDefault, session, _address, _context, _kDADiskDescriptionsCallback, 0, NULL, NULL );
+
+                        if ( callback )
+                        {
+                            DACallbackSetArgument1( callback, descriptions );
+
+                            DASessionQueueCallback( session, callback );
+
+                            DALogDebug( "  dispatched callback, id = %016llX:%016llX, kind = %s, count = %ld.",
+                                        DACallbackGetAddress( callback ),
+                                        DACallbackGetContext( callback ),
+                                        _DACallbackKindGetName( DACallbackGetKind( callback ) ),
+                                        count );
+
+                            status = kDAReturnSuccess;
+
+                            CFRelease( callback );
+                        }
+
+                        CFRelease( descriptions );
+                    }
+                }
+
+                CFRelease( disks );
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to queue disk descriptions (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionQueueRequest( mach_port_t            _session,
+                                            uint32_t                _kind,
+                                            caddr_t                _argument0,
+                                            int32_t                _argument1,
+                                            vm_address_t           _argument2,
+                                            mach_msg_type_number_t _argument2Size,
+                                            vm_address_t           _argument3,
+                                            mach_msg_type_number_t _argument3Size,
+                                            mach_vm_offset_t       _address,
+                                            mach_vm_offset_t       _context,
+                                            audit_token_t          _token )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            CFTypeRef argument2 = NULL;
+            CFTypeRef argument3 = NULL;
+
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            if ( _argument2 )
+            {
+                argument2 = _DAUnserializeWithBytes( kCFAllocatorDefault, _argument2, _argument2Size );
+            }
+
+            if ( _argument3 )
+            {
+                argument3 = _DAUnserializeWithBytes( kCFAllocatorDefault, _argument3, _argument3Size );
+            }
+
+            status = __DASessionQueueRequest( session, _kind, _argument0, _argument1, argument2, argument3, _address, _context, _token );
+
+            if ( argument2 )
+            {
+                CFRelease( argument2 );
+            }
+
+            if ( argument3 )
+            {
+                CFRelease( argument3 );
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to queue solicitation, id = %016llX:%016llX, kind = %s, disk = %s (status code 0x%08X).",
+                    _address,
+                    _context,
+                    _DACallbackKindGetName( _kind ),
+                    _argument0,
+                    status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionQueueRequests( mach_port_t              _session,
+                                             vm_address_t             _requests,
+                                             mach_msg_type_number_t   _requestsSize,
+                                             vm_address_t *           _statuses,
+                                             mach_msg_type_number_t * _statusesSize,
+                                             audit_token_t            _token )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            CFArrayRef requests;
+
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            requests = _DAUnserializeWithBytes( kCFAllocatorDefault, _requests, _requestsSize );
+
+            if ( requests )
+            {
+                if ( CFGetTypeID( requests ) == CFArrayGetTypeID( ) )
+                {
+                    CFMutableArrayRef statuses;
+
+                    status = kDAReturnNoResources;
+
+                    statuses = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                    if ( statuses )
+                    {
+                        CFIndex   count;
+                        CFIndex   index;
+                        CFDataRef data;
+
+                        /*
+                         * Queue every request of the batch before returning to the run loop, so that the stage
+                         * is signaled once and picks up the batch in a single pass.
+                         */
+
+                        count = CFArrayGetCount( requests );
+
+                        for ( index = 0; index < count; index++ )
+                        {
+                            CFNumberRef     number;
+                            CFDictionaryRef request;
+                            DAReturn        requestStatus;
+
+                            request = CFArrayGetValueAtIndex( requests, index );
+
+                            requestStatus = kDAReturnBadArgument;
+
+                            if ( CFGetTypeID( request ) == CFDictionaryGetTypeID( ) )
+                            {
+                                CFStringRef disk;
+
+                                disk = CFDictionaryGetValue( request, _kDARequestDiskKey );
 
-                                if ( mountpoint )
+                                if ( disk && CFGetTypeID( disk ) == CFStringGetTypeID( ) )
                                 {
-                                    char * path;
+                                    char * id;
 
-                                    path = ___CFURLCopyFileSystemRepresentation( mountpoint );
+                                    id = ___CFStringCopyCString( disk );
 
-                                    if ( path )
+                                    if ( id )
                                     {
-                                        status = sandbox_check_by_audit_token(_token, "file-mount", SANDBOX_FILTER_PATH | SANDBOX_CHECK_ALLOW_APPROVAL, path);
+                                        mach_vm_offset_t address;
+                                        _DARequestKind   kind;
 
-                                        if ( status )
-                                        {
-                                            status = kDAReturnNotPrivileged;
-                                        }
+                                        address = ___CFDictionaryGetIntegerValue( request, _kDACallbackAddressKey );
 
-                                        free( path );
-                                    }
+                                        kind = ___CFDictionaryGetIntegerValue( request, _kDARequestKindKey );
 
-                                    if ( audit_token_to_euid( _token ) )
-                                    {
-                                        if ( audit_token_to_euid( _token ) != DADiskGetUserUID( disk ) )
+                                        requestStatus = __DASessionQueueRequest( session,
+                                                                                 kind,
+                                                                                 id,
+                                                                                 ___CFDictionaryGetIntegerValue( request, _kDARequestArgument1Key ),
+                                                                                 CFDictionaryGetValue( request, _kDARequestArgument2Key ),
+                                                                                 CFDictionaryGetValue( request, _kDARequestArgument3Key ),
+                                                                                 address,
+                                                                                 address,
+                                                                                 _token );
+
+                                        if ( requestStatus )
                                         {
-                                            status = kDAReturnNotPrivileged;
+                                            DALogDebug( "unable to queue solicitation, id = %016llX:%016llX, kind = %s, disk = %s (status code 0x%08X).",
+                                                        address,
+                                                        address,
+                                                        _DACallbackKindGetName( kind ),
+                                                        id,
+                                                        requestStatus );
                                         }
-                                    }
 
-                                    CFRelease( mountpoint );
+                                        free( id );
+                                    }
                                 }
                             }
 
-                            break;
-                        }
-                        case _kDADiskRename:
-                        {
-                            status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightRename );
+                            number = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, requestStatus );
 
-                            break;
-                        }
-                        case _kDADiskUnmount:
-                        {
-                            status = DAAuthorize( session, _kDAAuthorizeOptionIsOwner, disk, audit_token_to_euid( _token ), audit_token_to_egid( _token ), _kDAAuthorizeRightUnmount );
+                            if ( number )
+                            {
+                                CFArrayAppendValue( statuses, number );
 
-                            break;
+                                CFRelease( number );
+                            }
                         }
-                        default:
-                        {
-                            status = kDAReturnSuccess;
 
-                            break;
-                        }
-                    }
+                        data = _DASerialize( kCFAllocatorDefault, statuses );
 
-                    if ( status == kDAReturnSuccess )
-                    {
-                        DAQueueRequest( request );
-
-                        DALogDebug( "  queued solicitation, id = %016llX:%016llX, kind = %s, disk = %@, options = 0x%08X.",
-                                    _address,
-                                    _context,
-                                    _DARequestKindGetName( _kind ),
-                                    disk,
-                                    _argument1 );
-                    }
+                        if ( data )
+                        {
+                            *_statuses = ___CFDataCopyBytes( data, _statusesSize );
 
-                    CFRelease( request );
-                }
+                            if ( *_statuses )
+                            {
+                                DALogDebug( "  queued solicitations, count = %ld.", count );
 
-                if ( callback )
-                {
-                    CFRelease( callback );
-                }
+                                status = kDAReturnSuccess;
+                            }
 
-                if ( argument2 )
-                {
-                    CFRelease( argument2 );
-                }
+                            CFRelease( data );
+                        }
 
-                if ( argument3 )
-                {
-                    CFRelease( argument3 );
+                        CFRelease( statuses );
+                    }
                 }
+
+                CFRelease( requests );
             }
         }
     }
 
     if ( status )
     {
-        DALogDebug( "unable to queue solicitation, id = %016llX:%016llX, kind = %s, disk = %s (status code 0x%08X).",
-                    _address,
-                    _context,
-                    _DACallbackKindGetName( _kind ),
-                    _argument0,
-                    status );
+        DALogDebug( "unable to queue solicitations (status code 0x%08X).", status );
     }
 
     return status;
@@ -2248,127 +3128,144 @@ kern_return_t _DAServerSessionRegisterCallback( mach_port_t            _session,
 
         if ( session )
         {
-            DACallbackRef   callback;
-            CFDictionaryRef match = NULL;
-            CFArrayRef      watch = NULL;
+            DACallbackRef callback;
+
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            callback = __DASessionCreateCallback( session, _address, _context, _kind, _order, _match, _matchSize, _watch, _watchSize );
+
+            if ( callback )
+            {
+                __DASessionRegisterCallback( session, callback );
+
+                CFRelease( callback );
+
+                status = kDAReturnSuccess;
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to register callback, id = %016llX:%016llX, kind = %s (status code 0x%08X).", _address, _context, _DACallbackKindGetName( _kind ), status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionRegisterCallbacks( mach_port_t _session, vm_address_t _callbacks, mach_msg_type_number_t _callbacksSize )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            CFArrayRef callbacks;
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            if ( _kDADiskLastKind < _kind )
-            {
-                goto exit;
-            }
-
-            if ( _match )
-            {
-                match = _DAUnserializeDiskDescriptionWithBytes( kCFAllocatorDefault, _match, _matchSize );
-            }
-
-            if ( _watch )
-            {
-                watch = _DAUnserializeWithBytes( kCFAllocatorDefault, _watch, _watchSize );
-            }
-
-            callback = DACallbackCreate( kCFAllocatorDefault, session, _address, _context, _kind, _order, match, watch );
+            callbacks = _DAUnserializeWithBytes( kCFAllocatorDefault, _callbacks, _callbacksSize );
 
-            if ( callback )
+            if ( callbacks )
             {
-                DASessionRegisterCallback( session, callback );
-
-                DALogDebug( "  registered callback, id = %016llX:%016llX, kind = %s.", _address, _context, _DACallbackKindGetName( _kind ) );
-
-                if ( DACallbackGetKind( callback ) == _kDADiskAppearedCallback )
+                if ( CFGetTypeID( callbacks ) == CFArrayGetTypeID( ) )
                 {
-                    CFIndex count;
-                    CFIndex index;
-                   
-                    count = CFArrayGetCount( gDADiskList );
+                    CFIndex           count;
+                    CFMutableArrayRef created;
+                    CFIndex           index;
 
-                    for ( index = 0; index < count; index++ )
-                    {
-                        DADiskRef disk;
-
-                        disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+                    count = CFArrayGetCount( callbacks );
 
-                        if ( DADiskGetState( disk, kDADiskStateStagedAppear ) )
-                        {
-                            DAQueueCallback( callback, disk, NULL );
-                        }
-                    }
+                    /*
+                     * Create every callback of the set, match and watch included, before registering any of
+                     * it.  Registration itself cannot fail, so the set is installed either completely or not
+                     * at all.
+                     */
 
-                    DAQueueCallbacks( session, _kDADiskListCompleteCallback, NULL, NULL );
+                    created = CFArrayCreateMutable( kCFAllocatorDefault, count, &kCFTypeArrayCallBacks );
 
-                    if ( gDAIdle )
+                    if ( created )
                     {
-                        DAQueueCallbacks( session, _kDAIdleCallback, NULL, NULL );
+                        for ( index = 0; index < count; index++ )
+                        {
+                            DACallbackRef   callback;
+                            CFDictionaryRef item;
+                            CFDataRef       match;
+                            CFDataRef       watch;
 
-                        DASessionSetState( session, kDASessionStateIdle, TRUE );
-                    }
-                }
-                else if ( DACallbackGetKind( callback ) == _kDAIdleCallback )
-                {
-                    if ( gDAIdle )
-                    {
-                        DAQueueCallback( callback, NULL, NULL );
+                            item = CFArrayGetValueAtIndex( callbacks, index );
 
-                        DASessionSetState( session, kDASessionStateIdle, TRUE );
-                    }
-                    else
-                    {
-                        DASessionSetState( session, kDASessionStateIdle, FALSE );
-                    }
-                }
-///w:start
-                else if ( DACallbackGetKind( callback ) == _kDADiskEjectApprovalCallback )
-                {
-                    if ( strcmp( _DASessionGetName( session ), "SystemUIServer" ) == 0 )
-                    {
-                        CFStringRef key;
+                            if ( CFGetTypeID( item ) != CFDictionaryGetTypeID( ) )
+                            {
+                                break;
+                            }
 
-                        key = SCDynamicStoreKeyCreateConsoleUser( kCFAllocatorDefault );
+                            match = CFDictionaryGetValue( item, _kDACallbackMatchKey );
+                            watch = CFDictionaryGetValue( item, _kDACallbackWatchKey );
 
-                        if ( key )
-                        {
-                            CFMutableArrayRef keys;
+                            if ( match && CFGetTypeID( match ) != CFDataGetTypeID( ) )
+                            {
+                                break;
+                            }
 
-                            keys = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+                            if ( watch && CFGetTypeID( watch ) != CFDataGetTypeID( ) )
+                            {
+                                break;
+                            }
 
-                            if ( keys )
+                            callback = __DASessionCreateCallback( session,
+                                                                  ___CFDictionaryGetIntegerValue( item, _kDACallbackAddressKey ),
+                                                                  ___CFDictionaryGetIntegerValue( item, _kDACallbackContextKey ),
+                                                                  ___CFDictionaryGetIntegerValue( item, _kDACallbackKindKey ),
+                                                                  ___CFDictionaryGetIntegerValue( item, _kDACallbackOrderKey ),
+                                                                  ( vm_address_t           ) ( match ? CFDataGetBytePtr( match ) : 0 ),
+                                                                  ( mach_msg_type_number_t ) ( match ? CFDataGetLength(  match ) : 0 ),
+                                                                  ( vm_address_t           ) ( watch ? CFDataGetBytePtr( watch ) : 0 ),
+                                                                  ( mach_msg_type_number_t ) ( watch ? CFDataGetLength(  watch ) : 0 ) );
+
+                            if ( callback == NULL )
                             {
-                                CFArrayAppendValue( keys, key );
+                                break;
+                            }
 
-                                _DAConfigurationCallback( NULL, keys, NULL );
+                            CFArrayAppendValue( created, callback );
 
-                                CFRelease( keys );
+                            CFRelease( callback );
+                        }
+
+                        if ( index == count )
+                        {
+                            for ( index = 0; index < count; index++ )
+                            {
+                                __DASessionRegisterCallback( session, ( void * ) CFArrayGetValueAtIndex( created, index ) );
                             }
 
-                            CFRelease( key );
+                            DALogDebug( "  registered callbacks, count = %ld.", count );
+
+                            status = kDAReturnSuccess;
                         }
+
+                        CFRelease( created );
                     }
                 }
-///w:stop
-
-                CFRelease( callback );
-
-                status = kDAReturnSuccess;
-            }
-
-            if ( match )
-            {
-                CFRelease( match );
-            }
 
-            if ( watch )
-            {
-                CFRelease( watch );
+                CFRelease( callbacks );
             }
         }
     }
 
-exit:
     if ( status )
     {
-        DALogDebug( "unable to register callback, id = %016llX:%016llX, kind = %s (status code 0x%08X).", _address, _context, _DACallbackKindGetName( _kind ), status );
+        DALogDebug( "unable to register callbacks (status code 0x%08X).", status );
     }
 
     return status;
@@ -2424,6 +3321,8 @@ kern_return_t _DAServerSessionRelease( mach_port_t _session )
 
             DASessionSetState( session, kDASessionStateZombie, TRUE );
 
+            CFDictionaryRemoveValue( __gDASessionListIndex, ( void * ) ( uintptr_t ) DASessionGetID( session ) );
+
             ___CFArrayRemoveValue( gDASessionList, session );
 
             ___os_transaction_end( );
@@ -2440,6 +3339,40 @@ kern_return_t _DAServerSessionRelease( mach_port_t _session )
     return status;
 }
 
+kern_return_t _DAServerSessionReleaseEventRing( mach_port_t _session )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            DASessionReleaseEventRing( session );
+
+            DALogDebug( "  released event ring." );
+
+            status = kDAReturnSuccess;
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to release event ring (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
 kern_return_t _DAServerSessionSetAuthorization( mach_port_t _session, AuthorizationExternalForm _authorization )
 {
     kern_return_t status;
@@ -2481,6 +3414,56 @@ kern_return_t _DAServerSessionSetAuthorization( mach_port_t _session, Authorizat
     return status;
 }
 
+kern_return_t _DAServerSessionSetCallbackBatching( mach_port_t _session, int32_t _latency, int32_t _limit )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            /*
+             * The latency is expressed in microseconds, and is bounded so that a client cannot hold
+             * back its callbacks, approvals in particular, for longer than a second.
+             */
+
+            if ( _latency < 0 || _latency > 1000000 )
+            {
+                goto exit;
+            }
+
+            if ( _limit < 0 )
+            {
+                goto exit;
+            }
+
+            DASessionSetCallbackBatching( session, _latency / 1000000.0, _limit );
+
+            DALogDebug( "  set callback batching, id = %@, latency = %dus, limit = %d.", session, _latency, _limit );
+
+            status = kDAReturnSuccess;
+        }
+    }
+
+exit:
+    if ( status )
+    {
+        DALogDebug( "unable to set callback batching, id = ? [?]:%d.", _session );
+    }
+
+    return status;
+}
+
 kern_return_t _DAServerSessionSetClientPort( mach_port_t _session, mach_port_t _client )
 {
     kern_return_t status;
@@ -2515,6 +3498,45 @@ kern_return_t _DAServerSessionSetClientPort( mach_port_t _session, mach_port_t _
     return status;
 }
 
+kern_return_t _DAServerSessionSetDebugLogSubsystems( mach_port_t _session, int32_t _subsystems, audit_token_t _token )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            status = kDAReturnNotPrivileged;
+
+            if ( audit_token_to_euid( _token ) == 0 )
+            {
+                DALogSetDebugSubsystems( ( DADebugLogSubsystems ) _subsystems );
+
+                DALog( "debug logging set, subsystems = 0x%08X, id = %@.", _subsystems, session );
+
+                status = kDAReturnSuccess;
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to set debug logging, id = ? [?]:%d (status code 0x%08X).", _session, status );
+    }
+
+    return status;
+}
+
 kern_return_t _DAServerSessionUnregisterCallback( mach_port_t _session, mach_vm_offset_t _address, mach_vm_offset_t _context )
 {
     kern_return_t status;
@@ -2560,13 +3582,124 @@ kern_return_t _DAServerSessionUnregisterCallback( mach_port_t _session, mach_vm_
     return status;
 }
 
+kern_return_t _DAServerSessionUnregisterCallbacks( mach_port_t _session, vm_address_t _callbacks, mach_msg_type_number_t _callbacksSize )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            CFArrayRef callbacks;
+
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            callbacks = _DAUnserializeWithBytes( kCFAllocatorDefault, _callbacks, _callbacksSize );
+
+            if ( callbacks )
+            {
+                if ( CFGetTypeID( callbacks ) == CFArrayGetTypeID( ) )
+                {
+                    CFIndex           count;
+                    CFMutableArrayRef created;
+                    CFIndex           index;
+
+                    count = CFArrayGetCount( callbacks );
+
+                    /*
+                     * Create the key of every callback of the set before unregistering any of it, so that the
+                     * set is removed either completely or not at all.
+                     */
+
+                    created = CFArrayCreateMutable( kCFAllocatorDefault, count, &kCFTypeArrayCallBacks );
+
+                    if ( created )
+                    {
+                        for ( index = 0; index < count; index++ )
+                        {
+                            DACallbackRef   callback;
+                            CFDictionaryRef item;
+
+                            item = CFArrayGetValueAtIndex( callbacks, index );
+
+                            if ( CFGetTypeID( item ) != CFDictionaryGetTypeID( ) )
+                            {
+                                break;
+                            }
+
+                            callback = DACallbackCreate( kCFAllocatorDefault,
+                                                         session,
+                                                         ___CFDictionaryGetIntegerValue( item, _kDACallbackAddressKey ),
+                                                         ___CFDictionaryGetIntegerValue( item, _kDACallbackContextKey ),
+                                                         0,
+                                                         0,
+                                                         NULL,
+                                                         NULL );
+
+                            if ( callback == NULL )
+                            {
+                                break;
+                            }
+
+                            CFArrayAppendValue( created, callback );
+
+                            CFRelease( callback );
+                        }
+
+                        if ( index == count )
+                        {
+                            for ( index = 0; index < count; index++ )
+                            {
+                                DACallbackRef callback;
+
+                                callback = ( void * ) CFArrayGetValueAtIndex( created, index );
+
+                                DAQueueUnregisterCallback( callback );
+
+                                DASessionUnregisterCallback( session, callback );
+                            }
+
+                            DALogDebug( "  unregistered callbacks, count = %ld.", count );
+
+                            status = kDAReturnSuccess;
+                        }
+
+                        CFRelease( created );
+                    }
+                }
+
+                CFRelease( callbacks );
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to unregister callbacks (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
 void _DAVolumeMountedCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
 {
     struct statfs * mountList;
     int             mountListCount;
     int             mountListIndex;
 
-    mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+    DAWatchdogBegin( "vfs notification" );
+
+    DARecordAppendMountList( kDARecordKindVolumeMounted );
+
+    mountListCount = DAPlatformGetMountList( &mountList );
 
     for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
     {
@@ -2606,6 +3739,8 @@ void _DAVolumeMountedCallback( CFMachPortRef port, void * parameter, CFIndex mes
 
                         CFArrayInsertValueAtIndex( gDADiskList, 0, disk );
 
+                        DASnapshotAddDisk( disk );
+
                         DAStageSignal( );
 
                         CFRelease( disk );
@@ -2614,6 +3749,8 @@ void _DAVolumeMountedCallback( CFMachPortRef port, void * parameter, CFIndex mes
             }
         }
     }
+
+    DAWatchdogEnd( );
 }
 
 void _DAVolumeUnmountedCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
@@ -2621,6 +3758,10 @@ void _DAVolumeUnmountedCallback( CFMachPortRef port, void * parameter, CFIndex m
     CFIndex count;
     CFIndex index;
 
+    DAWatchdogBegin( "vfs notification" );
+
+    DARecordAppendMountList( kDARecordKindVolumeUnmounted );
+
     count = CFArrayGetCount( gDADiskList );
 
     for ( index = 0; index < count; index++ )
@@ -2634,6 +3775,8 @@ void _DAVolumeUnmountedCallback( CFMachPortRef port, void * parameter, CFIndex m
             DADiskRefresh( disk, NULL );
         }
     }
+
+    DAWatchdogEnd( );
 }
 
 void _DAVolumeUpdatedCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
@@ -2641,6 +3784,10 @@ void _DAVolumeUpdatedCallback( CFMachPortRef port, void * parameter, CFIndex mes
     CFIndex count;
     CFIndex index;
 
+    DAWatchdogBegin( "vfs notification" );
+
+    DARecordAppendMountList( kDARecordKindVolumeUpdated );
+
     count = CFArrayGetCount( gDADiskList );
 
     for ( index = 0; index < count; index++ )
@@ -2654,6 +3801,8 @@ void _DAVolumeUpdatedCallback( CFMachPortRef port, void * parameter, CFIndex mes
             DADiskRefresh( disk, NULL );
         }
     }
+
+    DAWatchdogEnd( );
 }
 
 CFRunLoopSourceRef DAServerCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order )
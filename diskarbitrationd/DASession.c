@@ -24,7 +24,10 @@
 #include "DASession.h"
 
 #include "DACallback.h"
+#include "DAMetrics.h"
+#include "DAPlatform.h"
 #include "DAServer.h"
+#include "DAWatchdog.h"
 
 #include <mach/mach.h>
 #include <CoreFoundation/CoreFoundation.h>
@@ -35,12 +38,18 @@ struct __DASession
     CFRuntimeBase      _base;
 
     AuthorizationRef   _authorization;
+    CFTimeInterval     _batchLatency;
+    CFIndex            _batchLimit;
+    CFRunLoopTimerRef  _batchTimer;
     mach_port_t        _client;
     char *             _name;
     pid_t              _pid;
+    DAMetricsSeriesRef _queueDepth;
     DASessionOptions   _options;
     CFMutableArrayRef  _queue;
     CFMutableArrayRef  _register;
+    _DAEventRing *     _ring;
+    mach_port_t        _ringPort;
     CFMachPortRef      _server;
     CFRunLoopSourceRef _source;
     DASessionState     _state;
@@ -69,6 +78,43 @@ static const CFRuntimeClass __DASessionClass =
 
 static CFTypeID __kDASessionTypeID = _kCFRuntimeNotATypeID;
 
+static void __DASessionSignal( DASessionRef session )
+{
+    if ( session->_client )
+    {
+        DAPlatformSignal( session->_client );
+    }
+}
+
+static void __DASessionWakeup( DASessionRef session )
+{
+    /*
+     * Signal the client that its callback queue is ready to be copied.  A client with an event ring
+     * shares the one wakeup between both, and checks the ring for whether the queue is worth a copy.
+     */
+
+    if ( session->_ring )
+    {
+        __atomic_store_n( &session->_ring->queue, 1, __ATOMIC_RELEASE );
+    }
+
+    __DASessionSignal( session );
+}
+
+static void __DASessionBatchTimerCallback( CFRunLoopTimerRef timer, void * info )
+{
+    DASessionRef session = info;
+
+    DAWatchdogBegin( "batch timer" );
+
+    if ( CFArrayGetCount( session->_queue ) )
+    {
+        __DASessionWakeup( session );
+    }
+
+    DAWatchdogEnd( );
+}
+
 static CFStringRef __DASessionCopyDescription( CFTypeRef object )
 {
     DASessionRef session = ( DASessionRef ) object;
@@ -104,12 +150,18 @@ static DASessionRef __DASessionCreate( CFAllocatorRef allocator )
     if ( session )
     {
         session->_authorization = NULL;
+        session->_batchLatency  = 0;
+        session->_batchLimit    = 0;
+        session->_batchTimer    = NULL;
         session->_client        = MACH_PORT_NULL;
         session->_name          = NULL;
         session->_pid           = 0;
         session->_options       = 0;
         session->_queue         = CFArrayCreateMutable( allocator, 0, &kCFTypeArrayCallBacks );
+        session->_queueDepth    = NULL;
         session->_register      = CFArrayCreateMutable( allocator, 0, &kCFTypeArrayCallBacks );
+        session->_ring          = NULL;
+        session->_ringPort      = MACH_PORT_NULL;
         session->_server        = NULL;
         session->_source        = NULL;
         session->_state         = 0;
@@ -130,6 +182,15 @@ static void __DASessionDeallocate( CFTypeRef object )
     if ( session->_name          )  free( session->_name );
     if ( session->_queue         )  CFRelease( session->_queue );
     if ( session->_register      )  CFRelease( session->_register );
+    if ( session->_ring          )  vm_deallocate( mach_task_self( ), ( vm_address_t ) session->_ring, round_page( sizeof( _DAEventRing ) ) );
+    if ( session->_ringPort      )  mach_port_deallocate( mach_task_self( ), session->_ringPort );
+
+    if ( session->_batchTimer )
+    {
+        CFRunLoopTimerInvalidate( session->_batchTimer );
+
+        CFRelease( session->_batchTimer );
+    }
 
     if ( session->_source )
     {
@@ -173,6 +234,16 @@ const char * _DASessionGetName( DASessionRef session )
     return session->_name;
 }
 ///w:stop
+void DASessionClearCallbackQueue( DASessionRef session )
+{
+    CFArrayRemoveAllValues( session->_queue );
+
+    if ( session->_ring )
+    {
+        __atomic_store_n( &session->_ring->queue, 0, __ATOMIC_RELEASE );
+    }
+}
+
 DASessionRef DASessionCreate( CFAllocatorRef allocator, const char * _name, pid_t _pid )
 {
     DASessionRef session;
@@ -279,6 +350,46 @@ CFMutableArrayRef DASessionGetCallbackRegister( DASessionRef session )
     return session->_register;
 }
 
+mach_port_t DASessionGetEventRing( DASessionRef session )
+{
+    /*
+     * The event ring is a page-aligned region that is shared read-only with the client through a
+     * memory entry.  It is created the first time the client asks for it.
+     */
+
+    if ( session->_ring == NULL )
+    {
+        vm_address_t  address;
+        kern_return_t status;
+
+        status = vm_allocate( mach_task_self( ), &address, round_page( sizeof( _DAEventRing ) ), VM_FLAGS_ANYWHERE );
+
+        if ( status == KERN_SUCCESS )
+        {
+            memory_object_size_t size;
+
+            size = round_page( sizeof( _DAEventRing ) );
+
+            status = mach_make_memory_entry_64( mach_task_self( ), &size, address, VM_PROT_READ, &session->_ringPort, MACH_PORT_NULL );
+
+            if ( status == KERN_SUCCESS )
+            {
+                session->_ring = ( void * ) address;
+
+                session->_ring->version = _kDAEventRingVersion;
+                session->_ring->count   = _kDAEventRingCount;
+                session->_ring->queue   = CFArrayGetCount( session->_queue ) ? 1 : 0;
+            }
+            else
+            {
+                vm_deallocate( mach_task_self( ), address, round_page( sizeof( _DAEventRing ) ) );
+            }
+        }
+    }
+
+    return session->_ringPort;
+}
+
 mach_port_t DASessionGetID( DASessionRef session )
 {
     return CFMachPortGetPort( session->_server );
@@ -316,31 +427,92 @@ void DASessionInitialize( void )
 
 void DASessionQueueCallback( DASessionRef session, DACallbackRef callback )
 {
+    CFIndex count;
+
     session->_state &= ~kDASessionStateIdle;
     
     CFArrayAppendValue( session->_queue, callback );
 
-    if ( CFArrayGetCount( session->_queue ) == 1 )
+    count = CFArrayGetCount( session->_queue );
+
+    if ( session->_queueDepth == NULL )
+    {
+        char key[48];
+
+        /*
+         * Look the histogram up once per session, rather than format its key for every callback.
+         */
+
+        snprintf( key, sizeof( key ), "%s:%d", session->_name, DASessionGetID( session ) );
+
+        session->_queueDepth = DAMetricsGetHistogram( "callback queue depth", key );
+    }
+
+    DAMetricsRecordValue( session->_queueDepth, count );
+
+    if ( session->_batchTimer )
     {
-        if ( session->_client )
+        /*
+         * The client has asked for batched delivery.  The first callback of a batch arms the latency
+         * timer, and the batch is delivered early should it reach the size limit.
+         */
+
+        if ( count == session->_batchLimit )
         {
-            mach_msg_header_t message;
-            kern_return_t     status;
+            CFRunLoopTimerSetNextFireDate( session->_batchTimer, kCFAbsoluteTimeIntervalSince1904 );
 
-            message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
-            message.msgh_id          = 0;
-            message.msgh_local_port  = MACH_PORT_NULL;
-            message.msgh_remote_port = session->_client;
-            message.msgh_reserved    = 0;
-            message.msgh_size        = sizeof( message );
+            __DASessionWakeup( session );
+        }
+        else if ( count == 1 )
+        {
+            CFRunLoopTimerSetNextFireDate( session->_batchTimer, CFAbsoluteTimeGetCurrent( ) + session->_batchLatency );
+        }
+    }
+    else
+    {
+        if ( count == 1 )
+        {
+            __DASessionWakeup( session );
+        }
+    }
+}
 
-            status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+void DASessionQueueEvent( DASessionRef session, _DACallbackKind kind, const char * id )
+{
+    if ( session->_ring )
+    {
+        _DAEventRecord * record;
+        UInt64           head;
 
-            if ( status == MACH_SEND_TIMED_OUT )
-            {
-                mach_msg_destroy( &message );
-            }
+        head = session->_ring->head;
+
+        record = &session->_ring->records[ head % _kDAEventRingCount ];
+
+        /*
+         * Invalidate the record for the duration of the update, so that a client that is still
+         * reading it from the previous lap sees that it has been overtaken.
+         */
+
+        __atomic_store_n( &record->index, 0, __ATOMIC_RELAXED );
+
+        __atomic_thread_fence( __ATOMIC_RELEASE );
+
+        record->kind = kind;
+
+        /*
+         * An identifier that does not fit is left empty, which the client treats as lost events.
+         */
+
+        if ( strlcpy( record->id, id, sizeof( record->id ) ) >= sizeof( record->id ) )
+        {
+            record->id[0] = 0;
         }
+
+        __atomic_store_n( &record->index, head + 1, __ATOMIC_RELEASE );
+
+        __atomic_store_n( &session->_ring->head, head + 1, __ATOMIC_RELEASE );
+
+        __DASessionSignal( session );
     }
 }
 
@@ -349,6 +521,28 @@ void DASessionRegisterCallback( DASessionRef session, DACallbackRef callback )
     CFArrayAppendValue( session->_register, callback );
 }
 
+void DASessionReleaseEventRing( DASessionRef session )
+{
+    /*
+     * Stop writing events for a client that no longer reads them, and signal it for the callback
+     * queue alone from now on.
+     */
+
+    if ( session->_ring )
+    {
+        vm_deallocate( mach_task_self( ), ( vm_address_t ) session->_ring, round_page( sizeof( _DAEventRing ) ) );
+
+        session->_ring = NULL;
+    }
+
+    if ( session->_ringPort )
+    {
+        mach_port_deallocate( mach_task_self( ), session->_ringPort );
+
+        session->_ringPort = MACH_PORT_NULL;
+    }
+}
+
 void DASessionScheduleWithRunLoop( DASessionRef session, CFRunLoopRef runLoop, CFStringRef runLoopMode )
 {
     CFRunLoopAddSource( runLoop, session->_source, runLoopMode );
@@ -364,6 +558,56 @@ void DASessionSetAuthorization( DASessionRef session, AuthorizationRef authoriza
     session->_authorization = authorization;
 }
 
+void DASessionSetCallbackBatching( DASessionRef session, CFTimeInterval latency, CFIndex limit )
+{
+    if ( latency > 0 )
+    {
+        if ( session->_batchTimer == NULL )
+        {
+            CFRunLoopTimerContext timerContext = { 0, session, NULL, NULL, NULL };
+
+            session->_batchTimer = CFRunLoopTimerCreate( CFGetAllocator( session ),
+                                                         kCFAbsoluteTimeIntervalSince1904,
+                                                         kCFAbsoluteTimeIntervalSince1904,
+                                                         0,
+                                                         0,
+                                                         __DASessionBatchTimerCallback,
+                                                         &timerContext );
+
+            if ( session->_batchTimer )
+            {
+                CFRunLoopAddTimer( CFRunLoopGetCurrent( ), session->_batchTimer, kCFRunLoopDefaultMode );
+            }
+        }
+
+        session->_batchLatency = latency;
+        session->_batchLimit   = limit;
+    }
+    else
+    {
+        if ( session->_batchTimer )
+        {
+            CFRunLoopTimerInvalidate( session->_batchTimer );
+
+            CFRelease( session->_batchTimer );
+
+            session->_batchTimer = NULL;
+        }
+
+        session->_batchLatency = 0;
+        session->_batchLimit   = 0;
+
+        /*
+         * Deliver anything that was held back for the batch.
+         */
+
+        if ( CFArrayGetCount( session->_queue ) )
+        {
+            __DASessionWakeup( session );
+        }
+    }
+}
+
 void DASessionSetClientPort( DASessionRef session, mach_port_t client )
 {
     if ( session->_client )
@@ -375,25 +619,7 @@ void DASessionSetClientPort( DASessionRef session, mach_port_t client )
 
     if ( CFArrayGetCount( session->_queue ) )
     {
-        if ( session->_client )
-        {
-            mach_msg_header_t message;
-            kern_return_t     status;
-
-            message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
-            message.msgh_id          = 0;
-            message.msgh_local_port  = MACH_PORT_NULL;
-            message.msgh_remote_port = session->_client;
-            message.msgh_reserved    = 0;
-            message.msgh_size        = sizeof( message );
-
-            status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
-
-            if ( status == MACH_SEND_TIMED_OUT )
-            {
-                mach_msg_destroy( &message );
-            }
-        }
+        __DASessionWakeup( session );
     }
 }
 
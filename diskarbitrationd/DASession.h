@@ -28,6 +28,8 @@
 #include <DiskArbitration/DiskArbitration.h>
 #include <Security/Authorization.h>
 
+#include "DAInternal.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -57,10 +59,12 @@ typedef struct __DASession * DASessionRef;
 ///w:start
 extern const char * _DASessionGetName( DASessionRef session );
 ///w:stop
+extern void              DASessionClearCallbackQueue( DASessionRef session );
 extern DASessionRef      DASessionCreate( CFAllocatorRef allocator, const char * _name, pid_t _pid );
 extern AuthorizationRef  DASessionGetAuthorization( DASessionRef session );
 extern CFMutableArrayRef DASessionGetCallbackQueue( DASessionRef session );
 extern CFMutableArrayRef DASessionGetCallbackRegister( DASessionRef session );
+extern mach_port_t       DASessionGetEventRing( DASessionRef session );
 extern mach_port_t       DASessionGetID( DASessionRef session );
 extern Boolean           DASessionGetOption( DASessionRef session, DASessionOption option );
 extern DASessionOptions  DASessionGetOptions( DASessionRef session );
@@ -69,9 +73,12 @@ extern Boolean           DASessionGetState( DASessionRef session, DASessionState
 extern CFTypeID          DASessionGetTypeID( void );
 extern void              DASessionInitialize( void );
 extern void              DASessionQueueCallback( DASessionRef session, DACallbackRef callback );
+extern void              DASessionQueueEvent( DASessionRef session, _DACallbackKind kind, const char * id );
 extern void              DASessionRegisterCallback( DASessionRef session, DACallbackRef callback );
+extern void              DASessionReleaseEventRing( DASessionRef session );
 extern void              DASessionScheduleWithRunLoop( DASessionRef session, CFRunLoopRef runLoop, CFStringRef runLoopMode );
 extern void              DASessionSetAuthorization( DASessionRef session, AuthorizationRef authorization );
+extern void              DASessionSetCallbackBatching( DASessionRef session, CFTimeInterval latency, CFIndex limit );
 extern void              DASessionSetClientPort( DASessionRef session, mach_port_t client );
 extern void              DASessionSetOption( DASessionRef session, DASessionOption option, Boolean value );
 extern void              DASessionSetOptions( DASessionRef session, DASessionOptions options, Boolean value );
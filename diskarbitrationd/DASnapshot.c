@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "DASnapshot.h"
+
+#include "DAInternal.h"
+#include "DALog.h"
+#include "DAMetrics.h"
+
+#include <mach/mach.h>
+
+static UInt64                 __gDASnapshotGeneration = 0;
+static CFMutableDictionaryRef __gDASnapshotIndex      = NULL;
+static mach_port_t            __gDASnapshotPort       = MACH_PORT_NULL;
+static _DASnapshot *          __gDASnapshotTable      = NULL;
+
+static Boolean __DASnapshotInitialize( void )
+{
+    /*
+     * The snapshot table is a page-aligned region that is shared read-only with clients through a
+     * memory entry.  Clients map it on demand and consult it in place of a server round trip.
+     */
+
+    if ( __gDASnapshotTable == NULL )
+    {
+        vm_address_t  address;
+        kern_return_t status;
+
+        status = vm_allocate( mach_task_self( ), &address, round_page( sizeof( _DASnapshot ) ), VM_FLAGS_ANYWHERE );
+
+        if ( status == KERN_SUCCESS )
+        {
+            memory_object_size_t size;
+
+            size = round_page( sizeof( _DASnapshot ) );
+
+            status = mach_make_memory_entry_64( mach_task_self( ), &size, address, VM_PROT_READ, &__gDASnapshotPort, MACH_PORT_NULL );
+
+            if ( status == KERN_SUCCESS )
+            {
+                __gDASnapshotIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, NULL );
+
+                assert( __gDASnapshotIndex );
+
+                __gDASnapshotTable = ( void * ) address;
+
+                __gDASnapshotTable->version = _kDASnapshotVersion;
+                __gDASnapshotTable->count   = _kDASnapshotCount;
+            }
+            else
+            {
+                DALogError( "unable to create snapshot table (status code 0x%08X).", status );
+
+                vm_deallocate( mach_task_self( ), address, round_page( sizeof( _DASnapshot ) ) );
+            }
+        }
+    }
+
+    return __gDASnapshotTable ? TRUE : FALSE;
+}
+
+static void __DASnapshotWriteBoolean( _DASnapshotRecord * record, DADiskRef disk, CFStringRef key, UInt32 field )
+{
+    CFTypeRef object;
+
+    object = DADiskGetDescription( disk, key );
+
+    record->fields |= field;
+
+    if ( object )
+    {
+        record->present |= field;
+
+        if ( object == kCFBooleanTrue )
+        {
+            record->values |= field;
+        }
+    }
+}
+
+static void __DASnapshotWriteDescription( _DASnapshotRecord * record, DADiskRef disk )
+{
+    /*
+     * Copy the most commonly read description fields into their slots.  A field is only served from
+     * the table if it is marked in the fields mask, which it is not if its value does not fit.
+     */
+
+    CFTypeRef object;
+
+    record->fields  = 0;
+    record->present = 0;
+    record->values  = 0;
+
+    record->mediaBSDName[0] = 0;
+    record->volumePath[0]   = 0;
+
+    object = DADiskGetDescription( disk, kDADiskDescriptionMediaBSDNameKey );
+
+    if ( object == NULL || CFStringGetCString( object, record->mediaBSDName, sizeof( record->mediaBSDName ), kCFStringEncodingUTF8 ) )
+    {
+        record->fields |= _kDASnapshotFieldMediaBSDName;
+
+        if ( object )
+        {
+            record->present |= _kDASnapshotFieldMediaBSDName;
+        }
+    }
+
+    object = DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey );
+
+    if ( object == NULL || CFURLGetFileSystemRepresentation( object, TRUE, ( void * ) record->volumePath, sizeof( record->volumePath ) ) )
+    {
+        record->fields |= _kDASnapshotFieldVolumePath;
+
+        if ( object )
+        {
+            record->present |= _kDASnapshotFieldVolumePath;
+        }
+    }
+
+    __DASnapshotWriteBoolean( record, disk, kDADiskDescriptionMediaEjectableKey,  _kDASnapshotFieldMediaEjectable  );
+    __DASnapshotWriteBoolean( record, disk, kDADiskDescriptionMediaRemovableKey,  _kDASnapshotFieldMediaRemovable  );
+    __DASnapshotWriteBoolean( record, disk, kDADiskDescriptionMediaWholeKey,      _kDASnapshotFieldMediaWhole      );
+    __DASnapshotWriteBoolean( record, disk, kDADiskDescriptionMediaWritableKey,   _kDASnapshotFieldMediaWritable   );
+    __DASnapshotWriteBoolean( record, disk, kDADiskDescriptionVolumeMountableKey, _kDASnapshotFieldVolumeMountable );
+}
+
+static void __DASnapshotWrite( _DASnapshotRecord * record, DADiskRef disk, UInt32 state, Boolean description )
+{
+    /*
+     * Make the sequence count odd for the duration of the update, so that a concurrent reader
+     * discards whatever it copies in the meantime.
+     */
+
+    __atomic_store_n( &record->sequence, record->sequence + 1, __ATOMIC_RELAXED );
+
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    record->state = state;
+
+    if ( disk )
+    {
+        if ( description )
+        {
+            __gDASnapshotGeneration++;
+
+            record->generation = __gDASnapshotGeneration;
+        }
+
+        record->claimed = DADiskGetClaim( disk ) ? TRUE : FALSE;
+        record->options = DADiskGetOptions( disk );
+        record->userUID = DADiskGetUserUID( disk );
+
+        strlcpy( record->id, DADiskGetID( disk ), sizeof( record->id ) );
+
+        if ( description )
+        {
+            __DASnapshotWriteDescription( record, disk );
+        }
+    }
+    else
+    {
+        bzero( record->id, sizeof( record->id ) );
+
+        record->fields = 0;
+    }
+
+    __atomic_store_n( &record->sequence, record->sequence + 1, __ATOMIC_RELEASE );
+}
+
+void DASnapshotAddDisk( DADiskRef disk )
+{
+    if ( __DASnapshotInitialize( ) )
+    {
+        /*
+         * A disk that is not published leaves its clients to fall back on the server, which is counted
+         * so that the fallback can be told apart from a slow server.
+         */
+
+        if ( strlen( DADiskGetID( disk ) ) < sizeof( __gDASnapshotTable->records[0].id ) )
+        {
+            UInt32 index;
+            UInt32 probe;
+
+            index = _DASnapshotHash( DADiskGetID( disk ) ) % _kDASnapshotCount;
+
+            for ( probe = 0; probe < _kDASnapshotCount; probe++ )
+            {
+                _DASnapshotRecord * record;
+
+                record = &__gDASnapshotTable->records[index];
+
+                if ( record->state != _kDASnapshotRecordPresent )
+                {
+                    __DASnapshotWrite( record, disk, _kDASnapshotRecordPresent, TRUE );
+
+                    CFDictionarySetValue( __gDASnapshotIndex, disk, ( void * ) ( uintptr_t ) ( index + 1 ) );
+
+                    break;
+                }
+
+                index = ( index + 1 ) % _kDASnapshotCount;
+            }
+
+            if ( probe == _kDASnapshotCount )
+            {
+                DALogDebug( "unable to publish disk, table full, id = %@.", disk );
+
+                DAMetricsCount( "snapshot unpublished", "table full" );
+            }
+        }
+        else
+        {
+            DALogDebug( "unable to publish disk, id too long, id = %@.", disk );
+
+            DAMetricsCount( "snapshot unpublished", "id too long" );
+        }
+    }
+}
+
+mach_port_t DASnapshotGetPort( void )
+{
+    __DASnapshotInitialize( );
+
+    return __gDASnapshotPort;
+}
+
+void DASnapshotRemoveDisk( DADiskRef disk )
+{
+    if ( __gDASnapshotIndex )
+    {
+        UInt32 index;
+
+        index = ( UInt32 ) ( uintptr_t ) CFDictionaryGetValue( __gDASnapshotIndex, disk );
+
+        if ( index )
+        {
+            _DASnapshotRecord * record;
+            UInt32              state;
+
+            index = index - 1;
+
+            record = &__gDASnapshotTable->records[index];
+
+            /*
+             * A removed record must remain a placeholder for readers probing past it, unless it ends
+             * the probe sequence anyway.
+             */
+
+            state = _kDASnapshotRecordRemoved;
+
+            if ( __gDASnapshotTable->records[ ( index + 1 ) % _kDASnapshotCount ].state == _kDASnapshotRecordEmpty )
+            {
+                state = _kDASnapshotRecordEmpty;
+            }
+
+            __DASnapshotWrite( record, NULL, state, FALSE );
+
+            CFDictionaryRemoveValue( __gDASnapshotIndex, disk );
+        }
+    }
+}
+
+void DASnapshotUpdateDisk( DADiskRef disk, Boolean description )
+{
+    if ( __gDASnapshotIndex )
+    {
+        UInt32 index;
+
+        index = ( UInt32 ) ( uintptr_t ) CFDictionaryGetValue( __gDASnapshotIndex, disk );
+
+        if ( index )
+        {
+            __DASnapshotWrite( &__gDASnapshotTable->records[ index - 1 ], disk, _kDASnapshotRecordPresent, description );
+        }
+    }
+}
@@ -29,11 +29,15 @@
 #include "DADisk.h"
 #include "DAFileSystem.h"
 #include "DAMain.h"
+#include "DAMetrics.h"
 #include "DAMount.h"
+#include "DAPlatform.h"
 #include "DAPrivate.h"
 #include "DAProbe.h"
 #include "DAQueue.h"
 #include "DASupport.h"
+#include "DATrace.h"
+#include "DAWatchdog.h"
 
 #include <unistd.h>
 #include <sys/mount.h>
@@ -65,7 +69,11 @@ static void __DAStageProbeCallback( int             status,
 
 static void __DABusyTimerCallback( CFRunLoopTimerRef timer, void * info )
 {
+    DAWatchdogBegin( "busy timer" );
+
     DAStageSignal( );
+
+    DAWatchdogEnd( );
 }
 
 static void __DABusyTimerRefresh( CFAbsoluteTime clock )
@@ -94,6 +102,8 @@ static void __DAStageAppeared( DADiskRef disk )
      */
 
     DADiskSetState( disk, kDADiskStateStagedAppear, TRUE );
+
+    DATraceEnd( disk, "appear", NULL );
     
     DADiskAppearedCallback( disk );
 
@@ -109,6 +119,8 @@ static void __DAStageDispatch( void * info )
     CFIndex        index;
     Boolean        quiet = TRUE;
 
+    DAWatchdogBegin( "stage" );
+
     /*
      * Determine whether a unit has quiesced.  We do not allow I/O Kit to stay busy excessively.
      */
@@ -382,6 +394,8 @@ static void __DAStageDispatch( void * info )
 
                     if ( dispatch )
                     {
+                        DAMetricsRecordInterval( "request wait", _DARequestKindGetName( DARequestGetKind( request ) ), CFAbsoluteTimeGetCurrent( ) - DARequestGetTime( request ) );
+
                         CFArrayRemoveValueAtIndex( gDARequestList, index );
 
                         count--;
@@ -494,6 +508,8 @@ static void __DAStageDispatch( void * info )
             }
         }
     }
+
+    DAWatchdogEnd( );
 }
 
 static void __DAStageMount( DADiskRef disk )
@@ -509,6 +525,7 @@ static void __DAStageMount( DADiskRef disk )
      */
     if ( DAMountGetPreference( disk, kDAMountPreferenceDisableAutoMount ) == false )
     {
+        DATraceInstant( disk, "automatic mount", NULL );
 
         DADiskMountWithArguments( disk, NULL, kDADiskMountOptionDefault, NULL, CFSTR( "automatic" ) );
     }
@@ -573,6 +590,8 @@ static void __DAStagePeek( DADiskRef disk )
 
         DADiskSetState( disk, kDADiskStateCommandActive, TRUE );
 
+        DATraceBegin( disk, "peek", NULL );
+
         __DAStagePeekCallback( NULL, disk );
 
         CFRelease( candidates );
@@ -603,6 +622,8 @@ static void __DAStagePeekCallback( CFTypeRef response, void * context )
         return;
     }
     
+    DATraceEnd( disk, "peek", NULL );
+
     DADiskSetState( disk, kDADiskStateCommandActive, FALSE );
 
     DADiskSetContext( disk, NULL );
@@ -643,6 +664,8 @@ static void __DAStageProbe( DADiskRef disk )
 
         DAUnitSetState( disk, kDAUnitStateCommandActive, TRUE );
 
+        DATraceBegin( disk, "probe", NULL );
+
         DAProbe( disk, __DAStageProbeCallback, disk );
     }
 }
@@ -659,6 +682,8 @@ static void __DAStageProbeCallback( int             status,
     CFMutableArrayRef keys;
     CFStringRef       kind;
 
+    DATraceEnd( disk, "probe", NULL );
+
     DADiskSetFileSystem( disk, filesystem );
 
     DADiskSetState( disk, kDADiskStateRequireRepair,       FALSE );
@@ -757,7 +782,7 @@ static void __DAStageProbeCallback( int             status,
          * Determine whether the disk is mounted.
          */
 
-        mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+        mountListCount = DAPlatformGetMountList( &mountList );
 
         for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
         {
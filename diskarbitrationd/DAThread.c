@@ -23,6 +23,8 @@
 
 #include "DAThread.h"
 
+#include "DAWatchdog.h"
+
 #include <pthread.h>
 #include <sysexits.h>
 #include <mach/mach.h>
@@ -124,6 +126,8 @@ static void __DAThreadRunLoopSourceCallback( CFMachPortRef port, void * message,
     __DAThreadRunLoopSourceJob * job     = NULL;
     __DAThreadRunLoopSourceJob * jobLast = NULL;
 
+    DAWatchdogBegin( "thread port" );
+
     pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
 
     /*
@@ -176,6 +180,8 @@ static void __DAThreadRunLoopSourceCallback( CFMachPortRef port, void * message,
     }
 
     pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+
+    DAWatchdogEnd( );
 }
 
 CFRunLoopSourceRef DAThreadCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order )
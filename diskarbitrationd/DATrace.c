@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "DATrace.h"
+
+#include "DABase.h"
+#include "DAMain.h"
+#include "DAMetrics.h"
+
+#define __kDATraceEventCount 2048
+
+/*
+ * Trace events are kept in a ring that holds the most recent events of every disk.  Each event
+ * names a stage boundary of a disk, optionally qualified by a key such as a file system kind or
+ * a client, and is recorded on the main thread.  The ring is rendered in the Chrome trace event
+ * format on demand, with a process per disk and a thread per key.  Each span is measured for the
+ * metrics as well.
+ */
+
+struct __DATraceEvent
+{
+    CFAbsoluteTime time;
+    const char *   name;
+    char           phase;
+    char           disk[47];
+    char           key[48];
+};
+
+typedef struct __DATraceEvent __DATraceEvent;
+
+static __DATraceEvent __gDATraceEventList[__kDATraceEventCount];
+static UInt64         __gDATraceEventListHead = 0;
+
+static void __DATraceAppend( DADiskRef disk, const char * name, const char * key, char phase )
+{
+    __DATraceEvent * event;
+
+    event = __gDATraceEventList + ( __gDATraceEventListHead % __kDATraceEventCount );
+
+    event->time  = CFAbsoluteTimeGetCurrent( );
+    event->name  = name;
+    event->phase = phase;
+
+    strlcpy( event->disk, disk ? DADiskGetID( disk ) : "", sizeof( event->disk ) );
+    strlcpy( event->key,  key  ? key                 : "", sizeof( event->key  ) );
+
+    __gDATraceEventListHead++;
+}
+
+static void __DATraceAppendFormat( CFMutableDataRef data, const char * format, ... )
+{
+    char *  buffer;
+    va_list arguments;
+
+    va_start( arguments, format );
+
+    vasprintf( &buffer, format, arguments );
+
+    va_end( arguments );
+
+    if ( buffer )
+    {
+        CFDataAppendBytes( data, ( void * ) buffer, strlen( buffer ) );
+
+        free( buffer );
+    }
+}
+
+static void __DATraceAppendString( CFMutableDataRef data, const char * string )
+{
+    /*
+     * Append a JSON string literal.
+     */
+
+    CFDataAppendBytes( data, ( void * ) "\"", 1 );
+
+    for ( ; *string; string++ )
+    {
+        if ( *string == '"' || *string == '\\' )
+        {
+            __DATraceAppendFormat( data, "\\%c", *string );
+        }
+        else if ( ( unsigned char ) *string < 0x20 )
+        {
+            __DATraceAppendFormat( data, "\\u%04x", ( unsigned char ) *string );
+        }
+        else
+        {
+            CFDataAppendBytes( data, ( void * ) string, 1 );
+        }
+    }
+
+    CFDataAppendBytes( data, ( void * ) "\"", 1 );
+}
+
+static CFIndex __DATraceGetLane( CFMutableDictionaryRef lanes, CFStringRef lane, CFMutableDataRef data, const char * metadata, CFIndex pid, const char * name )
+{
+    /*
+     * Obtain the number of the lane for a disk, or for a key of a disk, announcing its name the first
+     * time that it is seen.  A disk lane is a process and a key lane is a thread of the disk's process.
+     */
+
+    CFNumberRef number;
+    CFIndex     value;
+
+    number = CFDictionaryGetValue( lanes, lane );
+
+    if ( number )
+    {
+        return ___CFNumberGetIntegerValue( number );
+    }
+
+    value = CFDictionaryGetCount( lanes ) + 1;
+
+    number = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, value );
+
+    if ( number )
+    {
+        CFDictionarySetValue( lanes, lane, number );
+
+        CFRelease( number );
+    }
+
+    __DATraceAppendFormat( data, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":", metadata, pid ? pid : value, pid ? value : 0 );
+
+    __DATraceAppendString( data, name );
+
+    __DATraceAppendFormat( data, "}},\n" );
+
+    return value;
+}
+
+void DATraceBegin( DADiskRef disk, const char * name, const char * key )
+{
+    __DATraceAppend( disk, name, key, 'B' );
+
+    DAMetricsBegin( disk, name, key );
+}
+
+CFDataRef DATraceCopyTimeline( void )
+{
+    CFMutableDataRef data;
+
+    data = CFDataCreateMutable( kCFAllocatorDefault, 0 );
+
+    if ( data )
+    {
+        CFMutableDictionaryRef disks;
+        CFMutableDictionaryRef keys;
+
+        disks = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+        keys  = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        if ( disks && keys )
+        {
+            UInt64 index;
+
+            index = ( __gDATraceEventListHead > __kDATraceEventCount ) ? __gDATraceEventListHead - __kDATraceEventCount : 0;
+
+            __DATraceAppendFormat( data, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"process\":" );
+
+            __DATraceAppendString( data, gDAProcessNameID );
+
+            __DATraceAppendFormat( data, "},\"traceEvents\":[\n" );
+
+            for ( ; index < __gDATraceEventListHead; index++ )
+            {
+                __DATraceEvent * event;
+                CFStringRef      lane;
+                CFIndex          pid = 0;
+                CFIndex          tid = 0;
+
+                event = __gDATraceEventList + ( index % __kDATraceEventCount );
+
+                lane = CFStringCreateWithCString( kCFAllocatorDefault, event->disk, kCFStringEncodingUTF8 );
+
+                if ( lane )
+                {
+                    pid = __DATraceGetLane( disks, lane, data, "process_name", 0, event->disk[0] ? event->disk : gDAProcessNameID );
+
+                    CFRelease( lane );
+                }
+
+                lane = CFStringCreateWithFormat( kCFAllocatorDefault, NULL, CFSTR( "%s\n%s" ), event->disk, event->key );
+
+                if ( lane )
+                {
+                    tid = __DATraceGetLane( keys, lane, data, "thread_name", pid, event->key[0] ? event->key : "stages" );
+
+                    CFRelease( lane );
+                }
+
+                __DATraceAppendFormat( data, "{\"name\":" );
+
+                __DATraceAppendString( data, event->name );
+
+                __DATraceAppendFormat( data,
+                                       ",\"cat\":\"disk\",\"ph\":\"%c\",%s\"ts\":%.0f,\"pid\":%ld,\"tid\":%ld},\n",
+                                       event->phase,
+                                       event->phase == 'i' ? "\"s\":\"t\"," : "",
+                                       event->time * 1000000.0,
+                                       pid,
+                                       tid );
+            }
+
+            /*
+             * Close the event list with a metadata record, as JSON permits no trailing comma.
+             */
+
+            __DATraceAppendFormat( data, "{\"name\":\"trace_complete\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"count\":%llu}}\n]}\n", __gDATraceEventListHead );
+        }
+
+        if ( disks )  CFRelease( disks );
+        if ( keys  )  CFRelease( keys  );
+    }
+
+    return data;
+}
+
+void DATraceEnd( DADiskRef disk, const char * name, const char * key )
+{
+    __DATraceAppend( disk, name, key, 'E' );
+
+    DAMetricsEnd( disk, name, key );
+}
+
+void DATraceInstant( DADiskRef disk, const char * name, const char * key )
+{
+    __DATraceAppend( disk, name, key, 'i' );
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 1998-2016 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "DAWatchdog.h"
+
+#include "DALog.h"
+#include "DAMetrics.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define __kDAWatchdogInterval 250000
+#define __kDAWatchdogLimit    0.5
+
+/*
+ * Every source of the server is served on the main run loop, such that a callout that blocks
+ * stalls every client.  The watchdog measures each iteration of the run loop and each callout
+ * from a source, which is named by the callout itself.  A callout that runs past the limit is
+ * logged when it returns, and a watchdog thread logs one that has yet to return.
+ */
+
+static const char *    __gDAWatchdogCallout       = NULL;
+static UInt32          __gDAWatchdogCalloutDepth  = 0;
+static UInt64          __gDAWatchdogCalloutTime   = 0;
+static UInt64          __gDAWatchdogGeneration    = 0;
+static UInt64          __gDAWatchdogIterationTime = 0;
+static pthread_mutex_t __gDAWatchdogLock          = PTHREAD_MUTEX_INITIALIZER;
+
+static CFTimeInterval __DAWatchdogGetInterval( UInt64 time )
+{
+    return ( clock_gettime_nsec_np( CLOCK_UPTIME_RAW ) - time ) / 1000000000.0;
+}
+
+static void __DAWatchdogRunLoopObserverCallback( CFRunLoopObserverRef observer, CFRunLoopActivity activity, void * info )
+{
+    UInt64 time;
+
+    /*
+     * An iteration runs from the timers that begin it to the next iteration, or to the wait that
+     * ends it.
+     */
+
+    pthread_mutex_lock( &__gDAWatchdogLock );
+
+    time = __gDAWatchdogIterationTime;
+
+    __gDAWatchdogIterationTime = ( activity == kCFRunLoopBeforeTimers ) ? clock_gettime_nsec_np( CLOCK_UPTIME_RAW ) : 0;
+
+    __gDAWatchdogGeneration++;
+
+    pthread_mutex_unlock( &__gDAWatchdogLock );
+
+    if ( time )
+    {
+        DAMetricsRecordInterval( "run loop iteration", NULL, __DAWatchdogGetInterval( time ) );
+    }
+}
+
+static void * __DAWatchdogThread( void * context )
+{
+    UInt64 generation = 0;
+
+    for ( ; ; )
+    {
+        const char *   callout = NULL;
+        CFTimeInterval interval = 0;
+
+        usleep( __kDAWatchdogInterval );
+
+        pthread_mutex_lock( &__gDAWatchdogLock );
+
+        if ( __gDAWatchdogGeneration != generation )
+        {
+            UInt64 time;
+
+            time = __gDAWatchdogCallout ? __gDAWatchdogCalloutTime : __gDAWatchdogIterationTime;
+
+            if ( time )
+            {
+                interval = __DAWatchdogGetInterval( time );
+
+                if ( interval >= __kDAWatchdogLimit )
+                {
+                    callout = __gDAWatchdogCallout ? __gDAWatchdogCallout : "unattributed";
+
+                    generation = __gDAWatchdogGeneration;
+                }
+            }
+        }
+
+        pthread_mutex_unlock( &__gDAWatchdogLock );
+
+        if ( callout )
+        {
+            DALogError( "run loop stalled, %s callout running for %.3f s.", callout, interval );
+        }
+    }
+
+    return NULL;
+}
+
+void DAWatchdogBegin( const char * source )
+{
+    /*
+     * Note the start of a callout from a source.  A callout made from within another is counted
+     * against the outer one.
+     */
+
+    if ( __gDAWatchdogCalloutDepth++ == 0 )
+    {
+        pthread_mutex_lock( &__gDAWatchdogLock );
+
+        __gDAWatchdogCallout     = source;
+        __gDAWatchdogCalloutTime = clock_gettime_nsec_np( CLOCK_UPTIME_RAW );
+
+        __gDAWatchdogGeneration++;
+
+        pthread_mutex_unlock( &__gDAWatchdogLock );
+    }
+}
+
+CFRunLoopObserverRef DAWatchdogCreateRunLoopObserver( CFAllocatorRef allocator, CFIndex order )
+{
+    /*
+     * Create a CFRunLoopObserver for the watchdog, and start the watchdog thread.
+     */
+
+    CFRunLoopObserverRef observer;
+
+    observer = CFRunLoopObserverCreate( allocator, kCFRunLoopBeforeTimers | kCFRunLoopBeforeWaiting, TRUE, order, __DAWatchdogRunLoopObserverCallback, NULL );
+
+    if ( observer )
+    {
+        pthread_t thread;
+
+        if ( pthread_create( &thread, NULL, __DAWatchdogThread, NULL ) == 0 )
+        {
+            pthread_detach( thread );
+        }
+        else
+        {
+            CFRelease( observer );
+
+            observer = NULL;
+        }
+    }
+
+    return observer;
+}
+
+void DAWatchdogEnd( void )
+{
+    if ( --__gDAWatchdogCalloutDepth == 0 )
+    {
+        const char *   callout;
+        CFTimeInterval interval;
+
+        pthread_mutex_lock( &__gDAWatchdogLock );
+
+        callout  = __gDAWatchdogCallout;
+        interval = __DAWatchdogGetInterval( __gDAWatchdogCalloutTime );
+
+        __gDAWatchdogCallout = NULL;
+
+        __gDAWatchdogGeneration++;
+
+        pthread_mutex_unlock( &__gDAWatchdogLock );
+
+        DAMetricsRecordInterval( "callout", callout, interval );
+
+        if ( interval >= __kDAWatchdogLimit )
+        {
+            DAMetricsCount( "callout stall", callout );
+
+            DALogError( "run loop stalled, %s callout ran for %.3f s.", callout, interval );
+        }
+    }
+}